@@ -0,0 +1,440 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+// Micro-benchmarks of the stages of reading and summarizing reads, and the
+// throughput of each reader, on synthetic reads, printed as one line per
+// benchmark with the time per iteration and the rates of reads and bytes.
+// Usage:
+//   falco_benchmark [options]               runs the benchmarks
+//   falco_benchmark -generate out.fq [...]  writes the synthetic reads
+
+#include "synthetic_fastq.hpp"
+
+#include "FalcoConfig.hpp"
+#include "FastqStats.hpp"
+#include "StreamReader.hpp"
+#include "SequenceTable.hpp"
+#include "Module.hpp"
+#include "OptionParser.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <zlib.h>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::runtime_error;
+using std::string;
+using std::vector;
+using std::unique_ptr;
+
+typedef std::chrono::steady_clock steady_clock;
+
+/*******************************************************/
+/*************** BENCHMARK RUNNER **********************/
+/*******************************************************/
+// Each benchmark runs at least once and then in batches of growing size
+// until it took min_seconds, and reports the mean of all runs after the
+// first, which warms up caches and allocations.
+struct BenchmarkRunner {
+  double min_seconds;
+  string filter;
+
+  // run returns a checksum that keeps the compiler from removing the work
+  void run(const string &name, const size_t items, const size_t bytes,
+           const std::function<size_t()> &run_once) const;
+  void print_header() const;
+};
+
+void
+BenchmarkRunner::print_header() const {
+  cout << std::left << std::setw(48) << "benchmark" << std::right
+       << std::setw(14) << "ms/iter" << std::setw(8) << "iters"
+       << std::setw(14) << "Mreads/s" << std::setw(12) << "MB/s" << endl;
+}
+
+void
+BenchmarkRunner::run(const string &name, const size_t items,
+                     const size_t bytes,
+                     const std::function<size_t()> &run_once) const {
+  if (!filter.empty() && name.find(filter) == string::npos)
+    return;
+
+  volatile size_t checksum = run_once();
+  size_t iterations = 0;
+  double seconds = 0.0;
+  for (size_t batch = 1; seconds < min_seconds; batch *= 2) {
+    const steady_clock::time_point start = steady_clock::now();
+    for (size_t i = 0; i < batch; ++i)
+      checksum = checksum + run_once();
+    seconds += std::chrono::duration<double>(
+      steady_clock::now() - start).count();
+    iterations += batch;
+  }
+
+  const double per_iteration = seconds / iterations;
+  cout << std::left << std::setw(48) << name << std::right << std::fixed
+       << std::setprecision(3) << std::setw(14) << 1e3 * per_iteration
+       << std::setw(8) << iterations << std::setprecision(2)
+       << std::setw(14) << (items / per_iteration) / 1e6 << std::setw(12);
+  if (bytes == 0)
+    cout << "-" << endl;
+  else
+    cout << (bytes / per_iteration) / (1 << 20) << endl;
+}
+
+/*******************************************************/
+/*************** SYNTHETIC INPUTS **********************/
+/*******************************************************/
+// a file removed when it goes out of scope
+struct TempFile {
+  string path;
+  explicit TempFile(const string &_path) : path(_path) {}
+  ~TempFile() { remove(path.c_str()); }
+  size_t size() const {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    return static_cast<size_t>(in.tellg());
+  }
+};
+
+static void
+write_fastq_file(const string &path, const SyntheticReadsOptions &opts) {
+  std::ofstream out(path, std::ios::binary);
+  write_synthetic_fastq(out, opts);
+  if (!out.good())
+    throw runtime_error("failed to write " + path);
+}
+
+static void
+write_sam_file(const string &path, const SyntheticReadsOptions &opts) {
+  std::ofstream out(path, std::ios::binary);
+  write_synthetic_sam(out, opts);
+  if (!out.good())
+    throw runtime_error("failed to write " + path);
+}
+
+static void
+write_fastq_gz_file(const string &path, const SyntheticReadsOptions &opts) {
+  gzFile out = gzopen(path.c_str(), "wb6");
+  if (!out)
+    throw runtime_error("failed to write " + path);
+  SyntheticReads reads(opts);
+  string name, seq, qual;
+  while (reads.next(name, seq, qual)) {
+    const string record =
+      "@" + name + " 1:N:0:1\n" + seq + "\n+\n" + qual + "\n";
+    gzwrite(out, record.data(), record.size());
+  }
+  gzclose(out);
+}
+
+/*******************************************************/
+/*************** READER STAGES *************************/
+/*******************************************************/
+// reads a whole file with the pipeline falco would compile for config
+template <class Reader> static size_t
+read_file(FalcoConfig &config, FastqStats &stats) {
+  Reader in(config, FastqStats::SHORT_READ_THRESHOLD);
+  in.load();
+  size_t num_bytes = 0;
+  switch (ReaderModules::pipeline_for(config)) {
+    case ReaderModules::all:
+      while (in.template read_entry_with<ReaderModules::all>(stats, num_bytes));
+      break;
+    case ReaderModules::no_kmer:
+      while (in.template read_entry_with<ReaderModules::no_kmer>(stats,
+                                                                 num_bytes));
+      break;
+    case ReaderModules::quality_only:
+      while (in.template read_entry_with<ReaderModules::quality_only>(
+        stats, num_bytes));
+      break;
+    default:
+      while (in.read_entry(stats, num_bytes));
+  }
+  return stats.num_reads;
+}
+
+template <class Reader> static size_t
+read_file(FalcoConfig &config) {
+  unique_ptr<FastqStats> stats(new FastqStats);
+  return read_file<Reader>(config, *stats);
+}
+
+static FalcoConfig
+config_for_file(const FalcoConfig &base, const string &filename) {
+  FalcoConfig config(base);
+  config.filename = filename;
+  config.format = "";
+  config.setup();
+  return config;
+}
+
+static void
+set_modules(FalcoConfig &config, const bool quality, const bool sequence,
+            const bool duplication, const bool others, const bool kmer) {
+  config.do_quality_base = config.do_quality_sequence = quality;
+  config.do_tile = quality;
+  config.do_sequence = config.do_n_content = sequence;
+  config.do_gc_sequence = config.do_sequence_length = sequence;
+  config.do_duplication = config.do_overrepresented = duplication;
+  config.do_adapter = others;
+  config.do_kmer = kmer;
+}
+
+// The line parsers and postprocess_fastq_record are inlined into the
+// reader, so each stage is timed by adding its modules to a pipeline
+// that already has the stages before it
+static void
+bench_reader_stages(const BenchmarkRunner &runner, const FalcoConfig &base,
+                    const TempFile &fastq, const size_t num_reads) {
+  struct Stage {
+    string name;
+    bool quality, sequence, duplication, others, kmer;
+  };
+  const vector<Stage> stages = {
+    {"read_quality_line (qualities, tiles)", true, false, false, false, false},
+    {"read_sequence_line (+bases, GC, lengths)",
+     true, true, false, false, false},
+    {"postprocess_fastq_record (+duplication)",
+     true, true, true, false, false},
+    {"reader default modules (+adapters)", true, true, true, true, false},
+    {"reader all modules (+k-mers)", true, true, true, true, true}
+  };
+
+  for (const Stage &s : stages) {
+    FalcoConfig config = config_for_file(base, fastq.path);
+    set_modules(config, s.quality, s.sequence, s.duplication, s.others,
+                s.kmer);
+    runner.run("stage/" + s.name, num_reads, fastq.size(), [&]() {
+      return read_file<FastqReader>(config);
+    });
+  }
+}
+
+// the duplication table lookups of postprocess_fastq_record on their own
+static void
+bench_sequence_table(const BenchmarkRunner &runner,
+                     const SyntheticReadsOptions &opts) {
+  vector<string> seqs;
+  SyntheticReads reads(opts);
+  string name, seq, qual;
+  while (reads.next(name, seq, qual)) {
+    if (seq.size() > Constants::unique_reads_max_length)
+      seq.resize(Constants::unique_reads_truncate);
+    seqs.push_back(seq);
+  }
+
+  runner.run("stage/SequenceTable::find_or_add", seqs.size(), 0, [&]() {
+    SequenceTable table;
+    size_t num_unique = 0;
+    for (const string &s : seqs) {
+      bool is_new;
+      const bool can_add = num_unique < Constants::unique_reads_stop_counting;
+      const size_t ind = table.find_or_add(s.data(), s.size(), can_add,
+                                           is_new);
+      if (ind != SequenceTable::not_found) {
+        ++table.count(ind);
+        num_unique += is_new;
+      }
+    }
+    return table.size();
+  });
+}
+
+// the GC model cell of each short read, as the reader counts it, and the
+// models applied to the counts as the GC module does when summarized
+static void
+bench_gc_model(const BenchmarkRunner &runner,
+               const SyntheticReadsOptions &opts) {
+  vector<size_t> cells;
+  SyntheticReads reads(opts);
+  string name, seq, qual;
+  while (reads.next(name, seq, qual)) {
+    // reads are truncated to 100 bases for the model
+    const size_t len = std::min(seq.size(), FastqStats::kGCTruncation);
+    size_t gc = 0;
+    for (size_t i = 0; i < len; ++i)
+      gc += (seq[i] == 'G' || seq[i] == 'C');
+    cells.push_back(FastqStats::gc_cell(len, gc));
+  }
+
+  unique_ptr<FastqStats> stats(new FastqStats);
+  runner.run("stage/GCModel cell counts", cells.size(), 0, [&]() {
+    for (const size_t cell : cells)
+      ++stats->gc_cell_count[cell];
+    return stats->gc_cell_count[cells[0]];
+  });
+
+  runner.run("stage/GCModel smoothing", 0, 0, [&]() {
+    std::array<double, 101> gc_count;
+    stats->get_gc_count(gc_count);
+    return static_cast<size_t>(gc_count[50]);
+  });
+}
+
+/*******************************************************/
+/*************** MODULE SUMMARIES **********************/
+/*******************************************************/
+template <class T> static void
+bench_module(const BenchmarkRunner &runner, const FalcoConfig &config,
+             FastqStats &stats) {
+  runner.run("summarize/" + T::module_name, stats.num_reads, 0, [&]() {
+    T module(config);
+    module.summarize(stats);
+    return module.grade.size();
+  });
+}
+
+static void
+bench_modules(const BenchmarkRunner &runner, const FalcoConfig &base,
+              const TempFile &fastq) {
+  FalcoConfig config = config_for_file(base, fastq.path);
+  set_modules(config, true, true, true, true, true);
+  unique_ptr<FastqStats> stats(new FastqStats);
+  read_file<FastqReader>(config, *stats);
+  stats->summarize();
+
+  bench_module<ModuleBasicStatistics>(runner, config, *stats);
+  bench_module<ModulePerBaseSequenceQuality>(runner, config, *stats);
+  bench_module<ModulePerTileSequenceQuality>(runner, config, *stats);
+  bench_module<ModulePerSequenceQualityScores>(runner, config, *stats);
+  bench_module<ModulePerBaseSequenceContent>(runner, config, *stats);
+  bench_module<ModulePerSequenceGCContent>(runner, config, *stats);
+  bench_module<ModulePerBaseNContent>(runner, config, *stats);
+  bench_module<ModuleSequenceLengthDistribution>(runner, config, *stats);
+  bench_module<ModuleSequenceDuplicationLevels>(runner, config, *stats);
+  bench_module<ModuleOverrepresentedSequences>(runner, config, *stats);
+  bench_module<ModuleAdapterContent>(runner, config, *stats);
+  bench_module<ModuleKmerContent>(runner, config, *stats);
+}
+
+/*******************************************************/
+/*************** READER THROUGHPUT *********************/
+/*******************************************************/
+// whole files read with the default modules by each reader, with MB/s
+// of the file as it is stored
+template <class Reader> static void
+bench_throughput(const BenchmarkRunner &runner, const FalcoConfig &base,
+                 const string &name, const TempFile &file,
+                 const size_t num_reads) {
+  FalcoConfig config = config_for_file(base, file.path);
+  runner.run("throughput/" + name, num_reads, file.size(), [&]() {
+    return read_file<Reader>(config);
+  });
+}
+
+int
+main(int argc, const char **argv) {
+  try {
+    SyntheticReadsOptions opts;
+    BenchmarkRunner runner;
+    runner.min_seconds = 1.0;
+    string generate_file;
+    string tmpdir = "/tmp";
+    bool generate_sam = false;
+
+    OptionParser opt_parse(argv[0],
+                           "micro-benchmarks of falco on synthetic reads");
+    opt_parse.set_show_defaults();
+    opt_parse.add_opt("reads", 'n', "number of reads", false,
+                      opts.num_reads);
+    opt_parse.add_opt("length", 'l', "read length", false, opts.read_length);
+    opt_parse.add_opt("n-rate", 'N', "probability of a base being N", false,
+                      opts.n_rate);
+    opt_parse.add_opt("duplication", 'd',
+                      "probability of a read repeating an earlier one",
+                      false, opts.duplication_rate);
+    opt_parse.add_opt("tiles", 't', "tiles in read names (0 for no tiles)",
+                      false, opts.num_tiles);
+    opt_parse.add_opt("seed", 's', "random seed", false, opts.seed);
+    opt_parse.add_opt("min-time", 'm', "minimum seconds per benchmark",
+                      false, runner.min_seconds);
+    opt_parse.add_opt("filter", 'f',
+                      "only run benchmarks whose name contains this",
+                      false, runner.filter);
+    opt_parse.add_opt("tmpdir", 'T', "directory for the synthetic files",
+                      false, tmpdir);
+    opt_parse.add_opt("generate", 'g',
+                      "write the synthetic reads to this file and exit",
+                      false, generate_file);
+    opt_parse.add_opt("sam", '\0', "with -generate, write SAM instead of "
+                      "FASTQ", false, generate_sam);
+
+    vector<string> leftover_args;
+    opt_parse.parse(argc, argv, leftover_args);
+    if (opt_parse.help_requested()) {
+      cerr << opt_parse.help_message() << endl;
+      return EXIT_SUCCESS;
+    }
+    if (opts.read_length == 0 || opts.num_reads == 0)
+      throw runtime_error("read length and number of reads must be positive");
+
+    if (!generate_file.empty()) {
+      if (generate_sam)
+        write_sam_file(generate_file, opts);
+      else
+        write_fastq_file(generate_file, opts);
+      return EXIT_SUCCESS;
+    }
+
+    FalcoConfig base(argc, argv);
+    base.quiet = true;
+    base.read_config_files();
+
+    const string prefix =
+      tmpdir + "/falco_benchmark_" + std::to_string(getpid());
+    const TempFile fastq(prefix + ".fastq");
+    const TempFile fastq_gz(prefix + ".fastq.gz");
+    const TempFile sam(prefix + ".sam");
+    write_fastq_file(fastq.path, opts);
+    write_fastq_gz_file(fastq_gz.path, opts);
+    write_sam_file(sam.path, opts);
+
+    cout << "reads: " << opts.num_reads << " of " << opts.read_length
+         << " bases, N rate " << opts.n_rate << ", duplication rate "
+         << opts.duplication_rate << ", " << opts.num_tiles << " tiles"
+         << endl;
+    runner.print_header();
+
+    bench_reader_stages(runner, base, fastq, opts.num_reads);
+    bench_sequence_table(runner, opts);
+    bench_gc_model(runner, opts);
+    bench_modules(runner, base, fastq);
+    bench_throughput<FastqReader>(runner, base, "FastqReader (mapped fastq)",
+                                  fastq, opts.num_reads);
+    bench_throughput<GzFastqReader>(runner, base, "GzFastqReader (fastq.gz)",
+                                    fastq_gz, opts.num_reads);
+    bench_throughput<SamReader>(runner, base, "SamReader (sam)", sam,
+                                opts.num_reads);
+  }
+  catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+// Per-base time of the sequence and quality line kernels, in their plain
+// loop and SIMD versions, on random reads of a given length. Usage:
+//   kernel_benchmark [read length] [number of reads]
+
+#include "SimdKernels.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+static const size_t num_repeats = 20;
+
+struct Reads {
+  size_t read_length;
+  size_t num_reads;
+  vector<char> bases;
+  vector<char> quals;
+};
+
+static Reads
+make_reads(const size_t read_length, const size_t num_reads) {
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> base(0, 99);
+  std::uniform_int_distribution<int> qual('#', 'J');
+  static const char acgt[] = {'A', 'C', 'G', 'T'};
+
+  Reads reads;
+  reads.read_length = read_length;
+  reads.num_reads = num_reads;
+  reads.bases.resize(read_length * num_reads);
+  reads.quals.resize(read_length * num_reads);
+  for (size_t i = 0; i < reads.bases.size(); ++i) {
+    const int b = base(gen);
+    reads.bases[i] = (b == 0) ? 'N' : acgt[b & 3];
+    reads.quals[i] = static_cast<char>(qual(gen));
+  }
+  return reads;
+}
+
+/*******************************************************/
+/*************** KERNEL TIMING *************************/
+/*******************************************************/
+// the checksum keeps the compiler from removing the work
+struct Timing {
+  double ns_per_base;
+  size_t checksum;
+};
+
+template <class Kernel> static Timing
+time_kernel(const Reads &reads, Kernel kernel) {
+  typedef std::chrono::steady_clock clock;
+  Timing ans;
+  ans.checksum = 0;
+  const clock::time_point start = clock::now();
+  for (size_t r = 0; r < num_repeats; ++r)
+    for (size_t i = 0; i < reads.num_reads; ++i)
+      ans.checksum += kernel(i * reads.read_length);
+  const double ns = std::chrono::duration<double, std::nano>(
+    clock::now() - start).count();
+  ans.ns_per_base = ns / (num_repeats * reads.bases.size());
+  return ans;
+}
+
+static void
+report(const string &name, const Timing &scalar, const Timing &simd) {
+  if (scalar.checksum != simd.checksum)
+    throw runtime_error("kernels disagree in " + name);
+  cout << name << "\t" << scalar.ns_per_base << "\t" << simd.ns_per_base
+       << "\t" << scalar.ns_per_base / simd.ns_per_base << endl;
+}
+
+int
+main(int argc, char **argv) {
+  try {
+    const size_t read_length = (argc > 1) ? atoi(argv[1]) : 150;
+    const size_t num_reads = (argc > 2) ? atoi(argv[2]) : 100000;
+    if (read_length == 0 || num_reads == 0)
+      throw runtime_error("read length and number of reads must be positive");
+
+    const Reads reads = make_reads(read_length, num_reads);
+    vector<uint8_t> codes(read_length);
+
+    cout << "kernels: " << simd_kernels_name() << endl;
+    cout << "read length: " << read_length << endl;
+    cout << "kernel\tscalar ns/base\tsimd ns/base\tspeedup" << endl;
+
+    const char *bases = reads.bases.data();
+    const char *quals = reads.quals.data();
+    uint8_t *c = codes.data();
+
+    // conversion to 2-bit codes and GC count of the whole sequence line
+    report("sequence",
+      time_kernel(reads, [&](const size_t off) {
+        encode_bases_scalar(bases + off, read_length, c);
+        return count_gc_scalar(c, read_length) + c[read_length - 1];
+      }),
+      time_kernel(reads, [&](const size_t off) {
+        encode_bases(bases + off, read_length, c);
+        return count_gc(c, read_length) + c[read_length - 1];
+      })
+    );
+
+    // lowest character and sum of the quality line
+    report("quality",
+      time_kernel(reads, [&](const size_t off) {
+        char lowest = 127;
+        int64_t sum = 0;
+        summarize_quality_scalar(quals + off, read_length, lowest, sum);
+        return static_cast<size_t>(sum) + lowest;
+      }),
+      time_kernel(reads, [&](const size_t off) {
+        char lowest = 127;
+        int64_t sum = 0;
+        summarize_quality(quals + off, read_length, lowest, sum);
+        return static_cast<size_t>(sum) + lowest;
+      })
+    );
+  }
+  catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
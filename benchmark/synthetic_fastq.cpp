@@ -0,0 +1,101 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "synthetic_fastq.hpp"
+
+using std::string;
+using std::ostream;
+
+// reads kept to be repeated, enough that repeats are spread over many
+// duplication levels
+static const size_t pool_size = 4096;
+
+SyntheticReadsOptions::SyntheticReadsOptions() {
+  read_length = 150;
+  num_reads = 100000;
+  n_rate = 0.001;
+  duplication_rate = 0.2;
+  num_tiles = 16;
+  seed = 1;
+}
+
+/*******************************************************/
+/*************** SYNTHETIC READS ***********************/
+/*******************************************************/
+SyntheticReads::SyntheticReads(const SyntheticReadsOptions &_opts) :
+  opts(_opts), gen(_opts.seed) {
+  num_made = 0;
+}
+
+bool
+SyntheticReads::next(string &name, string &seq, string &qual) {
+  if (num_made == opts.num_reads)
+    return false;
+
+  std::uniform_real_distribution<double> unif(0.0, 1.0);
+  std::uniform_int_distribution<int> base(0, 3);
+  std::uniform_int_distribution<int> noise(-4, 4);
+  static const char acgt[] = {'A', 'C', 'G', 'T'};
+
+  if (!pool.empty() && unif(gen) < opts.duplication_rate) {
+    std::uniform_int_distribution<size_t> pick(0, pool.size() - 1);
+    seq = pool[pick(gen)];
+  }
+  else {
+    seq.resize(opts.read_length);
+    for (auto &c : seq)
+      c = (unif(gen) < opts.n_rate) ? 'N' : acgt[base(gen)];
+    if (pool.size() < pool_size)
+      pool.push_back(seq);
+    else
+      pool[num_made % pool_size] = seq;
+  }
+
+  // qualities drop from about 38 to 28 along the read, Phred+33
+  qual.resize(seq.size());
+  for (size_t i = 0; i < qual.size(); ++i) {
+    const int q = 38 - static_cast<int>((10 * i) / qual.size()) + noise(gen);
+    qual[i] = static_cast<char>(33 + ((seq[i] == 'N') ? 2 : q));
+  }
+
+  // instrument:run:flowcell:lane:tile:x:y, or a name without tiles
+  if (opts.num_tiles == 0)
+    name = "SYN" + std::to_string(num_made);
+  else
+    name = "SYN:1:FC001:1:" +
+           std::to_string(1101 + num_made % opts.num_tiles) + ":" +
+           std::to_string(num_made % 30000) + ":" +
+           std::to_string(num_made / 30000);
+
+  ++num_made;
+  return true;
+}
+
+void
+write_synthetic_fastq(ostream &out, const SyntheticReadsOptions &opts) {
+  SyntheticReads reads(opts);
+  string name, seq, qual;
+  while (reads.next(name, seq, qual))
+    out << '@' << name << " 1:N:0:1\n" << seq << "\n+\n" << qual << '\n';
+}
+
+void
+write_synthetic_sam(ostream &out, const SyntheticReadsOptions &opts) {
+  SyntheticReads reads(opts);
+  string name, seq, qual;
+  out << "@HD\tVN:1.6\tSO:unsorted\n";
+  while (reads.next(name, seq, qual))
+    out << name << "\t4\t*\t0\t0\t*\t*\t0\t0\t" << seq << '\t' << qual << '\n';
+}
@@ -0,0 +1,62 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef SYNTHETIC_FASTQ_HPP
+#define SYNTHETIC_FASTQ_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Shape of the reads made by SyntheticReads
+struct SyntheticReadsOptions {
+  size_t read_length;
+  size_t num_reads;
+  double n_rate;            // probability that a base is N
+  double duplication_rate;  // probability that a read repeats an earlier one
+  size_t num_tiles;         // tiles in the read names, none if zero
+  uint32_t seed;
+
+  SyntheticReadsOptions();
+};
+
+// A deterministic stream of Illumina-like reads: random bases, qualities
+// that drop along the read, CASAVA read names with tiles, and copies of
+// reads drawn from a pool of earlier reads so the duplication table sees
+// the requested rate of repeats
+class SyntheticReads {
+ public:
+  explicit SyntheticReads(const SyntheticReadsOptions &_opts);
+
+  // makes the next read, returning false after num_reads reads
+  bool next(std::string &name, std::string &seq, std::string &qual);
+
+ private:
+  const SyntheticReadsOptions opts;
+  std::mt19937 gen;
+  size_t num_made;
+  std::vector<std::string> pool;
+};
+
+// all reads written as one FASTQ or unaligned SAM file
+void
+write_synthetic_fastq(std::ostream &out, const SyntheticReadsOptions &opts);
+void
+write_synthetic_sam(std::ostream &out, const SyntheticReadsOptions &opts);
+
+#endif
@@ -0,0 +1,86 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "AdapterAutomaton.hpp"
+#include "aux.hpp"
+
+#include <queue>
+
+using std::string;
+using std::vector;
+using std::queue;
+
+static const uint32_t no_state = static_cast<uint32_t>(-1);
+
+AdapterAutomaton::AdapterAutomaton(const vector<string> &adapters) {
+  // build the trie of all adapters, storing the adapters that end in each
+  // node. Unfilled transitions are completed below
+  vector<uint32_t> trie(4, no_state);
+  vector<vector<uint32_t> > node_matches(1);
+  for (size_t i = 0; i < adapters.size(); ++i) {
+    if (adapters[i].empty()) continue;
+    uint32_t state = root;
+    for (const char c : adapters[i]) {
+      const uint8_t base = actg_to_2bit(c);
+      if (trie[(state << 2) | base] == no_state) {
+        trie[(state << 2) | base] = node_matches.size();
+        node_matches.push_back(vector<uint32_t>());
+        trie.resize(trie.size() + 4, no_state);
+      }
+      state = trie[(state << 2) | base];
+    }
+    node_matches[state].push_back(i);
+  }
+
+  // breadth-first search setting missing transitions to those of the
+  // longest proper suffix that is in the trie. A state inherits the
+  // matches of its suffix, which is always closer to the root
+  const size_t num_states = node_matches.size();
+  transitions = trie;
+  vector<uint32_t> suffix(num_states, root);
+  queue<uint32_t> to_visit;
+  for (uint8_t base = 0; base < 4; ++base) {
+    uint32_t &next = transitions[(root << 2) | base];
+    if (next == no_state)
+      next = root;
+    else
+      to_visit.push(next);
+  }
+  while (!to_visit.empty()) {
+    const uint32_t state = to_visit.front();
+    to_visit.pop();
+    const vector<uint32_t> &inherited = node_matches[suffix[state]];
+    node_matches[state].insert(end(node_matches[state]),
+                               begin(inherited), end(inherited));
+    for (uint8_t base = 0; base < 4; ++base) {
+      uint32_t &next = transitions[(state << 2) | base];
+      const uint32_t suffix_next = transitions[(suffix[state] << 2) | base];
+      if (next == no_state)
+        next = suffix_next;
+      else {
+        suffix[next] = suffix_next;
+        to_visit.push(next);
+      }
+    }
+  }
+
+  // flatten the matches of all states
+  match_start.push_back(0);
+  for (size_t i = 0; i < num_states; ++i) {
+    matches.insert(end(matches), begin(node_matches[i]),
+                   end(node_matches[i]));
+    match_start.push_back(matches.size());
+  }
+}
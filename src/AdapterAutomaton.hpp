@@ -0,0 +1,61 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef ADAPTERAUTOMATON_HPP
+#define ADAPTERAUTOMATON_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*************************************************************
+ ******************** ADAPTER AUTOMATON **********************
+ *************************************************************/
+// Aho-Corasick automaton over 2-bit bases that finds all occurrences of all
+// adapters, of any length, in a single pass through a read. States are the
+// prefixes of the adapters, and every state has a transition for each
+// base, so each base costs one table lookup. Bases that are not ACGT must
+// take the automaton back to the root.
+class AdapterAutomaton {
+ public:
+  explicit AdapterAutomaton(const std::vector<std::string> &adapters);
+
+  static const uint32_t root = 0;
+
+  // state after reading a 2-bit base
+  inline uint32_t next_state(const uint32_t state, const uint8_t base) const {
+    return transitions[(state << 2) | base];
+  }
+
+  // whether any adapter ends at the last base read to get to a state
+  inline bool has_matches(const uint32_t state) const {
+    return match_start[state] != match_start[state + 1];
+  }
+
+  // indices of the adapters that end at a state are in [first, last)
+  inline const uint32_t *matches_begin(const uint32_t state) const {
+    return matches.data() + match_start[state];
+  }
+  inline const uint32_t *matches_end(const uint32_t state) const {
+    return matches.data() + match_start[state + 1];
+  }
+
+ private:
+  std::vector<uint32_t> transitions;
+  std::vector<uint32_t> match_start;
+  std::vector<uint32_t> matches;
+};
+
+#endif
@@ -0,0 +1,162 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "ContaminantIndex.hpp"
+
+#include <algorithm>
+#include <limits>
+
+using std::string;
+using std::vector;
+using std::pair;
+using std::max;
+using std::min;
+
+const size_t ContaminantIndex::not_found =
+  std::numeric_limits<size_t>::max();
+
+size_t
+get_overlap(const string &left, const string &right) {
+  const auto left_st(begin(left));
+  const auto left_end(end(left));
+
+  const auto right_st(begin(right));
+  const auto right_end(end(right));
+
+  size_t best = 0;
+  const auto sz = left.size();
+  for (size_t start = 0; start < sz; ++start) {
+    size_t cur = 0;
+    auto left_it(left_st + start);
+    auto right_it(right_st);
+    for (; (left_it != left_end) && (right_it != right_end) && (*left_it == *right_it);
+        ++left_it, ++right_it, ++cur);
+
+    // does not accept if overlap does not cover a suffix or the
+    // entirety of right
+    cur = (left_it == left_end || right_it == right_end) ? (cur) : 0;
+    best = max(best, cur);
+  }
+  return best;
+}
+
+/*******************************************************/
+/*************** CONTAMINANT INDEX *********************/
+/*******************************************************/
+ContaminantIndex::ContaminantIndex(
+  const vector<pair<string, string> > &contaminants) {
+  first_with_prefix.resize(seed_size);
+  first_with_suffix.resize(seed_size);
+  for (size_t i = 0; i < contaminants.size(); ++i) {
+    const string &c = contaminants[i].second;
+    seqs.push_back(c);
+
+    for (size_t j = 0; j + seed_size <= c.size(); ++j) {
+      vector<size_t> &v = seed_contaminants[c.substr(j, seed_size)];
+      if (v.empty() || v.back() != i)
+        v.push_back(i);
+    }
+    if (c.size() >= seed_size)
+      first_seed[c.substr(0, seed_size)].push_back(i);
+
+    // emplace keeps the first contaminant with each key
+    for (size_t len = 1; len < seed_size && len <= c.size(); ++len) {
+      first_with_prefix[len].emplace(c.substr(0, len), i);
+      first_with_suffix[len].emplace(c.substr(c.size() - len), i);
+    }
+    if (!c.empty() && c.size() < seed_size)
+      first_short.emplace(c, i);
+  }
+}
+
+size_t
+ContaminantIndex::find_best_by_comparison(const string &seq,
+                                          size_t &best_overlap) const {
+  size_t best = not_found;
+  best_overlap = 0;
+  for (size_t i = 0; i < seqs.size(); ++i) {
+    const size_t cand = max(get_overlap(seqs[i], seq), get_overlap(seq, seqs[i]));
+    if (cand > best_overlap) {
+      best_overlap = cand;
+      best = i;
+    }
+  }
+  return best;
+}
+
+size_t
+ContaminantIndex::find_best(const string &seq, size_t &best_overlap) const {
+  if (seq.size() < seed_size)
+    return find_best_by_comparison(seq, best_overlap);
+
+  // contaminants that may overlap seq by at least seed_size bases
+  vector<size_t> candidates;
+  auto it = seed_contaminants.find(seq.substr(0, seed_size));
+  if (it != end(seed_contaminants))
+    candidates = it->second;
+  for (size_t i = 0; i + seed_size <= seq.size(); ++i) {
+    it = first_seed.find(seq.substr(i, seed_size));
+    if (it != end(first_seed))
+      candidates.insert(end(candidates), begin(it->second), end(it->second));
+  }
+  sort(begin(candidates), end(candidates));
+  candidates.erase(unique(begin(candidates), end(candidates)),
+                   end(candidates));
+
+  size_t best = not_found;
+  best_overlap = 0;
+  for (const size_t i : candidates) {
+    const size_t cand = max(get_overlap(seqs[i], seq), get_overlap(seq, seqs[i]));
+    if (cand > best_overlap) {
+      best_overlap = cand;
+      best = i;
+    }
+  }
+  if (best_overlap >= seed_size)
+    return best;
+
+  // No other contaminant overlaps seq by seed_size bases or more, so the
+  // overlap of all other contaminants is given by their ends. Any of them
+  // with the same overlap as the best so far also has it as its largest
+  // overlap, so the first of them wins
+  auto consider = [&](const size_t overlap, const size_t i) {
+    if (overlap > best_overlap || (overlap == best_overlap && i < best)) {
+      best_overlap = overlap;
+      best = i;
+    }
+  };
+  for (size_t len = 1; len < seed_size; ++len) {
+    // suffix of seq that is a prefix of a contaminant
+    auto p = first_with_prefix[len].find(seq.substr(seq.size() - len));
+    if (p != end(first_with_prefix[len]))
+      consider(len, p->second);
+
+    // prefix of seq that is a suffix of a contaminant
+    p = first_with_suffix[len].find(seq.substr(0, len));
+    if (p != end(first_with_suffix[len]))
+      consider(len, p->second);
+  }
+
+  // short contaminants contained in seq
+  if (!first_short.empty())
+    for (size_t len = 1; len < seed_size; ++len)
+      for (size_t i = 0; i + len <= seq.size(); ++i) {
+        auto p = first_short.find(seq.substr(i, len));
+        if (p != end(first_short))
+          consider(len, p->second);
+      }
+
+  return (best_overlap == 0) ? not_found : best;
+}
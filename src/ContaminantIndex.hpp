@@ -0,0 +1,75 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef CONTAMINANTINDEX_HPP
+#define CONTAMINANTINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+// gets the largest suffix of left which is a prefix of right, or the size
+// of right if it is contained in left. Returns 0 if none exist
+size_t
+get_overlap(const std::string &left, const std::string &right);
+
+/*************************************************************
+ ******************** CONTAMINANT INDEX **********************
+ *************************************************************/
+// Finds the contaminant with the largest overlap (as in get_overlap, in
+// either direction) with a sequence, without comparing the sequence to
+// every contaminant. An overlap of at least seed_size bases starts with
+// the first seed of one of the two sequences, so only contaminants that
+// contain the first seed of the sequence, or whose first seed is in the
+// sequence, are compared to it. Shorter overlaps can only cover the ends
+// of both sequences or a whole short contaminant, and are looked up in
+// tables of contaminant ends.
+class ContaminantIndex {
+ public:
+  static const size_t not_found;
+
+  // contaminants are (name, sequence) pairs
+  explicit ContaminantIndex(
+    const std::vector<std::pair<std::string, std::string> > &contaminants);
+
+  // Index of the first contaminant with the largest overlap with seq, and
+  // the size of the overlap, or not_found if no contaminant overlaps it
+  size_t find_best(const std::string &seq, size_t &best_overlap) const;
+
+ private:
+  static const size_t seed_size = 12;
+
+  std::vector<std::string> seqs;
+
+  // contaminants that contain each seed
+  std::unordered_map<std::string, std::vector<size_t> > seed_contaminants;
+
+  // contaminants by their first seed
+  std::unordered_map<std::string, std::vector<size_t> > first_seed;
+
+  // first contaminant with each prefix and suffix of a given size, for
+  // sizes up to seed_size - 1
+  std::vector<std::unordered_map<std::string, size_t> > first_with_prefix;
+  std::vector<std::unordered_map<std::string, size_t> > first_with_suffix;
+
+  // first contaminant with each sequence shorter than seed_size
+  std::unordered_map<std::string, size_t> first_short;
+
+  size_t find_best_by_comparison(const std::string &seq,
+                                 size_t &best_overlap) const;
+};
+
+#endif
@@ -22,9 +22,13 @@
 #include <unistd.h>
 #include <algorithm>
 #include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
 
 using std::ostringstream;
 using std::transform;
+using std::count;
 using std::string;
 using std::vector;
 using std::unordered_map;
@@ -319,6 +323,8 @@ FalcoConfig::FalcoConfig(const int argc, const char **argv) {
   read_step = 1;
   format = "";
   threads = 1;
+  memory_budget = 0;
+  sam_line_size = Constants::default_sam_line_size;
   trim_value_3p = 0;
   contaminants_file = string(PROGRAM_PATH) + "/Configuration/contaminant_list.txt";
   adapters_file = string(PROGRAM_PATH) + "/Configuration/adapter_list.txt";
@@ -336,6 +342,8 @@ FalcoConfig::FalcoConfig(const int argc, const char **argv) {
   is_bam = false;
   is_fastq = false;
   is_fastq_gz = false;
+  is_stdin = false;
+  is_pushed = false;
 
   ostringstream ost;
   for (int i = 0; i < argc; ++i) {
@@ -388,20 +396,94 @@ check_if_not_ignored(const T& limits_map,
   return ret;
 }
 
+void
+FalcoConfig::read_config_files() {
+  std::shared_ptr<ParsedConfigFiles> files(new ParsedConfigFiles);
+
+  // read which modules to run and the cutoffs for pass/warn/fail
+  read_limits(*files);
+
+  // Read files for appropriate modules
+  if (do_adapter) read_adapters(*files);
+  if (do_overrepresented) read_contaminants_file(*files);
+
+  files->adapter_automaton.reset(new AdapterAutomaton(files->adapter_seqs));
+  files->contaminant_index.reset(new ContaminantIndex(files->contaminants));
+  parsed = files;
+}
+
 void
 FalcoConfig::setup() {
+  if (!parsed)
+    throw runtime_error("configuration files must be read before any input");
+
   // Now check for the file format (FASTQ/SAM/BAM, compressed or not)
   define_file_format();
 
   // Get filename without absolute path
-  filename_stripped = strip_path(filename);
+  filename_stripped = is_stdin ? "stdin" : strip_path(filename);
+}
 
-  // read which modules to run and the cutoffs for pass/warn/fail
-  read_limits();
+// bytes of standard input used to detect its format
+static const size_t stdin_head_size = (1 << 16);
 
-  // Read files for appropriate modules
-  if (do_adapter) read_adapters();
-  if (do_overrepresented) read_contaminants_file();
+static bool
+is_gzipped(const vector<char> &data) {
+  return data.size() >= 2 && static_cast<unsigned char>(data[0]) == 31 &&
+         static_cast<unsigned char>(data[1]) == 139;
+}
+
+// decompresses as much of the start of a gzip stream as is in data
+static string
+inflate_start(const vector<char> &data) {
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  if (inflateInit2(&strm, MAX_WBITS + 32) != Z_OK)
+    throw runtime_error("cannot allocate gzip decompressor");
+
+  string ans(4*stdin_head_size, '\0');
+  strm.next_in =
+    reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  strm.avail_in = data.size();
+  strm.next_out = reinterpret_cast<Bytef*>(&ans[0]);
+  strm.avail_out = ans.size();
+  inflate(&strm, Z_SYNC_FLUSH);
+  ans.resize(ans.size() - strm.avail_out);
+  inflateEnd(&strm);
+  return ans;
+}
+
+// guesses the format from the first bytes of standard input
+static string
+detect_stdin_format(const vector<char> &head, const string &text) {
+  if (text.compare(0, 4, string("BAM\1", 4)) == 0)
+    throw runtime_error("BAM from standard input requires --format bam");
+  if (is_gzipped(head))
+    return "fastq.gz";
+
+  const string first_line = text.substr(0, text.find_first_of("\r\n"));
+  // SAM header lines have a two letter record type
+  if (first_line.size() > 3 && first_line[0] == '@' &&
+      isupper(first_line[1]) && isupper(first_line[2]) &&
+      first_line[3] == '\t')
+    return "sam";
+  if (first_line.empty() || first_line[0] == '@')
+    return "fastq";
+  if (count(begin(first_line), end(first_line), '\t') >= 10)
+    return "sam";
+  throw runtime_error("cannot detect the format of standard input, "
+                      "use --format to specify it");
+}
+
+void
+FalcoConfig::read_stdin_head() {
+  stdin_head.resize(stdin_head_size);
+  stdin_head.resize(fread(stdin_head.data(), 1, stdin_head_size, stdin));
+  if (ferror(stdin))
+    throw runtime_error("problem reading standard input");
+
+  stdin_text = is_gzipped(stdin_head) ? inflate_start(stdin_head) :
+               string(begin(stdin_head), end(stdin_head));
 }
 
 void
@@ -410,10 +492,21 @@ FalcoConfig::define_file_format() {
   string tmp_filename = filename;
   transform(begin(tmp_filename), end(tmp_filename), begin(tmp_filename), tolower);
 
+  // BAM files are read by htslib, which takes "-" as standard input itself
+  is_stdin = (filename == "-");
+  stdin_head.clear();
+  stdin_text.clear();
+  if (is_stdin && format != "bam")
+    read_stdin_head();
+
+  // standard input has no name to guess the format from
+  const string file_format = (is_stdin && format == "") ?
+    detect_stdin_format(stdin_head, stdin_text) : format;
+
   // reset, important bececause the same FalcoConfig object is used
   // across possibly multiple input files
   is_sam = is_bam = is_fastq_gz = is_fastq = false;
-  if (format == "") {
+  if (file_format == "") {
     if (endswith(tmp_filename, "sam") ||
         endswith(tmp_filename, "sam_mapped")) {
       is_sam = true;
@@ -438,20 +531,24 @@ FalcoConfig::define_file_format() {
     }
   }
   else {
-    if (format == "sam") is_sam = true;
+    if (file_format == "sam") is_sam = true;
 #ifdef USE_HTS
-    else if (format == "bam") is_bam = true;
+    else if (file_format == "bam") is_bam = true;
 #endif
-    else if (format == "fq.gz" || format == "fastq.gz") is_fastq_gz = true;
-    else if (format == "fq" || format == "fastq") is_fastq = true;
-    else throw runtime_error("unrecognized file format: " + format);
+    else if (file_format == "fq.gz" || file_format == "fastq.gz")
+      is_fastq_gz = true;
+    else if (file_format == "fq" || file_format == "fastq") is_fastq = true;
+    else throw runtime_error("unrecognized file format: " + file_format);
   }
+
+  if (is_stdin && is_sam && is_gzipped(stdin_head))
+    throw runtime_error("gzipped SAM from standard input is not supported");
 }
 
 
 void
-FalcoConfig::read_limits() {
-  limits = FileConstants::limits;
+FalcoConfig::read_limits(ParsedConfigFiles &files) {
+  files.limits = FileConstants::limits;
   if (!file_exists(limits_file)) {
     if (!quiet)
       cerr << "[limits]\tWARNING: using default limits because "
@@ -488,7 +585,7 @@ FalcoConfig::read_limits() {
           throw runtime_error("unknown instruction for limit " +
                               limit + ": " + instruction);
 
-        limits[limit][instruction] = value;
+        files.limits[limit][instruction] = value;
       }
     }
     in.close();
@@ -496,18 +593,17 @@ FalcoConfig::read_limits() {
 
   // Get data from config that tells us which analyses to skip
  
-  do_duplication = check_if_not_ignored(limits, "duplication");
-  do_kmer = check_if_not_ignored(limits, "kmer");
-  do_n_content = check_if_not_ignored(limits, "n_content");
-  do_overrepresented = check_if_not_ignored(limits, "overrepresented");
-  do_quality_base = check_if_not_ignored(limits, "quality_base");
-  do_sequence = check_if_not_ignored(limits, "sequence");
-  do_gc_sequence = check_if_not_ignored(limits, "gc_sequence");
-  do_quality_sequence = check_if_not_ignored(limits, "quality_sequence");
-  do_tile = check_if_not_ignored(limits, "tile");
-  do_adapter = check_if_not_ignored(limits, "adapter");
-  do_sequence_length = check_if_not_ignored(limits, "sequence_length");
-  do_adapter_optimized = false;
+  do_duplication = check_if_not_ignored(files.limits, "duplication");
+  do_kmer = check_if_not_ignored(files.limits, "kmer");
+  do_n_content = check_if_not_ignored(files.limits, "n_content");
+  do_overrepresented = check_if_not_ignored(files.limits, "overrepresented");
+  do_quality_base = check_if_not_ignored(files.limits, "quality_base");
+  do_sequence = check_if_not_ignored(files.limits, "sequence");
+  do_gc_sequence = check_if_not_ignored(files.limits, "gc_sequence");
+  do_quality_sequence = check_if_not_ignored(files.limits, "quality_sequence");
+  do_tile = check_if_not_ignored(files.limits, "tile");
+  do_adapter = check_if_not_ignored(files.limits, "adapter");
+  do_sequence_length = check_if_not_ignored(files.limits, "sequence_length");
 }
 
 size_t
@@ -524,20 +620,20 @@ hash_adapter(const string &s) {
 }
 
 void
-FalcoConfig::read_adapters() {
+FalcoConfig::read_adapters(ParsedConfigFiles &files) {
   if (!file_exists(adapters_file)) {
     if (!quiet)
       cerr << "[adapters]\tWARNING: using default adapters because "
            << "adapters file does not exist: " << adapters_file << "\n";
 
-    adapter_names = FileConstants::adapter_names;
-    adapter_seqs = FileConstants::adapter_seqs;
+    files.adapter_names = FileConstants::adapter_names;
+    files.adapter_seqs = FileConstants::adapter_seqs;
 
-    adapter_hashes.clear();
-    for (size_t i = 0; i < adapter_seqs.size(); ++i)
-      adapter_hashes.push_back(hash_adapter(adapter_seqs[i]));
+    files.adapter_hashes.clear();
+    for (size_t i = 0; i < files.adapter_seqs.size(); ++i)
+      files.adapter_hashes.push_back(hash_adapter(files.adapter_seqs[i]));
 
-    shortest_adapter_size = adapter_size = adapter_seqs[0].size();
+    files.shortest_adapter_size = files.adapter_size = files.adapter_seqs[0].size();
     return;
   }
 
@@ -555,15 +651,14 @@ FalcoConfig::read_adapters() {
   // The adapters file has a space separated name, and the last instance is
   // the biological sequence
 
-  adapter_size = 0;
-  adapter_names.clear();
-  adapter_seqs.clear();
-  adapter_hashes.clear();
-  do_adapter_optimized = true;
+  files.adapter_size = 0;
+  files.adapter_names.clear();
+  files.adapter_seqs.clear();
+  files.adapter_hashes.clear();
 
   while (getline(in, line)) {
     if (is_content_line(line)) {
-      if (adapter_names.size() > Constants::max_adapters) {
+      if (files.adapter_names.size() > Constants::max_adapters) {
         in.close();
         throw runtime_error("You are testing too many adapters. The maximum "
                             "number is 128!");
@@ -583,28 +678,19 @@ FalcoConfig::read_adapters() {
           adapter_name += " " + line_by_space[i];
 
         adapter_seq = line_by_space.back();
-
-        if (adapter_seq.size() > 32) {
-          cerr << "[adapters]\tadapter size is more then 32. Use slow adapters search" << "\n";
-          do_adapter_optimized = false;
-        }
       }
 
       // store information
-      adapter_names.push_back(adapter_name);
-      adapter_seqs.push_back(adapter_seq);
-      adapter_hashes.push_back(hash_adapter(adapter_seq));
+      files.adapter_names.push_back(adapter_name);
+      files.adapter_seqs.push_back(adapter_seq);
+      files.adapter_hashes.push_back(hash_adapter(adapter_seq));
 
-      if (adapter_size == 0) {
-        adapter_size = adapter_seq.size();
-        shortest_adapter_size = adapter_size;
+      if (files.adapter_size == 0) {
+        files.adapter_size = adapter_seq.size();
+        files.shortest_adapter_size = files.adapter_size;
       }
-      else if (adapter_seq.size() != adapter_size) {
-        cerr << "[adapters]\tadapters have different size. Use slow adapters search" << "\n";
-        do_adapter_optimized = false;
-        if(adapter_seq.size() < shortest_adapter_size){
-          shortest_adapter_size = adapter_seq.size();
-        }
+      else if (adapter_seq.size() < files.shortest_adapter_size) {
+        files.shortest_adapter_size = adapter_seq.size();
       }
     }
   }
@@ -612,12 +698,12 @@ FalcoConfig::read_adapters() {
 }
 
 void
-FalcoConfig::read_contaminants_file() {
+FalcoConfig::read_contaminants_file(ParsedConfigFiles &files) {
   if (!file_exists(contaminants_file)) {
     if (!quiet)
       cerr << "[contaminants]\tWARNING: using default contaminants because "
            << "contaminants file does not exist: " << contaminants_file << "\n";
-    contaminants = FileConstants::contaminants;
+    files.contaminants = FileConstants::contaminants;
     return;
   }
   ifstream in(contaminants_file);
@@ -631,7 +717,7 @@ FalcoConfig::read_contaminants_file() {
   // The contaminants file has a space separated name, and the last
   // instance is the biological sequence
   string line;
-  contaminants.clear();
+  files.contaminants.clear();
   while (getline(in, line)) {
     if (is_content_line(line)) {
       istringstream iss(line);
@@ -643,7 +729,7 @@ FalcoConfig::read_contaminants_file() {
         string contaminant_name = line_by_space[0];
         for (size_t i = 1; i < line_by_space.size() - 1; ++i)
           contaminant_name += " " + line_by_space[i];
-        contaminants.push_back(make_pair(contaminant_name, line_by_space.back()));
+        files.contaminants.push_back(make_pair(contaminant_name, line_by_space.back()));
       }
       line_by_space.clear();
     }
@@ -20,9 +20,47 @@
 #include <vector>
 #include <unordered_map>
 #include <utility>
+#include <memory>
 
 #include "aux.hpp"
+#include "AdapterAutomaton.hpp"
+#include "ContaminantIndex.hpp"
 
+/*************************************************************
+ ******************** PARSED CONFIG FILES ********************
+ *************************************************************/
+// Contents of the limits, adapters and contaminants files. They are parsed
+// once per run, and all files and threads share the same read-only copy
+struct ParsedConfigFiles {
+  ParsedConfigFiles() : adapter_size(0), shortest_adapter_size(0) {}
+
+  /*************** FASTQC LIMITS *****************/
+  std::unordered_map<std::string,
+                     std::unordered_map<std::string, double> > limits;
+
+  /*************** CONTAMINANTS *****************/
+  // below: first = name, scond = seq
+  std::vector<std::pair<std::string, std::string> > contaminants;
+
+  // the sequences above, to find the best match of overrepresented reads
+  std::unique_ptr<const ContaminantIndex> contaminant_index;
+
+  /*************** ADAPTERS *********************/
+  // Name (eg: Illumina Small RNA adapter)
+  std::vector<std::string> adapter_names;
+
+  // Actual string sequence (eg: ATTGCCACA)
+  std::vector<std::string> adapter_seqs;
+
+  // two-bit hash of the sequence above
+  std::vector<size_t> adapter_hashes;
+
+  size_t adapter_size;
+  size_t shortest_adapter_size;
+
+  // all adapter sequences, searched by the readers in one pass
+  std::unique_ptr<const AdapterAutomaton> adapter_automaton;
+};
 
 /*************************************************************
  ******************** CUSTOM CONFIGURATION *******************
@@ -45,6 +83,8 @@ struct FalcoConfig {
   bool quiet;
   size_t read_step;  // only process reads that are multiple of read_step
   size_t threads;  // number of threads to read multiple files in parallel
+  size_t memory_budget;  // bytes all threads may allocate, 0 for no limit
+  size_t sam_line_size;  // longest SAM line that can be read
   size_t trim_value_3p; // Stop reading sequence/quality stream when reaching this read position
   std::string call; // the function call
   std::string format;  // force file format
@@ -65,33 +105,17 @@ struct FalcoConfig {
        do_quality_sequence,
        do_tile,
        do_adapter,
-       do_adapter_optimized,
        do_sequence_length;
 
   /************************************************************
    *************** FASTQC LIMITS *******************************
    ************************************************************/
-  // These will become const bools in the stream reader
-  std::unordered_map<std::string,
-                     std::unordered_map<std::string, double> > limits;
   static const std::vector<std::string> values_to_check;
 
-  /*************** CONTAMINANTS *****************/
-  // below: first = name, scond = seq
-  std::vector<std::pair<std::string, std::string> > contaminants;
+  // limits, contaminants and adapters, set by read_config_files. Copies of
+  // the config made for each file share them
+  std::shared_ptr<const ParsedConfigFiles> parsed;
 
-  /*************** ADAPTERS *********************/
-  // Name (eg: Illumina Small RNA adapter)
-  std::vector<std::string> adapter_names;
-
-  // Actual string sequence (eg: ATTGCCACA)
-  std::vector<std::string> adapter_seqs;
-
-  // two-bit hash of the sequence above
-  std::vector<size_t> adapter_hashes;
-
-  size_t adapter_size;
-  size_t shortest_adapter_size;
   /************************************************************
    ******* ADDITIONAL INFORMATION ABOUT THE SAMPLE ************
    ************************************************************/
@@ -105,12 +129,29 @@ struct FalcoConfig {
   std::string filename;
   std::string filename_stripped;
 
+  // Input given as "-" is read from standard input, which cannot be reopened
+  // or seeked, so the format, line separator and tile layout are taken from
+  // its first bytes, which readers parse before the rest of the stream
+  bool is_stdin;
+  std::vector<char> stdin_head;
+  std::string stdin_text;  // stdin_head, decompressed if gzipped
+
+  // Records pushed through FalcoContext by a program linking libfalco have
+  // no file, so the tile layout is taken from the name of the first one
+  bool is_pushed;
+  std::string first_pushed_name;
+
   /*********** FUNCTIONS TO READ FILES *************/
   void define_file_format();
-  void read_limits();  // populate limits hash map
-  void read_adapters();
-  void read_contaminants_file();
+  void read_stdin_head();
+  void read_limits(ParsedConfigFiles &files);  // populate limits hash map
+  void read_adapters(ParsedConfigFiles &files);
+  void read_contaminants_file(ParsedConfigFiles &files);
 
+  // reads the limits, adapters and contaminants files, once per run
+  void read_config_files();
+
+  // sets the format and name of the input in filename
   void setup();
 };
 
@@ -159,6 +200,28 @@ namespace Constants {
   // Prefix size to cut if read length exceeds the value above
   static const size_t unique_reads_truncate = 50;
 
+  /************* PARALLEL READING OF A SINGLE FILE *************/
+  // Smallest piece of an uncompressed file worth reading in its own thread
+  static const size_t min_bytes_per_split = (1 << 24);
+
+  /************* MEMORY BUDGET *************/
+  // line buffer of SAM readers, and the smallest one a memory budget can
+  // shrink it to
+  static const size_t default_sam_line_size = (1 << 26);
+  static const size_t min_sam_line_size = (1 << 24);
+
+  /************* CONVERGENCE OF THE METRICS *************/
+  // reads between the checks of whether the metrics stopped changing
+  static const size_t reads_between_checkpoints = 1e5;
+
+  // size of the evenly spaced blocks of a mapped file read until the
+  // metrics converge
+  static const size_t bytes_per_sample_block = (1 << 22);
+
+  /************* PROGRESS OF STANDARD INPUT *************/
+  // input read between progress lines when the input size is not known
+  static const size_t bytes_between_reports = (1 << 26);
+
   /****Bit shifts as instructions for the std::arrays***/
   // for matrices that count stats per nucleotide
   static const size_t bit_shift_base = log2exact(num_nucleotides);
@@ -0,0 +1,201 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "FalcoContext.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+#include "StreamReader.hpp"
+#include "Module.hpp"
+#include "Profile.hpp"
+
+using std::string;
+using std::vector;
+using std::ostream;
+using std::ostringstream;
+using std::runtime_error;
+
+/*******************************************************/
+/*************** FALCO CONTEXT *************************/
+/*******************************************************/
+FalcoContext::FalcoContext(const FalcoConfig &_config,
+                           const string &sample_name) :
+  config(_config), stats(new FastqStats) {
+  if (!config.parsed)
+    config.read_config_files();
+  config.filename = config.filename_stripped = sample_name;
+  config.is_pushed = true;
+  pipeline = ReaderModules::pipeline_for(config);
+  num_bytes = 0;
+  is_finalized = false;
+}
+
+// the reader is only complete here, so it is destroyed here
+FalcoContext::~FalcoContext() {}
+
+void
+FalcoContext::start(const char *name, const size_t name_len) {
+  if (name != NULL)
+    config.first_pushed_name.assign(name, name_len);
+  reader.reset(new MemoryReader(config, FastqStats::SHORT_READ_THRESHOLD));
+  reader->load();
+}
+
+template <size_t Modules> void
+FalcoContext::push_all(const FalcoRecord *records, const size_t num_records) {
+  for (size_t i = 0; i < num_records; ++i) {
+    const FalcoRecord &r = records[i];
+    reader->set_record(r.name, r.name_len, r.seq, r.qual, r.len);
+    reader->template read_entry_with<Modules>(*stats, num_bytes);
+  }
+}
+
+void
+FalcoContext::push(const FalcoRecord *records, const size_t num_records) {
+  if (is_finalized)
+    throw runtime_error("cannot push reads after finalize");
+  if (num_records == 0)
+    return;
+  if (!reader)
+    start(records[0].name, records[0].name_len);
+
+  switch (pipeline) {
+    case ReaderModules::all:
+      push_all<ReaderModules::all>(records, num_records);
+      break;
+    case ReaderModules::no_kmer:
+      push_all<ReaderModules::no_kmer>(records, num_records);
+      break;
+    case ReaderModules::quality_only:
+      push_all<ReaderModules::quality_only>(records, num_records);
+      break;
+    default:
+      push_all<ReaderModules::dynamic>(records, num_records);
+  }
+}
+
+void
+FalcoContext::push(const vector<FalcoRecord> &records) {
+  push(records.data(), records.size());
+}
+
+void
+FalcoContext::push(const char *name, const size_t name_len, const char *seq,
+                   const char *qual, const size_t len) {
+  const FalcoRecord record = {name, name_len, seq, qual, len};
+  push(&record, 1);
+}
+
+void
+FalcoContext::push(const char *seq, const char *qual, const size_t len) {
+  push(NULL, 0, seq, qual, len);
+}
+
+void
+FalcoContext::add_snapshot(std::istream &in) {
+  if (is_finalized)
+    throw runtime_error("snapshots cannot be added after finalize");
+  std::unique_ptr<FastqStats> snapshot_stats(new FastqStats);
+  snapshot_stats->read_snapshot(in);
+  stats->merge(*snapshot_stats);
+}
+
+template <typename T> void
+FalcoContext::add_result(const bool requested) {
+  if (!requested)
+    return;
+  T module(config);
+  module.summarize(*stats);
+
+  FalcoModuleResult result;
+  result.name = T::module_name;
+  result.grade = module.grade;
+  ostringstream data;
+  module.write(data);
+  result.data = data.str();
+  results.push_back(result);
+}
+
+const FastqStats &
+FalcoContext::finalize() {
+  if (is_finalized)
+    return *stats;
+  is_finalized = true;
+
+  // names without tile information, or no reads at all, have no tiles
+  if (stats->tile_names.empty() || (reader && reader->tile_ignore))
+    config.do_tile = false;
+
+  stats->summarize();
+
+  // same modules in the same order as the reports of a file
+  add_result<ModuleBasicStatistics>(true);
+  add_result<ModulePerBaseSequenceQuality>(config.do_quality_sequence);
+  add_result<ModulePerTileSequenceQuality>(config.do_tile);
+  add_result<ModulePerSequenceQualityScores>(config.do_quality_sequence);
+  add_result<ModulePerBaseSequenceContent>(config.do_sequence);
+  add_result<ModulePerSequenceGCContent>(config.do_gc_sequence);
+  add_result<ModulePerBaseNContent>(config.do_n_content);
+  add_result<ModuleSequenceLengthDistribution>(config.do_sequence_length);
+  add_result<ModuleSequenceDuplicationLevels>(config.do_duplication);
+  add_result<ModuleOverrepresentedSequences>(config.do_overrepresented);
+  add_result<ModuleAdapterContent>(config.do_adapter);
+  add_result<ModuleKmerContent>(config.do_kmer);
+  return *stats;
+}
+
+const FastqStats &
+FalcoContext::get_stats() const {
+  if (!is_finalized)
+    throw runtime_error("stats are only complete after finalize");
+  return *stats;
+}
+
+const vector<FalcoModuleResult> &
+FalcoContext::get_results() const {
+  if (!is_finalized)
+    throw runtime_error("module results are only ready after finalize");
+  return results;
+}
+
+void
+FalcoContext::write_json(ostream &out) const {
+  get_results();
+  out << "{\n  \"falco_version\": ";
+  write_json_string(out, FalcoConfig::FalcoVersion);
+  out << ",\n  \"filename\": ";
+  write_json_string(out, config.filename_stripped);
+  out << ",\n  \"num_reads\": " << stats->num_reads
+      << ",\n  \"modules\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    out << (i == 0 ? "\n    " : ",\n    ") << "{\"name\": ";
+    write_json_string(out, results[i].name);
+    out << ", \"grade\": ";
+    write_json_string(out, results[i].grade);
+    out << ", \"data\": ";
+    write_json_string(out, results[i].data);
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+void
+FalcoContext::write_text(ostream &out) const {
+  get_results();
+  out << "##Falco\t" + FalcoConfig::FalcoVersion + "\n";
+  for (const FalcoModuleResult &result : results)
+    out << result.data;
+}
@@ -0,0 +1,118 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef FALCOCONTEXT_HPP
+#define FALCOCONTEXT_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <istream>
+
+#include "FalcoConfig.hpp"
+#include "FastqStats.hpp"
+
+class MemoryReader;
+
+/*************************************************************
+ ******************** LIBFALCO PUSH API **********************
+ *************************************************************/
+// One record of a batch given to FalcoContext::push. qual has Phred+33
+// characters, or is NULL if the record has no qualities. name is the read
+// name without the leading @, from which tiles are taken, and may be NULL
+struct FalcoRecord {
+  const char *name;
+  size_t name_len;
+  const char *seq;
+  const char *qual;
+  size_t len;
+};
+
+// The grade and the fastqc_data.txt section of one module
+struct FalcoModuleResult {
+  std::string name;
+  std::string grade;  // pass, warn or fail
+  std::string data;
+};
+
+// Runs QC on reads that a program already has in memory, such as an
+// aligner or a demultiplexer, without a file or a second pass over the
+// data. Records are counted as they are pushed, in the same way and with
+// the same modules as falco reads a file, and finalize summarizes them:
+//
+//   FalcoConfig config(0, NULL);
+//   FalcoContext qc(config, "sample");
+//   qc.push(read.name, read.name_len, read.seq, read.qual, read.len);
+//   qc.finalize();
+//   qc.write_json(std::cout);
+//
+// The limits, adapters and contaminants files of the config are read by
+// the constructor unless they were read before. A context is not thread
+// safe, so threads that push reads should each have their own.
+class FalcoContext {
+ public:
+  FalcoContext(const FalcoConfig &_config, const std::string &sample_name);
+  ~FalcoContext();
+
+  // counts one record, whose strings are not kept after the call
+  void push(const char *seq, const char *qual, const size_t len);
+  void push(const char *name, const size_t name_len, const char *seq,
+            const char *qual, const size_t len);
+
+  // counts several records with a single dispatch to the reader pipeline
+  void push(const FalcoRecord *records, const size_t num_records);
+  void push(const std::vector<FalcoRecord> &records);
+
+  // adds the counts of a stats snapshot written by falco -snapshot, as
+  // falco merge does, so a snapshot can be summarized like pushed reads
+  void add_snapshot(std::istream &in);
+
+  // Summarizes the records pushed so far and the modules of the config.
+  // No records can be pushed after it
+  const FastqStats &finalize();
+  bool finalized() const {return is_finalized;}
+
+  // the stats and the modules that were run, after finalize
+  const FastqStats &get_stats() const;
+  const std::vector<FalcoModuleResult> &get_results() const;
+
+  // the filename, number of reads and every module result as one object
+  void write_json(std::ostream &out) const;
+
+  // the same report as the fastqc_data.txt of a file
+  void write_text(std::ostream &out) const;
+
+ private:
+  FalcoConfig config;
+  std::unique_ptr<FastqStats> stats;
+  std::unique_ptr<MemoryReader> reader;
+  size_t pipeline;
+  size_t num_bytes;
+  bool is_finalized;
+  std::vector<FalcoModuleResult> results;
+
+  // the reader is made for the first record, whose name has the tile layout
+  void start(const char *name, const size_t name_len);
+
+  // counts records with the pipeline compiled for Modules
+  template <size_t Modules>
+  void push_all(const FalcoRecord *records, const size_t num_records);
+
+  // summarizes a module if the config requested it
+  template <typename T> void add_result(const bool requested);
+};
+
+#endif
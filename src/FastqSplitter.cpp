@@ -0,0 +1,325 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "FastqSplitter.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+#include <sys/stat.h>
+
+using std::string;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using std::ifstream;
+using std::runtime_error;
+using std::thread;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+
+/*******************************************************/
+/*************** FILE SPLITTING ************************/
+/*******************************************************/
+static size_t
+get_size_of_file(const string &filename) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+    throw runtime_error("bad input file: " + filename);
+  return static_cast<size_t>(st.st_size);
+}
+
+// Finds the first record that starts after offset. A line is the start of
+// a record if it starts with @ and the line two below starts with +. A
+// quality line starting with @ is followed by a name and a sequence, so
+// it cannot be confused with a record start.
+size_t
+get_next_record_start(const string &filename, const size_t offset,
+                      const size_t file_size) {
+  static const size_t max_lines_to_check = 16;
+
+  ifstream in(filename, std::ios::binary);
+  if (!in)
+    throw runtime_error("bad input file: " + filename);
+  in.seekg(offset);
+
+  // skip the line we fell into
+  string line;
+  getline(in, line);
+
+  vector<pair<size_t, char> > line_starts;
+  for (size_t i = 0; i < max_lines_to_check && in; ++i) {
+    const size_t pos = static_cast<size_t>(in.tellg());
+    if (!getline(in, line)) break;
+    line_starts.push_back(make_pair(pos, line.empty() ? '\0' : line[0]));
+
+    const size_t n = line_starts.size();
+    if (n >= 3 && line_starts[n - 3].second == '@' &&
+        line_starts[n - 1].second == '+')
+      return line_starts[n - 3].first;
+  }
+  return file_size;
+}
+
+// Number of newlines between two byte offsets
+static size_t
+count_lines(const string &filename, const size_t start, const size_t end) {
+  static const size_t block_size = (1 << 20);
+  FILE *fp = fopen(filename.c_str(), "r");
+  if (fp == NULL)
+    throw runtime_error("bad input file: " + filename);
+  if (fseek(fp, start, SEEK_SET) != 0) {
+    fclose(fp);
+    throw runtime_error("cannot seek in file: " + filename);
+  }
+
+  vector<char> block(block_size);
+  size_t num_lines = 0;
+  for (size_t pos = start; pos < end;) {
+    const size_t to_read = std::min(block_size, end - pos);
+    const size_t num_read = fread(block.data(), 1, to_read, fp);
+    if (num_read == 0) break;
+    num_lines += std::count(block.data(), block.data() + num_read, '\n');
+    pos += num_read;
+  }
+  fclose(fp);
+  return num_lines;
+}
+
+vector<FastqRange>
+split_fastq_file(const string &filename, size_t num_ranges,
+                 const size_t min_range_size) {
+  const size_t file_size = get_size_of_file(filename);
+  num_ranges = std::max(static_cast<size_t>(1),
+                        std::min(num_ranges, file_size / min_range_size));
+
+  // record boundaries closest to equally spaced offsets
+  vector<size_t> starts(1, 0);
+  for (size_t i = 1; i < num_ranges; ++i) {
+    const size_t start =
+      get_next_record_start(filename, (file_size / num_ranges) * i, file_size);
+    if (start > starts.back() && start < file_size)
+      starts.push_back(start);
+  }
+
+  vector<FastqRange> ranges(starts.size());
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    ranges[i].start = starts[i];
+    ranges[i].end = (i + 1 < starts.size()) ? starts[i + 1] : file_size;
+  }
+
+  // count the lines of every range in parallel
+  vector<size_t> num_lines(ranges.size(), 0);
+  vector<thread> threads;
+  vector<std::exception_ptr> errors(ranges.size());
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    threads.push_back(thread([&, i]() {
+      try {
+        num_lines[i] = count_lines(filename, ranges[i].start, ranges[i].end);
+      }
+      catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }));
+  }
+  for (auto &t : threads)
+    t.join();
+  for (auto &e : errors)
+    if (e) std::rethrow_exception(e);
+
+  size_t first_read = 0;
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    // all ranges but the last end right after a newline
+    if (i + 1 < ranges.size() && num_lines[i] % 4 != 0)
+      throw runtime_error("FASTQ records do not have four lines in file: " +
+                          filename);
+
+    ranges[i].first_read = first_read;
+    ranges[i].num_reads = num_lines[i] / 4;
+    first_read += ranges[i].num_reads;
+  }
+  return ranges;
+}
+
+/*******************************************************/
+/*************** SEQUENCE COUNT SYNC *******************/
+/*******************************************************/
+SequenceCountSync::SequenceCountSync(FastqStats &_stats,
+                                     const vector<FastqRange> &ranges,
+                                     const size_t _read_step) :
+  global(_stats), read_step(_read_step) {
+  continue_storing =
+    (global.num_unique_seen < Constants::unique_reads_stop_counting);
+
+  workers.resize(ranges.size());
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    workers[i].mode = (i == 0) ? kOwner : kLocal;
+    workers[i].first_read = ranges[i].first_read;
+  }
+  owner = 0;
+  frozen = !continue_storing;
+  aborted = false;
+}
+
+size_t
+SequenceCountSync::num_processed(const size_t from, const size_t to) const {
+  if (to <= from) return 0;
+  return (to + read_step - 1)/read_step - (from + read_step - 1)/read_step;
+}
+
+bool
+SequenceCountSync::count_in_global(const char *seq, const size_t len,
+                                   const size_t read_index) {
+  bool is_new;
+  const size_t ind =
+    global.sequence_count.find_or_add(seq, len, continue_storing, is_new);
+  if (ind == SequenceTable::not_found)
+    return false;
+
+  ++global.sequence_count.count(ind);
+  if (is_new) {
+    global.count_at_limit = read_index;
+    ++global.num_unique_seen;
+    if (global.num_unique_seen == Constants::unique_reads_stop_counting) {
+      continue_storing = false;
+      return true;
+    }
+  }
+  else
+    global.count_at_limit += continue_storing;
+  return false;
+}
+
+void
+SequenceCountSync::resolve(const size_t worker, const size_t end_read,
+                           FastqStats &stats) {
+  unique_lock<mutex> lock(mtx);
+  cv.wait(lock, [&]() {return aborted || frozen || owner == worker;});
+  if (aborted)
+    throw runtime_error("stopping because another thread failed");
+
+  Worker &w = workers[worker];
+
+  // the table is full: local counts of sequences in it will be added on
+  // merge, and the others will be ignored
+  if (frozen) {
+    w.mode = kLookup;
+  }
+
+  // replay sequences in the order they were seen as if we had read them
+  // right after the previous owner
+  else {
+    bool found_new = false;
+    size_t last_new = 0;
+    for (size_t i = 0; i < w.first_seen.size(); ++i) {
+      const string seq = stats.sequence_count.get_sequence(i);
+      bool is_new;
+      const size_t ind = global.sequence_count.find_or_add(
+        seq.data(), seq.size(), continue_storing, is_new
+      );
+      if (ind == SequenceTable::not_found)
+        continue;
+
+      global.sequence_count.count(ind) += stats.sequence_count.count(i);
+      if (is_new) {
+        ++global.num_unique_seen;
+        found_new = true;
+        last_new = w.first_seen[i];
+        if (global.num_unique_seen == Constants::unique_reads_stop_counting)
+          continue_storing = false;
+      }
+    }
+
+    // every processed read after the last new sequence was a duplicate
+    if (!continue_storing)
+      global.count_at_limit = last_new;
+    else if (found_new)
+      global.count_at_limit = last_new + num_processed(last_new + 1, end_read);
+    else
+      global.count_at_limit += num_processed(w.first_read, end_read);
+
+    stats.sequence_count.clear();
+    w.mode = kOwner;
+    if (!continue_storing) {
+      frozen = true;
+      cv.notify_all();
+    }
+  }
+  w.first_seen.clear();
+}
+
+void
+SequenceCountSync::count(const size_t worker, const char *seq,
+                         const size_t len, FastqStats &stats) {
+  Worker &w = workers[worker];
+  if (w.mode == kOwner) {
+    if (count_in_global(seq, len, stats.num_reads)) {
+      lock_guard<mutex> lock(mtx);
+      frozen = true;
+      cv.notify_all();
+    }
+  }
+  else if (w.mode == kLocal) {
+    bool is_new;
+    const bool can_add =
+      (stats.sequence_count.size() < Constants::unique_reads_stop_counting);
+    const size_t ind =
+      stats.sequence_count.find_or_add(seq, len, can_add, is_new);
+    if (ind != SequenceTable::not_found) {
+      ++stats.sequence_count.count(ind);
+      if (is_new)
+        w.first_seen.push_back(stats.num_reads);
+    }
+
+    // we would store past the limit, so we need to know what the table
+    // looks like before going on
+    else {
+      resolve(worker, stats.num_reads, stats);
+      count(worker, seq, len, stats);
+    }
+  }
+
+  // no new sequences can be stored, but the owner does not change the
+  // structure of the table anymore, so it is safe to search it
+  else if (global.sequence_count.find(seq, len) != SequenceTable::not_found) {
+    bool is_new;
+    ++stats.sequence_count.count(
+      stats.sequence_count.find_or_add(seq, len, true, is_new)
+    );
+  }
+}
+
+void
+SequenceCountSync::finish(const size_t worker, FastqStats &stats) {
+  if (workers[worker].mode == kLocal)
+    resolve(worker, stats.num_reads, stats);
+
+  if (workers[worker].mode == kOwner) {
+    lock_guard<mutex> lock(mtx);
+    if (!frozen) {
+      owner = worker + 1;
+      cv.notify_all();
+    }
+  }
+}
+
+void
+SequenceCountSync::abort() {
+  lock_guard<mutex> lock(mtx);
+  aborted = true;
+  cv.notify_all();
+}
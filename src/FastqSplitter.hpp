@@ -0,0 +1,114 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef FASTQSPLITTER_HPP
+#define FASTQSPLITTER_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+
+#include "FastqStats.hpp"
+
+/*************************************************************
+ ******************** FILE SPLITTING *************************
+ *************************************************************/
+// A piece of an uncompressed FASTQ file that starts at a record boundary
+struct FastqRange {
+  size_t start;  // byte offset of the first record
+  size_t end;  // byte offset past the last record
+  size_t first_read;  // index of the first record in the file
+  size_t num_reads;  // number of records in the range
+};
+
+// Splits a FASTQ file in at most num_ranges pieces of similar size, none
+// smaller than min_range_size. Records of all pieces are counted in parallel
+// so each piece knows the index of its first read within the file.
+std::vector<FastqRange>
+split_fastq_file(const std::string &filename, size_t num_ranges,
+                 const size_t min_range_size);
+
+// Byte offset of the first record that starts after offset, or file_size
+// if there is none
+size_t
+get_next_record_start(const std::string &filename, const size_t offset,
+                      const size_t file_size);
+
+/*************************************************************
+ ******************** SEQUENCE COUNT SYNC ********************
+ *************************************************************/
+// The duplication table stores the first unique_reads_stop_counting
+// sequences in the order they appear in the file, so it cannot simply be
+// summed across pieces of a split file. Only one worker (the "owner") may
+// store new sequences at a time, and ownership goes through the workers in
+// file order. Other workers count their sequences locally, remembering where
+// each was first seen, until they either become the owner (and replay their
+// sequences in order) or the table is full (and they only count the
+// sequences already in it, which FastqStats::merge adds at the end).
+class SequenceCountSync {
+ public:
+  SequenceCountSync(FastqStats &_stats,
+                    const std::vector<FastqRange> &ranges,
+                    const size_t _read_step);
+
+  // counts the sequence of read stats.num_reads seen by a worker
+  void count(const size_t worker, const char *seq, const size_t len,
+             FastqStats &stats);
+
+  // called by each worker after its last read
+  void finish(const size_t worker, FastqStats &stats);
+
+  // wakes up waiting workers so they stop if any other worker failed
+  void abort();
+
+ private:
+  enum Mode {kOwner, kLocal, kLookup};
+  struct Worker {
+    Mode mode;
+    size_t first_read;
+
+    // read index in which each local sequence was first seen, indexed as
+    // the entries of the local table
+    std::vector<size_t> first_seen;
+  };
+
+  // stats in which the duplication table is stored
+  FastqStats &global;
+  bool continue_storing;
+  const size_t read_step;
+
+  std::vector<Worker> workers;
+
+  // guards the variables below
+  std::mutex mtx;
+  std::condition_variable cv;
+  size_t owner;
+  bool frozen;
+  bool aborted;
+
+  // same logic as the single-threaded reader, returns true when the table
+  // got full with this sequence
+  bool count_in_global(const char *seq, const size_t len,
+                       const size_t read_index);
+
+  // waits until the worker becomes the owner or the table is full
+  void resolve(const size_t worker, const size_t end_read, FastqStats &stats);
+
+  // number of processed reads in [from, to)
+  size_t num_processed(const size_t from, const size_t to) const;
+};
+#endif
@@ -26,6 +26,8 @@ using std::sort;
 using std::min;
 using std::max;
 using std::ostream;
+using std::istream;
+using std::runtime_error;
 using std::pair;
 using std::transform;
 using std::toupper;
@@ -46,14 +48,27 @@ const size_t FastqStats::kBitShiftNucleotide;
 const size_t FastqStats::kBitShiftQuality;
 const size_t FastqStats::kBitShiftAdapter;
 
-// To make the gc models static const
-static array<GCModel, FastqStats::SHORT_READ_THRESHOLD>
-make_gc_models () {
-  array<GCModel, FastqStats::SHORT_READ_THRESHOLD> ans;
-  for (size_t i = 0; i < FastqStats::SHORT_READ_THRESHOLD; ++i) {
-    ans[i] = GCModel(i);
+const size_t FastqStats::kGCTruncation;
+const size_t FastqStats::kNumGCRows;
+const size_t FastqStats::kNumGCCells;
+
+/****************************************************************/
+/******************** FLAT GC MODELS ****************************/
+/****************************************************************/
+FlatGCModels::FlatGCModels(const size_t num_rows,
+                           const size_t gc_truncation) {
+  for (size_t row = 0; row < num_rows; ++row) {
+    row_start.push_back(cell_start.size());
+    const size_t length = gc_length_of_row(row, gc_truncation);
+    const GCModel model(length);
+    for (size_t gc = 0; gc <= length; ++gc) {
+      cell_start.push_back(values.size());
+      if (gc < model.models.size())
+        values.insert(end(values), begin(model.models[gc]),
+                      end(model.models[gc]));
+    }
   }
-  return ans;
+  cell_start.push_back(values.size());
 }
 
 /****************************************************************/
@@ -75,51 +90,112 @@ FastqStats::FastqStats() {
 
   num_unique_seen = 0;
   count_at_limit = 0;
+  tile_row_size = 0;
 
   // Initialize IO arrays
   base_count.fill(0);
   n_base_count.fill(0);
   read_length_freq.fill(0);
   quality_count.fill(0);
-  gc_count.fill(0);
+  gc_cell_count.fill(0);
+  long_gc_count.fill(0);
   position_quality_count.fill(0);
   pos_kmer_count.fill(0);
   pos_adapter_count.fill(0);
-  kmer_count = vector<size_t>(SHORT_READ_THRESHOLD*(Constants::kmer_mask + 1), 0);
 }
 
-// Initialize as many gc models as fast bases
-const array<GCModel, FastqStats::SHORT_READ_THRESHOLD>
-FastqStats::gc_models = make_gc_models();
+// Initialize the models of every GC model cell
+const FlatGCModels
+FastqStats::gc_models(FastqStats::kNumGCRows, FastqStats::kGCTruncation);
 
-// When we read new bases, dynamically allocate new space for their statistics
 void
-FastqStats::allocate_new_base(const bool ignore_tile) {
-  for (size_t i = 0; i < kNumNucleotides; ++i) {
-    long_base_count.push_back(0);
+FastqStats::get_gc_count(array<double, 101> &gc_count) const {
+  gc_count.fill(0.0);
+  for (size_t cell = 0; cell < kNumGCCells; ++cell) {
+    const size_t count = gc_cell_count[cell];
+    if (count == 0)
+      continue;
+    const GCModelValue *values = gc_models.values.data();
+    const GCModelValue *v = values + gc_models.cell_start[cell];
+    const GCModelValue *lim = values + gc_models.cell_start[cell + 1];
+    for (; v != lim; ++v)
+      gc_count[v->percent] += count*v->increment;
   }
+  for (size_t i = 0; i < long_gc_count.size(); ++i)
+    gc_count[i] += long_gc_count[i];
+}
 
-  long_n_base_count.push_back(0);
+// When we read new bases, dynamically allocate new space for their statistics
+void
+FastqStats::allocate_new_bases(const size_t num_bases) {
+  if (num_bases <= num_extra_bases)
+    return;
+  num_extra_bases = max(num_bases, 2*num_extra_bases);
+  long_base_count.resize(num_extra_bases*kNumNucleotides, 0);
+  long_n_base_count.resize(num_extra_bases, 0);
 
   // space for quality boxplot
-  for (size_t i = 0; i < kNumQualityValues; ++i)
-    long_position_quality_count.push_back(0);
+  long_position_quality_count.resize(num_extra_bases*kNumQualityValues, 0);
+  long_read_length_freq.resize(num_extra_bases, 0);
+}
 
-  long_read_length_freq.push_back(0);
+// Bins start at SHORT_READ_THRESHOLD times a power of two to the 1/8, so
+// even the first ones are dozens of positions wide
+size_t
+FastqStats::long_bin_start(const size_t bin) {
+  return static_cast<size_t>(
+    SHORT_READ_THRESHOLD *
+    std::pow(2.0, static_cast<double>(bin) / long_bins_per_doubling));
+}
 
-  // space for tile quality in each position.
-  //
-  if (!ignore_tile) {
-    for (auto  &v : tile_position_quality) {
-      v.second.push_back(0);
-    }
-    for (auto  &v : tile_position_count) {
-      v.second.push_back(0);
-    }
-  }
+size_t
+FastqStats::long_bin_of(const size_t pos) {
+  size_t bin = 0;
+  while (long_bin_start(bin + 1) <= pos)
+    ++bin;
+  return bin;
+}
 
-  // Successfully allocated space for a new base
-  ++num_extra_bases;
+size_t
+FastqStats::num_long_bins() const {
+  return (max_read_length > SHORT_READ_THRESHOLD) ?
+    (long_bin_of(max_read_length - 1) + 1) : 0;
+}
+
+size_t
+FastqStats::get_tile_index(const size_t tile) {
+  const auto it = tile_index.find(tile);
+  if (it != end(tile_index))
+    return it->second;
+
+  reserve_tile_positions(max_read_length);
+  const size_t ind = tile_names.size();
+  tile_index[tile] = ind;
+  tile_names.push_back(tile);
+  tile_position_quality.resize(tile_names.size()*tile_row_size, 0.0);
+  tile_position_count.resize(tile_names.size()*tile_row_size, 0);
+  return ind;
+}
+
+// Rows at least double so reads of increasing lengths do not move the
+// whole matrix every time
+void
+FastqStats::grow_tile_rows(const size_t num_positions) {
+  const size_t new_row_size = max(num_positions, 2*tile_row_size);
+  const size_t num_tiles = tile_names.size();
+  vector<double> new_quality(num_tiles*new_row_size, 0.0);
+  vector<size_t> new_count(num_tiles*new_row_size, 0);
+  for (size_t t = 0; t < num_tiles; ++t) {
+    std::copy(begin(tile_position_quality) + t*tile_row_size,
+              begin(tile_position_quality) + (t + 1)*tile_row_size,
+              begin(new_quality) + t*new_row_size);
+    std::copy(begin(tile_position_count) + t*tile_row_size,
+              begin(tile_position_count) + (t + 1)*tile_row_size,
+              begin(new_count) + t*new_row_size);
+  }
+  tile_position_quality.swap(new_quality);
+  tile_position_count.swap(new_count);
+  tile_row_size = new_row_size;
 }
 
 // Calculates all summary statistics and pass warn fails
@@ -154,3 +230,504 @@ FastqStats::summarize() {
   }
 }
 
+
+// element-wise sum of two count containers, growing lhs if needed
+template <class T> static void
+add_counts(T &lhs, const T &rhs) {
+  for (size_t i = 0; i < rhs.size(); ++i)
+    lhs[i] += rhs[i];
+}
+
+template <class T> static void
+add_counts(vector<T> &lhs, const vector<T> &rhs) {
+  if (lhs.size() < rhs.size())
+    lhs.resize(rhs.size(), 0);
+  for (size_t i = 0; i < rhs.size(); ++i)
+    lhs[i] += rhs[i];
+}
+
+void
+FastqStats::merge(const FastqStats &rhs) {
+  lowest_char = min(lowest_char, rhs.lowest_char);
+
+  // duplication: sequences already in the table keep being counted, new ones
+  // are only stored while we are below the cutoff
+  if (!rhs.sequence_count.empty()) {
+    if (num_unique_seen < Constants::unique_reads_stop_counting)
+      count_at_limit = num_reads + rhs.count_at_limit;
+
+    for (size_t i = 0; i < rhs.sequence_count.size(); ++i) {
+      const string seq = rhs.sequence_count.get_sequence(i);
+      bool is_new;
+      const size_t ind = sequence_count.find_or_add(
+        seq.data(), seq.size(),
+        num_unique_seen < Constants::unique_reads_stop_counting, is_new
+      );
+      if (ind != SequenceTable::not_found) {
+        sequence_count.count(ind) += rhs.sequence_count.count(i);
+        num_unique_seen += is_new;
+      }
+    }
+  }
+
+  total_bases += rhs.total_bases;
+  num_reads += rhs.num_reads;
+  empty_reads += rhs.empty_reads;
+  max_read_length = max(max_read_length, rhs.max_read_length);
+  num_poor += rhs.num_poor;
+  total_gc += rhs.total_gc;
+
+  add_counts(base_count, rhs.base_count);
+  add_counts(n_base_count, rhs.n_base_count);
+  add_counts(position_quality_count, rhs.position_quality_count);
+  add_counts(quality_count, rhs.quality_count);
+  add_counts(gc_cell_count, rhs.gc_cell_count);
+  add_counts(long_gc_count, rhs.long_gc_count);
+  add_counts(read_length_freq, rhs.read_length_freq);
+
+  // tiles of rhs may have other indices here
+  reserve_tile_positions(rhs.tile_row_size);
+  for (size_t t = 0; t < rhs.tile_names.size(); ++t) {
+    const size_t ind = get_tile_index(rhs.tile_names[t]);
+    const size_t row = ind*tile_row_size;
+    const size_t rhs_row = t*rhs.tile_row_size;
+    for (size_t i = 0; i < rhs.tile_row_size; ++i) {
+      tile_position_quality[row + i] += rhs.tile_position_quality[rhs_row + i];
+      tile_position_count[row + i] += rhs.tile_position_count[rhs_row + i];
+    }
+  }
+
+  add_counts(long_base_count, rhs.long_base_count);
+  add_counts(long_n_base_count, rhs.long_n_base_count);
+  add_counts(long_position_quality_count, rhs.long_position_quality_count);
+  add_counts(long_read_length_freq, rhs.long_read_length_freq);
+  num_extra_bases = long_read_length_freq.size();
+  add_counts(long_pos_kmer_count, rhs.long_pos_kmer_count);
+  add_counts(long_pos_adapter_count, rhs.long_pos_adapter_count);
+
+  // kmer counts are kept in 32 bits until they overflow
+  if (kmer_count.size() < rhs.kmer_count.size())
+    kmer_count.resize(rhs.kmer_count.size(), 0);
+  for (size_t i = 0; i < rhs.kmer_count.size(); ++i) {
+    const size_t sum = static_cast<size_t>(kmer_count[i]) + rhs.kmer_count[i];
+    if (sum > std::numeric_limits<uint32_t>::max()) {
+      kmer_count[i] = std::numeric_limits<uint32_t>::max();
+      kmer_count_overflow[i] += sum - kmer_count[i];
+    }
+    else
+      kmer_count[i] = sum;
+  }
+  for (const auto &v : rhs.kmer_count_overflow)
+    kmer_count_overflow[v.first] += v.second;
+  add_counts(pos_kmer_count, rhs.pos_kmer_count);
+  add_counts(pos_adapter_count, rhs.pos_adapter_count);
+}
+
+/****************************************************************/
+/******************** BINARY SNAPSHOTS **************************/
+/****************************************************************/
+// A snapshot is a header followed by the counters in a fixed order. Most
+// counters are zero, so each array is written as its number of elements
+// followed by runs of zeros and of values, each run preceded by its size.
+// Values are written in the byte order of the machine, which the header
+// lets readers check
+static const char snapshot_magic[8] = {'F', 'A', 'L', 'C', 'O', 'B', 'I', 'N'};
+static const uint32_t snapshot_version = 2;
+static const uint32_t snapshot_byte_order = 0x01020304;
+
+template <class T> static void
+write_value(ostream &out, const T &v) {
+  out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <class T> static void
+read_value(istream &in, T &v) {
+  in.read(reinterpret_cast<char*>(&v), sizeof(T));
+  if (!in)
+    throw runtime_error("stats snapshot ends unexpectedly");
+}
+
+template <class T> static void
+write_values(ostream &out, const T *v, const uint64_t n) {
+  write_value(out, n);
+  for (uint64_t i = 0; i < n;) {
+    uint64_t num_zeros = 0, num_values = 0;
+    for (; i + num_zeros < n && v[i + num_zeros] == T(0); ++num_zeros) {}
+    i += num_zeros;
+    for (; i + num_values < n && v[i + num_values] != T(0); ++num_values) {}
+    write_value(out, num_zeros);
+    write_value(out, num_values);
+    out.write(reinterpret_cast<const char*>(v + i), num_values*sizeof(T));
+    i += num_values;
+  }
+}
+
+template <class T> static void
+read_values(istream &in, T *v, const uint64_t n) {
+  for (uint64_t i = 0; i < n;) {
+    uint64_t num_zeros = 0, num_values = 0;
+    read_value(in, num_zeros);
+    read_value(in, num_values);
+    if (num_zeros > n - i || num_values > n - i - num_zeros)
+      throw runtime_error("stats snapshot has runs past its arrays");
+    std::fill_n(v + i, num_zeros, T(0));
+    i += num_zeros;
+    in.read(reinterpret_cast<char*>(v + i), num_values*sizeof(T));
+    if (!in)
+      throw runtime_error("stats snapshot ends unexpectedly");
+    i += num_values;
+  }
+}
+
+template <class T, size_t N> static void
+write_array(ostream &out, const array<T, N> &v) {
+  write_values(out, v.data(), N);
+}
+
+template <class T> static void
+write_vector(ostream &out, const vector<T> &v) {
+  write_values(out, v.data(), v.size());
+}
+
+template <class T, size_t N> static void
+read_array(istream &in, array<T, N> &v) {
+  uint64_t n = 0;
+  read_value(in, n);
+  if (n != N)
+    throw runtime_error("stats snapshot has arrays of unexpected sizes");
+  read_values(in, v.data(), N);
+}
+
+// Arrays are only resized once their size was checked, so a damaged
+// snapshot is an error rather than a huge allocation
+template <class T> static void
+resize_and_read_values(istream &in, vector<T> &v, const uint64_t n) {
+  try {
+    v.resize(n);
+  }
+  catch (const std::bad_alloc &) {
+    throw runtime_error("stats snapshot has arrays too large to read");
+  }
+  read_values(in, v.data(), n);
+}
+
+template <class T> static void
+read_vector(istream &in, vector<T> &v, const uint64_t max_size) {
+  uint64_t n = 0;
+  read_value(in, n);
+  if (n > max_size)
+    throw runtime_error("stats snapshot has arrays of unexpected sizes");
+  resize_and_read_values(in, v, n);
+}
+
+// same as above for arrays whose size is set by earlier counters
+template <class T> static void
+read_vector_of_size(istream &in, vector<T> &v, const uint64_t size) {
+  uint64_t n = 0;
+  read_value(in, n);
+  if (n != size)
+    throw runtime_error("stats snapshot has arrays of unexpected sizes");
+  resize_and_read_values(in, v, n);
+}
+
+// bytes of the stream after the position it is at, which bounds the
+// number of values that are not zero in the rest of the snapshot
+static uint64_t
+get_bytes_left(istream &in) {
+  const std::streampos pos = in.tellg();
+  if (pos < 0)
+    return std::numeric_limits<uint64_t>::max();
+  in.seekg(0, std::ios::end);
+  const std::streampos end_pos = in.tellg();
+  in.seekg(pos);
+  return (end_pos < pos) ? 0 : static_cast<uint64_t>(end_pos - pos);
+}
+
+// longest read a snapshot may have counted, past which its counters are
+// taken to be damaged
+static const size_t max_snapshot_read_length = (static_cast<size_t>(1) << 32);
+
+// constants that define the layout of the counters
+static vector<uint64_t>
+get_snapshot_layout() {
+  return {
+    sizeof(size_t), FastqStats::SHORT_READ_THRESHOLD,
+    FastqStats::kNumQualityValues, FastqStats::kNumNucleotides,
+    Constants::max_adapters, Constants::kmer_size,
+    FastqStats::long_bins_per_doubling, FastqStats::kGCTruncation
+  };
+}
+
+void
+FastqStats::write_snapshot(ostream &out) const {
+  out.write(snapshot_magic, sizeof(snapshot_magic));
+  write_value(out, snapshot_version);
+  write_value(out, snapshot_byte_order);
+  write_vector(out, get_snapshot_layout());
+
+  write_value(out, lowest_char);
+  write_value(out, num_unique_seen);
+  write_value(out, count_at_limit);
+  write_value(out, total_bases);
+  write_value(out, num_reads);
+  write_value(out, empty_reads);
+  write_value(out, max_read_length);
+  write_value(out, num_poor);
+  write_value(out, total_gc);
+
+  write_array(out, base_count);
+  write_array(out, n_base_count);
+  write_array(out, position_quality_count);
+  write_array(out, quality_count);
+  write_array(out, gc_cell_count);
+  write_array(out, long_gc_count);
+  write_array(out, read_length_freq);
+  write_array(out, pos_kmer_count);
+  write_array(out, pos_adapter_count);
+
+  write_vector(out, tile_names);
+  write_value(out, tile_row_size);
+  write_vector(out, tile_position_quality);
+  write_vector(out, tile_position_count);
+
+  write_vector(out, long_base_count);
+  write_vector(out, long_n_base_count);
+  write_vector(out, long_position_quality_count);
+  write_vector(out, long_read_length_freq);
+  write_vector(out, long_pos_kmer_count);
+  write_vector(out, long_pos_adapter_count);
+
+  write_vector(out, kmer_count);
+  vector<size_t> overflow;
+  for (const auto &v : kmer_count_overflow) {
+    overflow.push_back(v.first);
+    overflow.push_back(v.second);
+  }
+  write_vector(out, overflow);
+
+  // sequences are in the order they were first seen
+  write_value(out, static_cast<uint64_t>(sequence_count.size()));
+  for (size_t i = 0; i < sequence_count.size(); ++i) {
+    const string seq = sequence_count.get_sequence(i);
+    write_values(out, seq.data(), seq.size());
+    write_value(out, sequence_count.count(i));
+  }
+
+  if (!out)
+    throw runtime_error("failed to write stats snapshot");
+}
+
+bool
+FastqStats::is_snapshot(istream &in) {
+  const std::streampos start = in.tellg();
+  char magic[sizeof(snapshot_magic)];
+  in.read(magic, sizeof(magic));
+  const bool ans =
+    in && std::equal(magic, magic + sizeof(magic), snapshot_magic);
+  in.clear();
+  in.seekg(start);
+  return ans;
+}
+
+void
+FastqStats::read_snapshot(istream &in) {
+  char magic[sizeof(snapshot_magic)];
+  in.read(magic, sizeof(magic));
+  if (!in || !std::equal(magic, magic + sizeof(magic), snapshot_magic))
+    throw runtime_error("not a falco stats snapshot");
+
+  uint32_t version = 0, byte_order = 0;
+  read_value(in, version);
+  if (version != snapshot_version)
+    throw runtime_error("unsupported stats snapshot version: " +
+                        std::to_string(version));
+  read_value(in, byte_order);
+  vector<uint64_t> layout;
+  read_vector(in, layout, get_snapshot_layout().size());
+  if (byte_order != snapshot_byte_order || layout != get_snapshot_layout())
+    throw runtime_error("stats snapshot was written by an incompatible build");
+
+  read_value(in, lowest_char);
+  read_value(in, num_unique_seen);
+  read_value(in, count_at_limit);
+  read_value(in, total_bases);
+  read_value(in, num_reads);
+  read_value(in, empty_reads);
+  read_value(in, max_read_length);
+  read_value(in, num_poor);
+  read_value(in, total_gc);
+  if (max_read_length > max_snapshot_read_length)
+    throw runtime_error("stats snapshot has an invalid read length");
+
+  read_array(in, base_count);
+  read_array(in, n_base_count);
+  read_array(in, position_quality_count);
+  read_array(in, quality_count);
+  read_array(in, gc_cell_count);
+  read_array(in, long_gc_count);
+  read_array(in, read_length_freq);
+  read_array(in, pos_kmer_count);
+  read_array(in, pos_adapter_count);
+
+  // positions grow geometrically past the longest read, at most doubling
+  // again when stats are merged, and tile names are distinct, so at most
+  // one of them is zero
+  const size_t max_positions = 8*(max_read_length + 1);
+  read_vector(in, tile_names, get_bytes_left(in)/sizeof(size_t) + 1);
+  read_value(in, tile_row_size);
+  if (tile_row_size > max_positions || (tile_row_size > 0 &&
+      tile_names.size() > std::numeric_limits<size_t>::max()/tile_row_size))
+    throw runtime_error("stats snapshot has inconsistent tile counts");
+  read_vector_of_size(in, tile_position_quality,
+                      tile_names.size()*tile_row_size);
+  read_vector_of_size(in, tile_position_count,
+                      tile_names.size()*tile_row_size);
+  tile_index.clear();
+  for (size_t t = 0; t < tile_names.size(); ++t)
+    tile_index[tile_names[t]] = t;
+
+  // the number of long read positions is set by the first of these
+  read_vector(in, long_base_count, max_positions*kNumNucleotides);
+  if (long_base_count.size() % kNumNucleotides != 0)
+    throw runtime_error("stats snapshot has inconsistent long read counts");
+  num_extra_bases = long_base_count.size()/kNumNucleotides;
+  read_vector_of_size(in, long_n_base_count, num_extra_bases);
+  read_vector_of_size(in, long_position_quality_count,
+                      num_extra_bases*kNumQualityValues);
+  read_vector_of_size(in, long_read_length_freq, num_extra_bases);
+
+  const size_t max_long_bins =
+    long_bin_of(max(max_read_length, SHORT_READ_THRESHOLD)) + 1;
+  read_vector(in, long_pos_kmer_count, max_long_bins);
+  read_vector(in, long_pos_adapter_count,
+              max_long_bins << Constants::bit_shift_adapter);
+
+  read_vector(in, kmer_count, (SHORT_READ_THRESHOLD + max_long_bins)
+                              << Constants::bit_shift_kmer);
+  vector<size_t> overflow;
+  read_vector(in, overflow, get_bytes_left(in)/sizeof(size_t));
+  kmer_count_overflow.clear();
+  for (size_t i = 0; i + 1 < overflow.size(); i += 2)
+    kmer_count_overflow[overflow[i]] = overflow[i + 1];
+
+  uint64_t num_sequences = 0;
+  read_value(in, num_sequences);
+  sequence_count.clear();
+  vector<char> seq;
+  for (size_t i = 0; i < num_sequences; ++i) {
+    read_vector(in, seq, SequenceTable::max_length);
+    size_t count = 0;
+    read_value(in, count);
+    bool is_new;
+    const size_t ind =
+      sequence_count.find_or_add(seq.data(), seq.size(), true, is_new);
+    if (ind == SequenceTable::not_found)
+      throw runtime_error("stats snapshot has an invalid sequence");
+    sequence_count.count(ind) += count;
+  }
+}
+
+/****************************************************************/
+/******************** CONVERGENCE TRACKER ***********************/
+/****************************************************************/
+const size_t ConvergenceTracker::num_quantiles;
+
+// Phred values that a change in a quality quantile is relative to
+static const double quality_range = 40.0;
+
+ConvergenceTracker::ConvergenceTracker(const double _tolerance,
+                                       const size_t _num_stable) :
+  tolerance(_tolerance), num_stable(max(_num_stable, size_t(1))) {
+  last_num_positions = 0;
+  last_num_reads = 0;
+  num_stable_seen = 0;
+}
+
+// quantile of a histogram, interpolated within the value it falls in so
+// it moves smoothly as counts are added
+static double
+get_quantile(const size_t *hist, const size_t num_values,
+             const size_t total, const double fraction) {
+  const double target = fraction*static_cast<double>(total);
+  double cumulative = 0.0;
+  for (size_t i = 0; i < num_values; ++i) {
+    if (hist[i] == 0)
+      continue;
+    const double next = cumulative + static_cast<double>(hist[i]);
+    if (next >= target)
+      return static_cast<double>(i) +
+             (target - cumulative)/static_cast<double>(hist[i]);
+    cumulative = next;
+  }
+  return static_cast<double>(num_values);
+}
+
+void
+ConvergenceTracker::get_estimates(const FastqStats &stats,
+                                  const size_t num_positions,
+                                  vector<double> &estimates) {
+  static const double quantiles[num_quantiles] = {0.25, 0.5, 0.75};
+  estimates.clear();
+
+  // quality quartiles and base content of each position
+  for (size_t i = 0; i < num_positions; ++i) {
+    const size_t *hist = &stats.position_quality_count[
+      i << FastqStats::kBitShiftQuality];
+    size_t total = 0;
+    for (size_t j = 0; j < FastqStats::kNumQualityValues; ++j)
+      total += hist[j];
+    for (size_t k = 0; k < num_quantiles; ++k)
+      estimates.push_back((total == 0) ? 0.0 :
+        get_quantile(hist, FastqStats::kNumQualityValues, total,
+                     quantiles[k])/quality_range);
+
+    const size_t *bases =
+      &stats.base_count[i << FastqStats::kBitShiftNucleotide];
+    size_t num_bases = stats.n_base_count[i];
+    for (size_t j = 0; j < FastqStats::kNumNucleotides; ++j)
+      num_bases += bases[j];
+    for (size_t j = 0; j < FastqStats::kNumNucleotides; ++j)
+      estimates.push_back((num_bases == 0) ? 0.0 :
+        static_cast<double>(bases[j])/static_cast<double>(num_bases));
+  }
+
+  // cumulative distribution of GC content
+  array<double, 101> gc_count;
+  stats.get_gc_count(gc_count);
+  double total_gc = 0.0;
+  for (const double v : gc_count)
+    total_gc += v;
+  double cumulative = 0.0;
+  for (const double v : gc_count) {
+    cumulative += v;
+    estimates.push_back((total_gc == 0.0) ? 0.0 : cumulative/total_gc);
+  }
+
+  // fraction of the reads counted for duplication that were not new
+  estimates.push_back((stats.count_at_limit == 0) ? 0.0 :
+    1.0 - static_cast<double>(stats.num_unique_seen)/
+          static_cast<double>(stats.count_at_limit));
+}
+
+bool
+ConvergenceTracker::add_checkpoint(const FastqStats &stats) {
+  // positions past the short read threshold are only in the long reads
+  // arrays and are not compared
+  const size_t num_positions =
+    min(stats.max_read_length, FastqStats::SHORT_READ_THRESHOLD);
+
+  vector<double> estimates;
+  get_estimates(stats, num_positions, estimates);
+
+  // a longer read than all before adds positions that have not had time
+  // to converge
+  bool stable = (last_num_reads > 0 && num_positions == last_num_positions);
+  for (size_t i = 0; stable && i < estimates.size(); ++i)
+    stable = (std::fabs(estimates[i] - last[i]) <= tolerance);
+
+  num_stable_seen = stable ? (num_stable_seen + 1) : 0;
+  last.swap(estimates);
+  last_num_positions = num_positions;
+  last_num_reads = stats.num_reads;
+  return converged();
+}
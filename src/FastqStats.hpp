@@ -21,7 +21,10 @@
 #include <iostream>
 #include <unordered_map>
 #include <array>
+#include <limits>
+#include <cstdint>
 #include "FalcoConfig.hpp"
+#include "SequenceTable.hpp"
 // log of a power of two, to use in bit shifting for fast index acces
 // returns the log2 of a number if it is a power of two, or zero
 // otherwise
@@ -112,6 +115,39 @@ struct GCModel {
 
 /********************** END COPY FROM FASTQC *************/
 
+/*************************************************************
+ ******************** FLAT GC MODELS *************************
+ *************************************************************/
+// Reads are counted for the GC model by their length and GC count. Reads
+// of up to gc_truncation bases are counted as they are, and longer ones
+// by the GC count of their first bases up to the last multiple of
+// gc_truncation, so there is a row of cells for every length up to
+// gc_truncation and one for each multiple of it up to the longest short
+// read. Row r has one cell per GC count from 0 to the length of the row.
+constexpr size_t
+gc_length_of_row(const size_t row, const size_t gc_truncation) {
+  return (row <= gc_truncation) ? row : (row - gc_truncation + 1)*gc_truncation;
+}
+
+constexpr size_t
+count_gc_cells(const size_t num_rows, const size_t gc_truncation) {
+  return (num_rows == 0) ? 0 :
+    (gc_length_of_row(num_rows - 1, gc_truncation) + 1) +
+    count_gc_cells(num_rows - 1, gc_truncation);
+}
+
+// The FastQC models of all cells one after the other, so the counts of a
+// cell are spread over GC percentages by walking one contiguous range
+struct FlatGCModels {
+  // first cell of each row, and first value of each cell followed by the
+  // number of values
+  std::vector<size_t> row_start;
+  std::vector<size_t> cell_start;
+  std::vector<GCModelValue> values;
+
+  FlatGCModels(const size_t num_rows, const size_t gc_truncation);
+};
+
 /*************************************************************
  ******************** FASTQ STATS ****************************
  *************************************************************/
@@ -173,8 +209,23 @@ struct FastqStats {
   size_t num_extra_bases;  // number of bases outside of buffer
   size_t total_gc; // sum of all G+C bases in all reads
 
-  // Pre-calculated GC model increments
-  static const std::array<GCModel, SHORT_READ_THRESHOLD> gc_models;
+  /********** GC MODEL CELLS ****************/
+  // rows of GC model cells, as described in FlatGCModels
+  static const size_t kGCTruncation = 100;
+  static const size_t kNumGCRows =
+    kGCTruncation + SHORT_READ_THRESHOLD/kGCTruncation;
+  static const size_t kNumGCCells = count_gc_cells(kNumGCRows, kGCTruncation);
+
+  // Pre-calculated GC model increments of every cell
+  static const FlatGCModels gc_models;
+
+  // cell of a read of a length (at most gc_truncation or a multiple of
+  // it) with a number of G and C bases
+  static inline size_t gc_cell(const size_t length, const size_t gc) {
+    const size_t row = (length <= kGCTruncation) ? length :
+      (kGCTruncation + length/kGCTruncation - 1);
+    return gc_models.row_start[row] + gc;
+  }
 
   /*********************************************************
    *********** METRICS COLLECTED DURING IO *****************
@@ -193,8 +244,13 @@ struct FastqStats {
   std::array<size_t, kNumQualityValues> quality_count;
 
   /*********** PER GC VALUE METRICS ****************/
-  // histogram of GC fraction in each read from 0 to 100%
-  std::array<double, 101> gc_count;
+  // reads in each GC model cell, spread over GC percentages by the models
+  // only when summarized
+  std::array<size_t, kNumGCCells> gc_cell_count;
+
+  // reads longer than the buffer in each GC percentage, which are not
+  // smoothed
+  std::array<size_t, 101> long_gc_count;
 
     /*********** PER READ METRICS ***************/
   // Distribution of read lengths
@@ -202,8 +258,14 @@ struct FastqStats {
   std::array<size_t, SHORT_READ_THRESHOLD> cumulative_read_length_freq;
 
   /*********** PER TILE SEQUENCE QUALITY OVERSERQUENCES ********/
-  std::unordered_map <size_t, std::vector<double> > tile_position_quality;
-  std::unordered_map <size_t, std::vector<size_t> > tile_position_count;
+  // Tiles get consecutive indices in the order they are first seen. The
+  // quality sum and count of tile t in position i are at
+  // t*tile_row_size + i, so each read only looks its tile up once
+  std::unordered_map<size_t, size_t> tile_index;
+  std::vector<size_t> tile_names;  // tile number of each index
+  size_t tile_row_size;
+  std::vector<double> tile_position_quality;
+  std::vector<size_t> tile_position_count;
 
   /*********** SLOW DATA STRUCTURES FOR LONGER READS ************/
   // Leftover memory using dynamic allocation
@@ -214,8 +276,13 @@ struct FastqStats {
   std::vector<size_t> long_cumulative_read_length_freq;
 
   /********** KMER FREQUENCY ****************/
-  // A (4^K + 1)*SHORT_READ_THRESHOLD std::vector to count all possible kmers
-  std::vector<size_t> kmer_count;
+  // Counts of all possible kmers ending at each position, with the counts of
+  // position i in [i << bit_shift_kmer, (i + 1) << bit_shift_kmer). Positions
+  // are only allocated when a kmer ending in them is counted, so the table is
+  // empty if kmers are not counted and covers only the longest read
+  // otherwise. Counts that do not fit in 32 bits go to kmer_count_overflow
+  std::vector<uint32_t> kmer_count;
+  std::unordered_map<size_t, size_t> kmer_count_overflow;
 
   // How many kmers were counted in each position
   std::array<size_t, SHORT_READ_THRESHOLD> pos_kmer_count;
@@ -223,20 +290,159 @@ struct FastqStats {
   // How many adapters were counted in each position
   std::array<size_t, Constants::max_adapters * SHORT_READ_THRESHOLD> pos_adapter_count;
 
+  /********** KMERS AND ADAPTERS IN LONG READS ****************/
+  // Past SHORT_READ_THRESHOLD, k-mers and adapters are counted in bins of
+  // positions that get wider with the position, long_bins_per_doubling
+  // bins every time the position doubles. Counts of k-mers ending in bin b
+  // are in kmer_count as position SHORT_READ_THRESHOLD + b, and the counts
+  // of adapters ending in bin b are at (b << bit_shift_adapter) | adapter
+  static const size_t long_bins_per_doubling = 8;
+  std::vector<size_t> long_pos_kmer_count;
+  std::vector<size_t> long_pos_adapter_count;
+
   /*********** DUPLICATION ******************/
   // First 100k unique sequences and how often they were seen
-  std::unordered_map <std::string, size_t> sequence_count;
+  SequenceTable sequence_count;
 
   /**************** FUNCTIONS ****************************/
   // Default constructor that zeros everything
   FastqStats();
 
-  // Allocation of more read positions
-  void allocate_new_base(const bool ignore_tile);
+  // Allocation of room for at least num_bases positions past
+  // SHORT_READ_THRESHOLD, which grows geometrically so long reads do not
+  // reallocate for every base
+  void allocate_new_bases(const size_t num_bases);
+
+  // first position of a bin of long read positions, and the bin of a
+  // position that is at least SHORT_READ_THRESHOLD
+  static size_t long_bin_start(const size_t bin);
+  static size_t long_bin_of(const size_t pos);
+
+  // number of bins needed for the longest read
+  size_t num_long_bins() const;
+
+  // Adds one to the count of a kmer or adapter ending in a bin
+  inline void add_long_kmer(const size_t bin, const size_t kmer) {
+    if (bin >= long_pos_kmer_count.size())
+      long_pos_kmer_count.resize(bin + 1, 0);
+    ++long_pos_kmer_count[bin];
+    add_kmer(SHORT_READ_THRESHOLD + bin, kmer);
+  }
+  inline void add_long_adapter(const size_t bin, const size_t adapter) {
+    const size_t ind = (bin << Constants::bit_shift_adapter) | adapter;
+    if (ind >= long_pos_adapter_count.size())
+      long_pos_adapter_count.resize((bin + 1) << Constants::bit_shift_adapter,
+                                    0);
+    ++long_pos_adapter_count[ind];
+  }
+
+  // count of an adapter ending in a bin
+  inline size_t get_long_adapter_count(const size_t bin,
+                                       const size_t adapter) const {
+    const size_t ind = (bin << Constants::bit_shift_adapter) | adapter;
+    return (ind < long_pos_adapter_count.size()) ?
+      long_pos_adapter_count[ind] : 0;
+  }
+
+  // index of a tile, which is added with room for max_read_length
+  // positions if it was not seen before
+  size_t get_tile_index(const size_t tile);
+
+  // makes the rows of all tiles hold at least num_positions positions
+  inline void reserve_tile_positions(const size_t num_positions) {
+    if (num_positions > tile_row_size)
+      grow_tile_rows(num_positions);
+  }
+  void grow_tile_rows(const size_t num_positions);
+
+  // Adds one to the count of a kmer ending at a position
+  inline void add_kmer(const size_t pos, const size_t kmer) {
+    const size_t ind = (pos << Constants::bit_shift_kmer) | kmer;
+    if (ind >= kmer_count.size())
+      kmer_count.resize((pos + 1) << Constants::bit_shift_kmer, 0);
+    if (kmer_count[ind] == std::numeric_limits<uint32_t>::max())
+      ++kmer_count_overflow[ind];
+    else
+      ++kmer_count[ind];
+  }
+
+  // Count of a kmer ending at a position
+  inline size_t get_kmer_count(const size_t pos, const size_t kmer) const {
+    const size_t ind = (pos << Constants::bit_shift_kmer) | kmer;
+    if (ind >= kmer_count.size())
+      return 0;
+    if (kmer_count_overflow.empty())
+      return kmer_count[ind];
+    const auto it = kmer_count_overflow.find(ind);
+    return kmer_count[ind] +
+           ((it == end(kmer_count_overflow)) ? 0 : it->second);
+  }
 
   void summarize();
 
+  // histogram of the GC percentage of reads from 0 to 100%, with the
+  // FastQC models applied to the counts of each cell
+  void get_gc_count(std::array<double, 101> &gc_count) const;
+
+  // Adds the counts of a FastqStats object populated from reads that come
+  // after the ones seen by this object. Must be called before summarize().
+  // The duplication table is only exact if the combined number of unique
+  // sequences stays below the counting cutoff
+  void merge(const FastqStats &rhs);
+
   // Given an input fastqc_data.txt file, populate the statistics with it
   void read(std::istream &is);
+
+  // Binary snapshot of the counts collected from the reads, taken before
+  // summarize(), which read_snapshot loads back so snapshots of several
+  // inputs can be merged and summarized without reading them again
+  void write_snapshot(std::ostream &out) const;
+  void read_snapshot(std::istream &in);
+
+  // whether a stream starts with a snapshot, without consuming any of it
+  static bool is_snapshot(std::istream &in);
+};
+
+/*************************************************************
+ ******************** CONVERGENCE TRACKER ********************
+ *************************************************************/
+// Decides when reading more of a file would not change its report. At
+// each checkpoint the running estimates of the quartiles of quality in
+// every position, the base content of every position, the distribution of
+// GC content and the duplication rate are compared with those of the
+// previous checkpoint. The metrics converged once none of them moved more
+// than tolerance for num_stable consecutive checkpoints. Fractions are
+// compared as they are, and quality quantiles relative to a range of 40
+// Phred values.
+class ConvergenceTracker {
+ public:
+  ConvergenceTracker(const double _tolerance, const size_t _num_stable);
+
+  // records the estimates of the reads counted so far and returns whether
+  // the metrics converged
+  bool add_checkpoint(const FastqStats &stats);
+
+  bool converged() const {return num_stable_seen >= num_stable;}
+
+  // number of reads in the last checkpoint
+  size_t num_reads() const {return last_num_reads;}
+
+ private:
+  static const size_t num_quantiles = 3;
+
+  const double tolerance;
+  const size_t num_stable;
+
+  // estimates at the last checkpoint, and for how many checkpoints in a
+  // row they stayed within tolerance
+  std::vector<double> last;
+  size_t last_num_positions;
+  size_t last_num_reads;
+  size_t num_stable_seen;
+
+  // all estimates, scaled so a change of one is the largest that matters
+  static void get_estimates(const FastqStats &stats,
+                            const size_t num_positions,
+                            std::vector<double> &estimates);
 };
 #endif
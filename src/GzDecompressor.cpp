@@ -0,0 +1,528 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "GzDecompressor.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <zlib.h>
+
+#ifdef USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+using std::string;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using std::runtime_error;
+using std::thread;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+
+/*******************************************************/
+/*************** BGZF BLOCKS ***************************/
+/*******************************************************/
+static const size_t gzip_header_size = 12;
+static const size_t gzip_footer_size = 8;
+
+// largest number of bytes a BGZF block inflates to
+static const size_t max_bgzf_block_size = (1 << 16);
+
+static inline size_t
+get_uint16(const unsigned char *p) {
+  return static_cast<size_t>(p[0]) | (static_cast<size_t>(p[1]) << 8);
+}
+
+static inline uint32_t
+get_uint32(const unsigned char *p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static inline bool
+is_gzip_header_with_extra(const unsigned char *header) {
+  return header[0] == 31 && header[1] == 139 && header[2] == 8 &&
+         (header[3] & 4);
+}
+
+// Finds the BSIZE value in the BC subfield of the extra gzip field, which
+// is the size of the whole block minus one
+static bool
+get_bgzf_block_size(const unsigned char *extra, const size_t xlen,
+                    size_t &block_size) {
+  for (size_t i = 0; i + 4 <= xlen;) {
+    const size_t slen = get_uint16(extra + i + 2);
+    if (extra[i] == 'B' && extra[i + 1] == 'C' && slen == 2 &&
+        i + 6 <= xlen) {
+      block_size = get_uint16(extra + i + 4) + 1;
+      return true;
+    }
+    i += 4 + slen;
+  }
+  return false;
+}
+
+// whether data, the start of a file, begins with a BGZF block
+static bool
+starts_with_bgzf_block(const unsigned char *data, const size_t size) {
+  if (size < gzip_header_size || !is_gzip_header_with_extra(data))
+    return false;
+  const size_t xlen = get_uint16(data + 10);
+  size_t block_size = 0;
+  return gzip_header_size + xlen <= size &&
+         get_bgzf_block_size(data + gzip_header_size, xlen, block_size);
+}
+
+// whether the first block of the file is a BGZF block
+static bool
+file_is_bgzf(FILE *fp) {
+  vector<unsigned char> start(gzip_header_size + (1 << 16));
+  const size_t num_read = fread(start.data(), 1, start.size(), fp);
+  rewind(fp);
+  return starts_with_bgzf_block(start.data(), num_read);
+}
+
+// Inflates whole BGZF blocks whose decompressed size is known in advance
+class BlockInflater {
+ public:
+  BlockInflater() {
+#ifdef USE_LIBDEFLATE
+    decompressor = libdeflate_alloc_decompressor();
+    if (decompressor == NULL)
+      throw runtime_error("cannot allocate block decompressor");
+#else
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+      throw runtime_error("cannot allocate block decompressor");
+#endif
+  }
+  BlockInflater(const BlockInflater &) = delete;
+  ~BlockInflater() {
+#ifdef USE_LIBDEFLATE
+    libdeflate_free_decompressor(decompressor);
+#else
+    inflateEnd(&strm);
+#endif
+  }
+
+  // returns false if the block is corrupt
+  bool inflate_block(const unsigned char *in, const size_t in_size,
+                     char *out, const size_t out_size, const uint32_t crc) {
+    if (out_size == 0)
+      return true;
+#ifdef USE_LIBDEFLATE
+    if (libdeflate_deflate_decompress(decompressor, in, in_size, out,
+                                      out_size, NULL) != LIBDEFLATE_SUCCESS)
+      return false;
+    return libdeflate_crc32(0, out, out_size) == crc;
+#else
+    inflateReset(&strm);
+    strm.next_in = const_cast<Bytef*>(in);
+    strm.avail_in = in_size;
+    strm.next_out = reinterpret_cast<Bytef*>(out);
+    strm.avail_out = out_size;
+    if (inflate(&strm, Z_FINISH) != Z_STREAM_END || strm.avail_out != 0)
+      return false;
+    return crc32(0L, reinterpret_cast<const Bytef*>(out), out_size) == crc;
+#endif
+  }
+
+ private:
+#ifdef USE_LIBDEFLATE
+  libdeflate_decompressor *decompressor;
+#else
+  z_stream strm;
+#endif
+};
+
+/*******************************************************/
+/*************** GZ DECOMPRESSOR ***********************/
+/*******************************************************/
+size_t
+GzDecompressor::max_buffered_bytes() {
+  return (max_queued_chunks + 3) * chunk_size;
+}
+
+GzDecompressor::GzDecompressor(const string &_filename,
+                               const size_t _num_threads) :
+  filename(_filename), num_threads(_num_threads == 0 ? 1 : _num_threads) {
+  fp = fopen(filename.c_str(), "rb");
+  if (fp == NULL)
+    throw runtime_error("Cannot open gzip FASTQ file : " + filename);
+
+  bgzf = file_is_bgzf(fp);
+  compressed = true;
+  head_pos = 0;
+  compressed_offset = 0;
+  finished = false;
+  stopped = false;
+  producer = thread(&GzDecompressor::run, this);
+}
+
+GzDecompressor::GzDecompressor(const vector<char> &_head,
+                               const bool _compressed,
+                               const size_t _num_threads) :
+  filename("standard input"),
+  num_threads(_num_threads == 0 ? 1 : _num_threads), head(_head) {
+  fp = stdin;
+  compressed = _compressed;
+  bgzf = compressed && starts_with_bgzf_block(
+    reinterpret_cast<const unsigned char*>(head.data()), head.size());
+  head_pos = 0;
+  compressed_offset = 0;
+  finished = false;
+  stopped = false;
+  producer = thread(&GzDecompressor::run, this);
+}
+
+GzDecompressor::~GzDecompressor() {
+  {
+    lock_guard<mutex> lock(mtx);
+    stopped = true;
+    cv.notify_all();
+  }
+  producer.join();
+  if (fp != stdin)
+    fclose(fp);
+}
+
+size_t
+GzDecompressor::read_input(void *buf, const size_t num_bytes) {
+  const size_t from_head = std::min(num_bytes, head.size() - head_pos);
+  memcpy(buf, head.data() + head_pos, from_head);
+  head_pos += from_head;
+  if (from_head == num_bytes)
+    return num_bytes;
+  return from_head + fread(static_cast<char*>(buf) + from_head, 1,
+                           num_bytes - from_head, fp);
+}
+
+vector<char>
+GzDecompressor::get_free_chunk() {
+  vector<char> chunk;
+  lock_guard<mutex> lock(mtx);
+  if (!free_chunks.empty()) {
+    chunk.swap(free_chunks.back());
+    free_chunks.pop_back();
+  }
+  chunk.clear();
+  return chunk;
+}
+
+bool
+GzDecompressor::push_chunk(vector<char> &chunk, const size_t offset) {
+  unique_lock<mutex> lock(mtx);
+  cv.wait(lock, [&]() {return stopped || queue.size() < max_queued_chunks;});
+  if (stopped)
+    return false;
+
+  queue.push_back(make_pair(vector<char>(), offset));
+  queue.back().first.swap(chunk);
+  cv.notify_all();
+  return true;
+}
+
+bool
+GzDecompressor::next_chunk(vector<char> &chunk) {
+  unique_lock<mutex> lock(mtx);
+  cv.wait(lock, [&]() {return finished || !queue.empty();});
+
+  // chunks decompressed before an error are still parsed
+  if (queue.empty()) {
+    if (error)
+      std::rethrow_exception(error);
+    return false;
+  }
+
+  if (chunk.capacity() > 0) {
+    free_chunks.push_back(vector<char>());
+    free_chunks.back().swap(chunk);
+  }
+  chunk.swap(queue.front().first);
+  compressed_offset = queue.front().second;
+  queue.pop_front();
+  cv.notify_all();
+  return true;
+}
+
+void
+GzDecompressor::run() {
+  try {
+    if (!compressed)
+      copy_stream();
+    else if (bgzf)
+      inflate_bgzf();
+    else
+      inflate_stream();
+  }
+  catch (...) {
+    lock_guard<mutex> lock(mtx);
+    error = std::current_exception();
+  }
+  lock_guard<mutex> lock(mtx);
+  finished = true;
+  cv.notify_all();
+}
+
+// Inflates a regular gzip file, possibly with several members, as zlib
+// would when reading it through gzread
+void
+GzDecompressor::inflate_stream() {
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  // 32 makes zlib detect the gzip header
+  if (inflateInit2(&strm, MAX_WBITS + 32) != Z_OK)
+    throw runtime_error("cannot allocate gzip decompressor");
+
+  vector<unsigned char> in(input_size);
+  vector<char> out = get_free_chunk();
+  out.resize(chunk_size);
+  size_t out_pos = 0;
+  size_t tot_bytes_read = 0;
+  bool member_ended = false;
+  for (;;) {
+    if (strm.avail_in == 0) {
+      const size_t num_read = read_input(in.data(), input_size);
+      if (ferror(fp)) {
+        inflateEnd(&strm);
+        throw runtime_error("error reading gzip file: " + filename);
+      }
+      if (num_read == 0)
+        break;
+      tot_bytes_read += num_read;
+      strm.next_in = in.data();
+      strm.avail_in = num_read;
+    }
+
+    strm.next_out = reinterpret_cast<Bytef*>(out.data() + out_pos);
+    strm.avail_out = chunk_size - out_pos;
+    const int ret = inflate(&strm, Z_NO_FLUSH);
+    const size_t num_inflated = (chunk_size - out_pos) - strm.avail_out;
+    out_pos += num_inflated;
+
+    // another member may follow, otherwise the rest is ignored like gzread
+    // does with trailing garbage
+    if (ret == Z_STREAM_END) {
+      member_ended = true;
+      inflateReset(&strm);
+    }
+    else if (ret == Z_DATA_ERROR && member_ended && num_inflated == 0)
+      break;
+    else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      inflateEnd(&strm);
+      throw runtime_error("corrupt gzip file: " + filename);
+    }
+    else if (num_inflated > 0)
+      member_ended = false;
+
+    if (out_pos == chunk_size) {
+      if (!push_chunk(out, tot_bytes_read - strm.avail_in)) {
+        inflateEnd(&strm);
+        return;
+      }
+      out = get_free_chunk();
+      out.resize(chunk_size);
+      out_pos = 0;
+    }
+  }
+  inflateEnd(&strm);
+
+  if (out_pos > 0) {
+    out.resize(out_pos);
+    push_chunk(out, tot_bytes_read);
+  }
+}
+
+// Reads BGZF blocks until they add up to a chunk, then inflates them in
+// parallel directly into their position in the chunk. Helper threads are
+// started once for the whole file and inflate their share of the blocks of
+// every chunk, so no thread is started per chunk
+void
+GzDecompressor::inflate_bgzf() {
+  struct Block {
+    size_t in_pos;
+    size_t in_size;
+    size_t out_pos;
+    size_t out_size;
+    uint32_t crc;
+  };
+
+  vector<unsigned char> compressed;
+  vector<unsigned char> extra(1 << 16);
+  vector<Block> blocks;
+  vector<BlockInflater> inflaters(num_threads);
+  vector<char> out;
+
+  // each worker inflates a contiguous set of the blocks of the chunk
+  size_t num_workers = 0;
+  vector<char> corrupt(num_threads, false);
+  auto inflate_blocks = [&](const size_t worker) {
+    const size_t first = (blocks.size() * worker) / num_workers;
+    const size_t last = (blocks.size() * (worker + 1)) / num_workers;
+    for (size_t i = first; i < last && !corrupt[worker]; ++i)
+      corrupt[worker] = !inflaters[worker].inflate_block(
+        compressed.data() + blocks[i].in_pos, blocks[i].in_size,
+        out.data() + blocks[i].out_pos, blocks[i].out_size, blocks[i].crc);
+  };
+
+  // helpers wait for the next chunk, whose blocks are not changed until
+  // all of them are done with it
+  mutex pool_mtx;
+  std::condition_variable pool_cv;
+  size_t chunk_number = 0;
+  size_t num_helpers_done = 0;
+  bool stop_helpers = false;
+  vector<thread> helpers;
+  auto help = [&](const size_t worker) {
+    size_t last_chunk = 0;
+    unique_lock<mutex> lock(pool_mtx);
+    for (;;) {
+      pool_cv.wait(lock, [&]() {
+        return stop_helpers || chunk_number != last_chunk;
+      });
+      if (stop_helpers)
+        return;
+      last_chunk = chunk_number;
+      lock.unlock();
+      if (worker < num_workers)
+        inflate_blocks(worker);
+      lock.lock();
+      ++num_helpers_done;
+      pool_cv.notify_all();
+    }
+  };
+  auto join_helpers = [&]() {
+    {
+      lock_guard<mutex> lock(pool_mtx);
+      stop_helpers = true;
+    }
+    pool_cv.notify_all();
+    for (auto &t : helpers)
+      t.join();
+  };
+
+  try {
+    for (size_t i = 1; i < num_threads; ++i)
+      helpers.push_back(thread(help, i));
+
+    size_t tot_bytes_read = 0;
+    bool reached_end = false;
+    while (!reached_end) {
+      compressed.clear();
+      blocks.clear();
+      size_t out_size = 0;
+      while (out_size < chunk_size) {
+        unsigned char header[gzip_header_size];
+        const size_t num_read = read_input(header, gzip_header_size);
+        if (num_read == 0) {
+          reached_end = true;
+          break;
+        }
+        if (num_read != gzip_header_size ||
+            !is_gzip_header_with_extra(header))
+          throw runtime_error("malformed BGZF block in file: " + filename);
+
+        const size_t xlen = get_uint16(header + 10);
+        size_t block_size = 0;
+        if (read_input(extra.data(), xlen) != xlen ||
+            !get_bgzf_block_size(extra.data(), xlen, block_size) ||
+            block_size < gzip_header_size + xlen + gzip_footer_size)
+          throw runtime_error("malformed BGZF block in file: " + filename);
+
+        // compressed data followed by the footer
+        const size_t data_size = block_size - gzip_header_size - xlen;
+        const size_t in_pos = compressed.size();
+        compressed.resize(in_pos + data_size);
+        if (read_input(compressed.data() + in_pos, data_size) != data_size)
+          throw runtime_error("truncated BGZF block in file: " + filename);
+
+        // the inflated size is checked before room is made for it, and
+        // inflating must fill it exactly
+        const unsigned char *footer =
+          compressed.data() + in_pos + data_size - gzip_footer_size;
+        Block b;
+        b.in_pos = in_pos;
+        b.in_size = data_size - gzip_footer_size;
+        b.out_pos = out_size;
+        b.out_size = get_uint32(footer + 4);
+        b.crc = get_uint32(footer);
+        if (b.out_size > max_bgzf_block_size)
+          throw runtime_error("malformed BGZF block in file: " + filename);
+        blocks.push_back(b);
+
+        out_size += b.out_size;
+        tot_bytes_read += block_size;
+      }
+      if (out_size == 0)
+        continue;
+
+      out = get_free_chunk();
+      out.resize(out_size);
+
+      num_workers = std::min(num_threads, blocks.size());
+      std::fill(begin(corrupt), end(corrupt), false);
+      if (!helpers.empty()) {
+        lock_guard<mutex> lock(pool_mtx);
+        num_helpers_done = 0;
+        ++chunk_number;
+      }
+      pool_cv.notify_all();
+      inflate_blocks(0);
+      if (!helpers.empty()) {
+        unique_lock<mutex> lock(pool_mtx);
+        pool_cv.wait(lock, [&]() {
+          return num_helpers_done == helpers.size();
+        });
+      }
+
+      for (size_t i = 0; i < num_workers; ++i)
+        if (corrupt[i])
+          throw runtime_error("corrupt BGZF block in file: " + filename);
+
+      if (!push_chunk(out, tot_bytes_read))
+        break;
+    }
+  }
+  catch (...) {
+    join_helpers();
+    throw;
+  }
+  join_helpers();
+}
+
+// Queues uncompressed input in chunks as it is read
+void
+GzDecompressor::copy_stream() {
+  size_t tot_bytes_read = 0;
+  for (;;) {
+    vector<char> out = get_free_chunk();
+    out.resize(chunk_size);
+    const size_t num_read = read_input(out.data(), chunk_size);
+    if (ferror(fp))
+      throw runtime_error("error reading file: " + filename);
+    if (num_read == 0)
+      return;
+
+    tot_bytes_read += num_read;
+    out.resize(num_read);
+    if (!push_chunk(out, tot_bytes_read) || num_read < chunk_size)
+      return;
+  }
+}
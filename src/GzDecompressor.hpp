@@ -0,0 +1,113 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef GZDECOMPRESSOR_HPP
+#define GZDECOMPRESSOR_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdio>
+
+/*************************************************************
+ ******************** GZ DECOMPRESSOR ************************
+ *************************************************************/
+// Decompresses a gzip file in a separate thread into a bounded queue of
+// large chunks, so inflating the file and parsing it happen at the same
+// time. Files in BGZF format (blocked gzip, as written by bgzip and
+// samtools) have independent blocks of known size, which are inflated by
+// num_threads threads in parallel. Other files are inflated as a stream.
+// Standard input, which cannot be memory mapped, is also queued in chunks
+// this way when it is not compressed.
+class GzDecompressor {
+ public:
+  GzDecompressor(const std::string &_filename, const size_t _num_threads);
+
+  // Reads standard input, starting with the bytes in _head that were
+  // already taken from it to detect the format. If _compressed is false the
+  // data is queued as it is read, without inflating it
+  GzDecompressor(const std::vector<char> &_head, const bool _compressed,
+                 const size_t _num_threads);
+  ~GzDecompressor();
+
+  // Swaps chunk with the next piece of decompressed data, in file order.
+  // The old content of chunk is reused for later chunks. Returns false when
+  // the file has no more data.
+  bool next_chunk(std::vector<char> &chunk);
+
+  // number of input bytes used to get all chunks returned so far
+  size_t get_compressed_offset() const { return compressed_offset; }
+
+  // whether the file was inflated as BGZF blocks
+  bool is_bgzf() const { return bgzf; }
+
+  // decompressed bytes held at most while reading a file: the queued
+  // chunks, the one being inflated and two in the reader that parses them
+  static size_t max_buffered_bytes();
+
+ private:
+  // decompressed bytes in each chunk
+  static const size_t chunk_size = (1 << 22);
+
+  // chunks decompressed ahead of the parser
+  static const size_t max_queued_chunks = 4;
+
+  // compressed bytes read at a time from streamed gzip files
+  static const size_t input_size = (1 << 20);
+
+  const std::string filename;
+  const size_t num_threads;
+  FILE *fp;
+  bool bgzf;
+  bool compressed;
+
+  // bytes of standard input read before the decompressor was created
+  std::vector<char> head;
+  size_t head_pos;
+  size_t compressed_offset;
+
+  std::thread producer;
+
+  // guards the variables below
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<std::pair<std::vector<char>, size_t> > queue;
+  std::vector<std::vector<char> > free_chunks;
+  bool finished;
+  bool stopped;
+  std::exception_ptr error;
+
+  void run();
+  void inflate_stream();
+  void inflate_bgzf();
+  void copy_stream();
+
+  // same as fread, but returns the bytes in head first
+  size_t read_input(void *buf, const size_t num_bytes);
+
+  // waits for space in the queue and moves chunk into it. Returns false if
+  // the reader was destroyed in the meantime
+  bool push_chunk(std::vector<char> &chunk, const size_t offset);
+
+  // an empty vector with the capacity of a previously used chunk if any
+  std::vector<char> get_free_chunk();
+};
+
+#endif
@@ -18,7 +18,7 @@
 #include <sstream>
 #include <chrono>
 #include <fstream>
-#include <algorithm>
+#include <cctype>
 
 using std::ostringstream;
 using std::string;
@@ -28,22 +28,81 @@ using std::ifstream;
 using std::runtime_error;
 using std::chrono::system_clock;
 using std::min;
+using std::make_pair;
+
+
+// whether the characters between braces are a placeholder name
+static bool
+is_placeholder_name(const string &s, const size_t first, const size_t last) {
+  if (first == last)
+    return false;
+  for (size_t i = first; i < last; ++i)
+    if (!islower(s[i]) && !isdigit(s[i]) && s[i] != '_')
+      return false;
+  return true;
+}
+
+const HtmlMaker::Template &
+HtmlMaker::get_template() {
+  // initialization of function statics is thread safe
+  static const Template the_template = []() {
+    const string &html = FalcoConfig::html_template;
+    Template t;
+    size_t text_start = 0;
+    size_t pos = html.find("{{");
+    while (pos != string::npos) {
+      const size_t name_end = html.find("}}", pos + 2);
+      if (name_end == string::npos)
+        break;
+
+      // braces that are not around a name are part of the text
+      if (!is_placeholder_name(html, pos + 2, name_end)) {
+        pos = html.find("{{", pos + 1);
+        continue;
+      }
 
+      const string placeholder = html.substr(pos, name_end + 2 - pos);
+      auto it = t.placeholder_index.find(placeholder);
+      if (it == end(t.placeholder_index)) {
+        it = t.placeholder_index.insert(
+          make_pair(placeholder, t.placeholders.size())).first;
+        t.placeholders.push_back(placeholder);
+      }
+      t.text.push_back(html.substr(text_start, pos - text_start));
+      t.slots.push_back(it->second);
+
+      text_start = name_end + 2;
+      pos = html.find("{{", text_start);
+    }
+    t.text.push_back(html.substr(text_start));
+    return t;
+  }();
+  return the_template;
+}
 
 void
 HtmlMaker::put_data(const string &placeholder,
-                    const string &data) {
-  auto pos = html_boilerplate.find(placeholder);
+                    const string &_data) {
+  const Template &t = get_template();
+  const auto it = t.placeholder_index.find(placeholder);
   // Placeholder not found
-  if (pos == string::npos) {
+  if (it == end(t.placeholder_index)) {
     throw runtime_error("placeholder not found: " + placeholder);
   }
 
-  // at least one placeholder found
-  while (pos != string::npos) {
-    html_boilerplate.replace(pos, placeholder.size(), data);
-    pos = html_boilerplate.find(placeholder, pos + 1);
+  data[it->second] = _data;
+  has_data[it->second] = true;
+}
+
+void
+HtmlMaker::write(std::ostream &out) const {
+  const Template &t = get_template();
+  for (size_t i = 0; i < t.slots.size(); ++i) {
+    out << t.text[i];
+    const size_t slot = t.slots[i];
+    out << (has_data[slot] ? data[slot] : t.placeholders[slot]);
   }
+  out << t.text.back();
 }
 
 // Comments out html pieces if analyses were skipped
@@ -77,6 +136,8 @@ HtmlMaker::put_file_details(const FalcoConfig &falco_config) {
 }
 
 HtmlMaker::HtmlMaker() {
-  html_boilerplate = FalcoConfig::html_template;
+  const size_t num_placeholders = get_template().placeholders.size();
+  data.resize(num_placeholders);
+  has_data.resize(num_placeholders, false);
 }
 
@@ -17,7 +17,9 @@
 #define HTMLMAKER_HPP
 
 #include <string>
-#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
 
 #include "FalcoConfig.hpp"
 #include "FastqStats.hpp"
@@ -25,9 +27,12 @@
 /*******************************************************/
 /*************** HTML MAKER ****************************/
 /*******************************************************/
+// The report template is split once into the text between placeholders
+// and the placeholders themselves. Each report only stores the data of
+// each placeholder, and the report is written in a single pass over the
+// pieces, so filling it does not search or copy the whole template.
 class HtmlMaker {
 public:
-  std::string html_boilerplate;
   HtmlMaker();
   // Fill data from module
   void put_data(const std::string &placeholder, const std::string &data);
@@ -39,5 +44,29 @@ public:
 
   // Put file details and date
   void put_file_details(const FalcoConfig &falco_config);
+
+  // writes the template with the data of each placeholder. Placeholders
+  // without data are written as they are in the template
+  void write(std::ostream &out) const;
+
+private:
+  struct Template {
+    // text before each placeholder, and after the last one
+    std::vector<std::string> text;
+
+    // index of the placeholder after each piece of text
+    std::vector<size_t> slots;
+
+    // distinct placeholders, including the braces
+    std::vector<std::string> placeholders;
+    std::unordered_map<std::string, size_t> placeholder_index;
+  };
+
+  // FalcoConfig::html_template split into its pieces, built on first use
+  static const Template &get_template();
+
+  // data of each placeholder, in the same order as the template's
+  std::vector<std::string> data;
+  std::vector<bool> has_data;
 };
 #endif
@@ -553,8 +553,8 @@ ModulePerBaseSequenceQuality::module_name = "Per base sequence quality";
 ModulePerBaseSequenceQuality::ModulePerBaseSequenceQuality
 (const FalcoConfig &config):
 Module(ModulePerBaseSequenceQuality::module_name){
-  auto base_lower = config.limits.find("quality_base_lower");
-  auto base_median = config.limits.find("quality_base_median");
+  auto base_lower = config.parsed->limits.find("quality_base_lower");
+  auto base_median = config.parsed->limits.find("quality_base_median");
 
   base_lower_warn = (base_lower->second).find("warn")->second;
   base_lower_error = (base_lower->second).find("error")->second;
@@ -790,7 +790,7 @@ ModulePerTileSequenceQuality::module_name = "Per tile sequence quality";
 ModulePerTileSequenceQuality::
 ModulePerTileSequenceQuality(const FalcoConfig &config) :
 Module(ModulePerTileSequenceQuality::module_name) {
-  auto grade_tile = config.limits.find("tile")->second;
+  auto grade_tile = config.parsed->limits.find("tile")->second;
   grade_warn = grade_tile.find("warn")->second;
   grade_error = grade_tile.find("error")->second;
 }
@@ -798,22 +798,18 @@ Module(ModulePerTileSequenceQuality::module_name) {
 void
 ModulePerTileSequenceQuality::summarize_module(FastqStats &stats) {
   max_read_length = stats.max_read_length;
-  tile_position_quality = stats.tile_position_quality;
-  // First I calculate the number of counts for each position
-  vector<size_t> position_counts(max_read_length, 0);
-
-  for (auto v : stats.tile_position_quality) {
-    for (size_t i = 0; i < v.second.size(); ++i) {
-      position_counts[i] +=
-        stats.tile_position_count.find(v.first)->second[i];
-    }
-  }
+  const size_t num_tiles = stats.tile_names.size();
+  const size_t row_size = stats.tile_row_size;
+  const size_t lim = min(max_read_length, row_size);
 
-  // Now I calculate the sum of all tile qualities in each position
+  // First I calculate the number of counts and the sum of all tile
+  // qualities in each position
+  vector<size_t> position_counts(max_read_length, 0);
   vector<double> mean_in_base(max_read_length, 0.0);
-  for (auto v : tile_position_quality) {
-    for(size_t i = 0; i < v.second.size(); ++i) {
-      mean_in_base[i] += v.second[i];
+  for (size_t t = 0; t < num_tiles; ++t) {
+    for (size_t i = 0; i < lim; ++i) {
+      position_counts[i] += stats.tile_position_count[t*row_size + i];
+      mean_in_base[i] += stats.tile_position_quality[t*row_size + i];
     }
   }
 
@@ -824,18 +820,19 @@ ModulePerTileSequenceQuality::summarize_module(FastqStats &stats) {
     else
       mean_in_base[i] = 0;
 
-  for (auto &v : tile_position_quality) {
-    const size_t lim = v.second.size();
-    for (size_t i = 0; i < lim; ++i) {
-      // transform sum of all qualities in mean
-      const size_t count_at_pos =
-        stats.tile_position_count.find(v.first)->second[i];
-
-      if (count_at_pos > 0)
-        v.second[i] = v.second[i] / count_at_pos;
-
-      // subtract the global mean
-      v.second[i] -= mean_in_base[i];
+  // mean of each tile in each position minus the global mean
+  tile_position_quality.clear();
+  for (size_t t = 0; t < num_tiles; ++t) {
+    vector<double> &v = tile_position_quality[stats.tile_names[t]];
+    v.assign(max_read_length, 0.0);
+    for (size_t i = 0; i < max_read_length; ++i) {
+      if (i < lim) {
+        const size_t count_at_pos = stats.tile_position_count[t*row_size + i];
+        v[i] = stats.tile_position_quality[t*row_size + i];
+        if (count_at_pos > 0)
+          v[i] = v[i] / count_at_pos;
+      }
+      v[i] -= mean_in_base[i];
     }
   }
   // sorts tiles
@@ -964,7 +961,7 @@ Module(ModulePerSequenceQualityScores::module_name) {
   mode_ind = 0;
   offset = 0;
 
-  auto mode_limits = config.limits.find("quality_sequence");
+  auto mode_limits = config.parsed->limits.find("quality_sequence");
   mode_warn = (mode_limits->second).find("warn")->second;
   mode_error = (mode_limits->second).find("error")->second;
 }
@@ -1043,7 +1040,7 @@ ModulePerBaseSequenceContent::module_name = "Per base sequence content";
 ModulePerBaseSequenceContent::
 ModulePerBaseSequenceContent(const FalcoConfig &config) :
 Module(ModulePerBaseSequenceContent::module_name) {
-  auto sequence_limits = config.limits.find("sequence")->second;
+  auto sequence_limits = config.parsed->limits.find("sequence")->second;
   sequence_warn = sequence_limits.find("warn")->second;
   sequence_error = sequence_limits.find("error")->second;
   is_bisulfite = config.is_bisulfite;
@@ -1286,14 +1283,15 @@ ModulePerSequenceGCContent::module_name = "Per sequence GC content";
 ModulePerSequenceGCContent::
 ModulePerSequenceGCContent(const FalcoConfig &config) :
 Module(ModulePerSequenceGCContent::module_name) {
-  auto gc_vars = config.limits.find("gc_sequence")->second;
+  auto gc_vars = config.parsed->limits.find("gc_sequence")->second;
   gc_warn = gc_vars.find("warn")->second;
   gc_error = gc_vars.find("error")->second;
 }
 
 void
 ModulePerSequenceGCContent::summarize_module(FastqStats &stats) {
-  gc_count = stats.gc_count;
+  // the FastQC models are applied once to the count of each cell
+  stats.get_gc_count(gc_count);
   gc_deviation = sum_deviation_from_normal(gc_count,
                                            theoretical_gc_count);
 }
@@ -1362,7 +1360,7 @@ ModulePerBaseNContent::module_name = "Per base N content";
 ModulePerBaseNContent::
 ModulePerBaseNContent(const FalcoConfig &config) :
 Module(ModulePerBaseNContent::module_name) {
-  auto grade_n = config.limits.find("n_content")->second;
+  auto grade_n = config.parsed->limits.find("n_content")->second;
   grade_n_warn = grade_n.find("warn")->second;
   grade_n_error = grade_n.find("error")->second;
   do_group = !config.nogroup;
@@ -1460,7 +1458,7 @@ ModuleSequenceLengthDistribution::module_name = "Sequence Length Distribution";
 ModuleSequenceLengthDistribution::
 ModuleSequenceLengthDistribution(const FalcoConfig &config) :
 Module(ModuleSequenceLengthDistribution::module_name) {
-  auto length_grade = config.limits.find("sequence_length")->second;
+  auto length_grade = config.parsed->limits.find("sequence_length")->second;
   do_grade_error = (length_grade.find("error")->second != 0);
   do_grade_warn = (length_grade.find("warn")->second != 0);
 }
@@ -1582,7 +1580,7 @@ ModuleSequenceDuplicationLevels(const FalcoConfig &config) :
 Module(ModuleSequenceDuplicationLevels::module_name) {
   percentage_deduplicated.fill(0);
   percentage_total.fill(0);
-  auto grade_dup = config.limits.find("duplication")->second;
+  auto grade_dup = config.parsed->limits.find("duplication")->second;
   grade_dup_warn = grade_dup.find("warn")->second;
   grade_dup_error = grade_dup.find("error")->second;
 }
@@ -1594,11 +1592,12 @@ ModuleSequenceDuplicationLevels::summarize_module(FastqStats &stats) {
 
     // Key is frequenccy (r), value is number of times we saw a sequence
     // with that frequency (Nr)
-    for (auto v : stats.sequence_count) {
-      if (counts_by_freq.count(v.second) == 0) {
-        counts_by_freq[v.second] = 0;
+    for (size_t i = 0; i < stats.sequence_count.size(); ++i) {
+      const size_t freq = stats.sequence_count.count(i);
+      if (counts_by_freq.count(freq) == 0) {
+        counts_by_freq[freq] = 0;
       }
-      counts_by_freq[v.second]++;
+      counts_by_freq[freq]++;
     }
 
     // Now we change it to the FastQC corrected extrapolation
@@ -1720,51 +1719,20 @@ const string
 ModuleOverrepresentedSequences::module_name = "Overrepresented sequences";
 ModuleOverrepresentedSequences::
 ModuleOverrepresentedSequences(const FalcoConfig &config) :
-Module(ModuleOverrepresentedSequences::module_name) {
-  contaminants = config.contaminants;
-  auto grade_overrep = config.limits.find("overrepresented")->second;
+Module(ModuleOverrepresentedSequences::module_name),
+contaminants(config.parsed->contaminants),
+contaminant_index(*config.parsed->contaminant_index) {
+  auto grade_overrep = config.parsed->limits.find("overrepresented")->second;
   grade_warn = grade_overrep.find("warn")->second;
   grade_error = grade_overrep.find("error")->second;
 }
 
-// gets the largest suffix of left which is a prefix of right
-// returns 0 if none exist
-size_t
-get_overlap(const string &left, const string &right) {
-  const auto left_st(begin(left));
-  const auto left_end(end(left));
-
-  const auto right_st(begin(right));
-  const auto right_end(end(right));
-
-  size_t best = 0;
-  const auto sz = left.size();
-  for (size_t start = 0; start < sz; ++start) {
-    size_t cur = 0;
-    auto left_it(left_st + start);
-    auto right_it(right_st);
-    for (; (left_it != left_end) && (right_it != right_end) && (*left_it == *right_it);
-        ++left_it, ++right_it, ++cur);
-
-    // does not accept if overlap does not cover a suffix or the
-    // entirety of right
-    cur = (left_it == left_end || right_it == right_end) ? (cur) : 0;
-    best = max(best, cur);
-  }
-  return best;
-}
-
 string
 ModuleOverrepresentedSequences::get_matching_contaminant (const string &seq) {
   size_t best = 0;
-  string ret;
-  for (auto v : contaminants) {
-    const size_t cand = max(get_overlap(v.second, seq), get_overlap(seq, v.second));
-    if (cand > best) {
-      best = cand;
-      ret = v.first;
-    }
-  }
+  const size_t ind = contaminant_index.find_best(seq, best);
+  const string ret =
+    (ind == ContaminantIndex::not_found) ? "" : contaminants[ind].first;
 
   // If any sequence is a match, return the best one
   if (best >= min(ret.size(), seq.size())/2)
@@ -1776,17 +1744,21 @@ void
 ModuleOverrepresentedSequences::summarize_module(FastqStats &stats) {
   // Keep only sequences that pass the input cutoff
   num_reads = stats.num_reads;
-  for (auto it = stats.sequence_count.begin();
-            it != stats.sequence_count.end(); ++it) {
-    if (it->second > num_reads * min_fraction_to_overrepresented) {
-      overrep_sequences.push_back(*it);
+  for (size_t i = 0; i < stats.sequence_count.size(); ++i) {
+    const size_t cnt = stats.sequence_count.count(i);
+    if (cnt > num_reads * min_fraction_to_overrepresented) {
+      overrep_sequences.push_back(
+        make_pair(stats.sequence_count.get_sequence(i), cnt)
+      );
     }
   }
 
-  // Sort strings by frequency
+  // Sort strings by frequency, ties by sequence so the order does not
+  // depend on how the table was filled
   sort(begin(overrep_sequences), end(overrep_sequences),
        [](const pair<string, size_t> &a, const pair<string, size_t> &b){
-         return a.second > b.second;
+         return a.second > b.second ||
+                (a.second == b.second && a.first < b.first);
        });
 }
 
@@ -1852,12 +1824,12 @@ const string
 ModuleAdapterContent::module_name = "Adapter Content";
 ModuleAdapterContent::
 ModuleAdapterContent(const FalcoConfig &config) :
-Module(ModuleAdapterContent::module_name) {
-  // data parsed from config
-  adapter_names = config.adapter_names;
-  adapter_seqs = config.adapter_seqs;
-  adapter_hashes = config.adapter_hashes;
-  shortest_adapter_size = config.shortest_adapter_size;
+Module(ModuleAdapterContent::module_name),
+// data parsed from config
+adapter_names(config.parsed->adapter_names),
+adapter_seqs(config.parsed->adapter_seqs),
+adapter_hashes(config.parsed->adapter_hashes) {
+  shortest_adapter_size = config.parsed->shortest_adapter_size;
 
   // check if they are all the same size
   if (adapter_names.size() != adapter_seqs.size())
@@ -1869,11 +1841,11 @@ Module(ModuleAdapterContent::module_name) {
   num_adapters = adapter_names.size();
 
   // maximum adapter % before pass/warn/fail
-  auto grade_adapter = config.limits.find("adapter")->second;
+  auto grade_adapter = config.parsed->limits.find("adapter")->second;
   grade_warn = grade_adapter.find("warn")->second;
   grade_error = grade_adapter.find("error")->second;
 
-  adapter_size = config.adapter_size;
+  adapter_size = config.parsed->adapter_size;
 }
 
 void
@@ -1911,6 +1883,26 @@ ModuleAdapterContent::summarize_module(FastqStats &stats) {
       }
     }
   }
+
+  // adapters that end past the short read positions keep adding up in the
+  // bin they end in
+  long_adapter_pos_pct.clear();
+  long_bin_positions.clear();
+  if (!adapter_pos_pct.empty()) {
+    const size_t num_long_bins = stats.num_long_bins();
+    for (size_t b = 0; b < num_long_bins; ++b)
+      long_bin_positions.push_back(FastqStats::long_bin_start(b) + 1);
+
+    for (size_t i = 0; i < num_adapters; ++i) {
+      long_adapter_pos_pct.push_back(vector<double>(num_long_bins, 0.0));
+      double pct = adapter_pos_pct[i].back();
+      for (size_t b = 0; b < num_long_bins; ++b) {
+        pct += 100.0*stats.get_long_adapter_count(b, i) /
+               static_cast<double>(stats.num_reads);
+        long_adapter_pos_pct[i][b] = pct;
+      }
+    }
+  }
 }
 
 void
@@ -1926,6 +1918,17 @@ ModuleAdapterContent::make_grade() {
       }
     }
   }
+  for (size_t i = 0; i < long_adapter_pos_pct.size(); ++i) {
+    for (size_t j = 0; j < long_adapter_pos_pct[i].size(); ++j) {
+      if (grade != "fail") {
+        if (long_adapter_pos_pct[i][j] > grade_error) {
+          grade = "fail";
+        } else if (long_adapter_pos_pct[i][j] > grade_warn) {
+          grade = "warn";
+        }
+      }
+    }
+  }
 }
 
 void
@@ -1956,6 +1959,12 @@ ModuleAdapterContent::write_module(ostream &os) {
       os << "\t" << adapter_pos_pct[j].back();
     os << "\n";
   }
+  for (size_t i = 0; i < long_bin_positions.size(); ++i) {
+    os << long_bin_positions[i];
+    for (size_t j = 0; j < num_adapters; ++j)
+      os << "\t" << long_adapter_pos_pct[j][i];
+    os << "\n";
+  }
 }
 
 string
@@ -1986,6 +1995,8 @@ ModuleAdapterContent::make_html_data() {
       data << j+1;
       if (j + 1 < num_bases) data << ",";
     }
+    for (size_t j = 0; j < long_bin_positions.size(); ++j)
+      data << "," << long_bin_positions[j];
     data << "]";
 
     // Y values : cumulative adapter frequency
@@ -2000,6 +2011,8 @@ ModuleAdapterContent::make_html_data() {
       if (j + 1 < num_bases)
         data << ",";
     }
+    for (size_t j = 0; j < long_bin_positions.size(); ++j)
+      data << "," << long_adapter_pos_pct[i][j];
 
     data << "]";
     data << ", type : 'line', ";
@@ -2023,7 +2036,7 @@ const size_t ModuleKmerContent::MAX_KMERS_TO_PLOT;
 ModuleKmerContent::
 ModuleKmerContent(const FalcoConfig &config) :
 Module(ModuleKmerContent::module_name) {
-  auto grade_kmer = config.limits.find("kmer")->second;
+  auto grade_kmer = config.parsed->limits.find("kmer")->second;
   grade_warn = grade_kmer.find("warn")->second;
   grade_error = grade_kmer.find("error")->second;
 }
@@ -2053,14 +2066,18 @@ ModuleKmerContent::summarize_module(FastqStats &stats) {
   double obs_exp_ratio;
   num_seen_kmers = 0;
 
+  // positions past the short read positions are counted in bins
+  const size_t num_long_bins = stats.num_long_bins();
+
   // Here we get the total count of all kmers and the number of observed kmers
   for (size_t kmer = 0; kmer < num_kmers; ++kmer) {
     for (size_t i = kmer_size - 1; i < num_kmer_bases; ++i) {
-      observed_count = stats.kmer_count[
-                          (i << Constants::bit_shift_kmer) | kmer
-                       ];
+      observed_count = stats.get_kmer_count(i, kmer);
       total_kmer_counts[kmer] += observed_count;
     }
+    for (size_t b = 0; b < num_long_bins; ++b)
+      total_kmer_counts[kmer] +=
+        stats.get_kmer_count(FastqStats::SHORT_READ_THRESHOLD + b, kmer);
     if (total_kmer_counts[kmer] > 0) ++num_seen_kmers;
   }
 
@@ -2068,7 +2085,7 @@ ModuleKmerContent::summarize_module(FastqStats &stats) {
   for (size_t kmer = 0; kmer < num_kmers; ++kmer) {
     for (size_t i = kmer_size - 1; i < num_kmer_bases; ++i) {
       observed_count =
-        stats.kmer_count[(i << Constants::bit_shift_kmer) | kmer];
+        stats.get_kmer_count(i, kmer);
 
       expected_count = pos_kmer_count[i] / dividend;
       obs_exp_ratio = (expected_count > 0) ? (observed_count / expected_count) : 0;
@@ -2079,6 +2096,22 @@ ModuleKmerContent::summarize_module(FastqStats &stats) {
       }
     }
 
+    // bins are reported at their first position
+    for (size_t b = 0; b < num_long_bins &&
+                       b < stats.long_pos_kmer_count.size(); ++b) {
+      observed_count =
+        stats.get_kmer_count(FastqStats::SHORT_READ_THRESHOLD + b, kmer);
+
+      expected_count = stats.long_pos_kmer_count[b] / dividend;
+      obs_exp_ratio = (expected_count > 0) ? (observed_count / expected_count) : 0;
+
+      if (obs_exp_ratio > obs_exp_max[kmer]) {
+        obs_exp_max[kmer] = obs_exp_ratio;
+        where_obs_exp_is_max[kmer] =
+          FastqStats::long_bin_start(b) + 1 - kmer_size;
+      }
+    }
+
     if (obs_exp_max[kmer] > MIN_OBS_EXP_TO_REPORT) {
       kmers_to_report.push_back(make_pair(kmer, obs_exp_max[kmer]));
     }
@@ -298,6 +298,7 @@ class ModuleSequenceDuplicationLevels : public Module {
  public:
   static const std::string module_name;
   ModuleSequenceDuplicationLevels(const FalcoConfig &config);
+  double get_total_deduplicated_pct() const {return total_deduplicated_pct;}
   ~ModuleSequenceDuplicationLevels() {}
   void summarize_module(FastqStats &stats);
   void make_grade();
@@ -311,7 +312,8 @@ class ModuleOverrepresentedSequences : public Module {
   std::vector<std::pair<std::string, size_t>> overrep_sequences;
   double grade_warn, grade_error;
   const double min_fraction_to_overrepresented = 0.001;
-  std::vector<std::pair<std::string, std::string> > contaminants;
+  const std::vector<std::pair<std::string, std::string> > &contaminants;
+  const ContaminantIndex &contaminant_index;
 
   // Function to find the matching contaminant within the list
   std::string get_matching_contaminant(const std::string &seq);
@@ -336,14 +338,19 @@ class ModuleAdapterContent : public Module {
    // adapter size to know how many bases to report
    size_t adapter_size;
 
-   // Information from config
-   std::vector<std::string> adapter_names;
-   std::vector<std::string> adapter_seqs;
-   std::vector<size_t> adapter_hashes;
+   // Information from config, shared by all files
+   const std::vector<std::string> &adapter_names;
+   const std::vector<std::string> &adapter_seqs;
+   const std::vector<size_t> &adapter_hashes;
    size_t shortest_adapter_size;
 
    // vector to be reported
    std::vector<std::vector<double>> adapter_pos_pct;
+
+   // the same past FastqStats::SHORT_READ_THRESHOLD, for each bin of
+   // positions the adapters end in, and the first position of each bin
+   std::vector<std::vector<double>> long_adapter_pos_pct;
+   std::vector<size_t> long_bin_positions;
    // minimum percentages for warn/fail
    double grade_warn, grade_error;
 
@@ -0,0 +1,127 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+
+#include "OutputWriter.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+using std::string;
+using std::ofstream;
+using std::runtime_error;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+
+static void
+write_file_now(const string &filename, const string &contents,
+               const string &description) {
+  ofstream out(filename.c_str(), std::ofstream::binary);
+  if (!out.good())
+    throw runtime_error("Failed to create " + description + ": " + filename);
+  out.write(contents.data(), contents.size());
+  out.close();
+  if (!out)
+    throw runtime_error("Failed to write " + description + ": " + filename);
+}
+
+void
+write_output_file(OutputWriter *writer, const string &filename,
+                  string contents, const string &description) {
+  if (writer == NULL)
+    write_file_now(filename, contents, description);
+  else
+    writer->write(filename, std::move(contents), description);
+}
+
+/*******************************************************/
+/*************** OUTPUT WRITER *************************/
+/*******************************************************/
+OutputWriter::OutputWriter() {
+  queued_bytes = 0;
+  writing = false;
+  stopped = false;
+  writer = std::thread(&OutputWriter::run, this);
+}
+
+OutputWriter::~OutputWriter() {
+  {
+    lock_guard<mutex> lock(mtx);
+    stopped = true;
+  }
+  cv.notify_all();
+  writer.join();
+}
+
+void
+OutputWriter::write(const string &filename, string contents,
+                    const string &description) {
+  unique_lock<mutex> lock(mtx);
+  if (error)
+    std::rethrow_exception(error);
+
+  // a file larger than the queue is queued once the queue is empty
+  cv.wait(lock, [&]() {
+    return queue.empty() ||
+           queued_bytes + contents.size() <= max_queued_bytes;
+  });
+  queued_bytes += contents.size();
+  QueuedFile file;
+  file.filename = filename;
+  file.contents = std::move(contents);
+  file.description = description;
+  queue.push_back(std::move(file));
+  cv.notify_all();
+}
+
+void
+OutputWriter::finish() {
+  unique_lock<mutex> lock(mtx);
+  cv.wait(lock, [&]() {return queue.empty() && !writing;});
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// files after one that failed are still written
+void
+OutputWriter::run() {
+  unique_lock<mutex> lock(mtx);
+  for (;;) {
+    cv.wait(lock, [&]() {return stopped || !queue.empty();});
+    if (queue.empty())
+      return;
+
+    QueuedFile file = std::move(queue.front());
+    queue.pop_front();
+    writing = true;
+    lock.unlock();
+    std::exception_ptr file_error;
+    try {
+      write_file_now(file.filename, file.contents, file.description);
+    }
+    catch (...) {
+      file_error = std::current_exception();
+    }
+    lock.lock();
+
+    writing = false;
+    queued_bytes -= file.contents.size();
+    if (file_error && !error)
+      error = file_error;
+    cv.notify_all();
+  }
+}
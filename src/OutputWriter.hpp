@@ -0,0 +1,78 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+
+#ifndef OUTPUTWRITER_HPP
+#define OUTPUTWRITER_HPP
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/*************************************************************
+ ******************** OUTPUT WRITER **************************
+ *************************************************************/
+// Writes output files in a thread of its own, so threads that read inputs
+// hand over their rendered reports and go on to the next file instead of
+// waiting on the file system. Files are written in the order they were
+// queued, and the queue holds at most max_queued_bytes of contents.
+class OutputWriter {
+ public:
+  OutputWriter();
+
+  // writes the files still queued
+  ~OutputWriter();
+
+  // Queues the contents of a file, waiting while the queue is full.
+  // description names the file in errors, like "output HTML report file".
+  // Rethrows the error of a file written before
+  void write(const std::string &filename, std::string contents,
+             const std::string &description);
+
+  // returns once every queued file was written, and throws the first error
+  void finish();
+
+ private:
+  static const size_t max_queued_bytes = (1 << 26);
+
+  struct QueuedFile {
+    std::string filename;
+    std::string contents;
+    std::string description;
+  };
+
+  // guards the variables below
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<QueuedFile> queue;
+  size_t queued_bytes;
+  bool writing;  // whether the writer has a file out of the queue
+  bool stopped;
+  std::exception_ptr error;
+
+  std::thread writer;
+
+  void run();
+};
+
+// Writes the contents of a file, through writer if it is not NULL
+void
+write_output_file(OutputWriter *writer, const std::string &filename,
+                  std::string contents, const std::string &description);
+
+#endif
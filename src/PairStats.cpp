@@ -0,0 +1,133 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "PairStats.hpp"
+
+#include <algorithm>
+
+using std::string;
+using std::ostream;
+
+static inline char
+complement_base(const char c) {
+  switch (c) {
+    case 'A': return 'T';
+    case 'C': return 'G';
+    case 'G': return 'C';
+    case 'T': return 'A';
+  }
+  return 'N';
+}
+
+PairStats::PairStats() {
+  num_pairs = 0;
+  num_pairs_compared = 0;
+  num_length_mismatch = 0;
+  total_length_difference = 0;
+  num_overlapping = 0;
+  num_adapter_read_through = 0;
+}
+
+// offsets are left as soon as their mismatches pass the limit, so most
+// offsets of pairs that do not overlap only compare a few bases
+static bool
+overlap_matches(const char *a, const char *b, const size_t len) {
+  const size_t limit = std::min(PairStats::overlap_diff_limit,
+    (len * PairStats::mismatch_percent_limit) / 100);
+  size_t diff = 0;
+  for (size_t i = 0; i < len; ++i)
+    if (a[i] != b[i] && ++diff > limit)
+      return false;
+  return true;
+}
+
+size_t
+PairStats::find_insert_size(const char *r1, const size_t len1) {
+  const char *r2 = mate2_rc.data();
+  const size_t len2 = mate2_rc.size();
+
+  // mate 2 starts at offset of mate 1, so the insert is larger than mate 1
+  for (size_t offset = 0; offset + min_overlap <= len1; ++offset) {
+    const size_t overlap = std::min(len1 - offset, len2);
+    if (overlap_matches(r1 + offset, r2, overlap))
+      return offset + len2;
+  }
+
+  // mate 2 starts before mate 1, so both mates read past the insert
+  for (size_t offset = 1; offset + min_overlap <= len2; ++offset) {
+    const size_t overlap = std::min(len1, len2 - offset);
+    if (overlap_matches(r1, r2 + offset, overlap))
+      return overlap;
+  }
+  return 0;
+}
+
+void
+PairStats::add_pair(const size_t len1, const char *bases1, const size_t size1,
+                    const size_t len2, const char *bases2,
+                    const size_t size2) {
+  ++num_pairs;
+  ++num_pairs_compared;
+  if (len1 != len2) {
+    ++num_length_mismatch;
+    total_length_difference += (len1 > len2) ? (len1 - len2) : (len2 - len1);
+  }
+
+  if (size1 < min_overlap || size2 < min_overlap)
+    return;
+
+  mate2_rc.resize(size2);
+  for (size_t i = 0; i < size2; ++i)
+    mate2_rc[i] = complement_base(bases2[size2 - 1 - i]);
+
+  const size_t insert_size = find_insert_size(bases1, size1);
+  if (insert_size == 0)
+    return;
+
+  ++num_overlapping;
+  if (insert_size < std::max(len1, len2))
+    ++num_adapter_read_through;
+  if (insert_size_count.size() <= insert_size)
+    insert_size_count.resize(insert_size + 1, 0);
+  ++insert_size_count[insert_size];
+}
+
+void
+PairStats::write(ostream &os, const string &filename1,
+                 const string &filename2) const {
+  os << ">>Pair Statistics\n";
+  os << "#Measure\tValue\n";
+  os << "Filename R1\t" << filename1 << "\n";
+  os << "Filename R2\t" << filename2 << "\n";
+  os << "Total Pairs\t" << num_pairs << "\n";
+  os << "Pairs Compared\t" << num_pairs_compared << "\n";
+  os << "Pairs with Mates of Different Lengths\t" << num_length_mismatch
+     << "\n";
+  os << "Mean Mate Length Difference\t"
+     << ((num_length_mismatch == 0) ? 0.0 :
+         static_cast<double>(total_length_difference) / num_length_mismatch)
+     << "\n";
+  os << "Overlapping Pairs\t" << num_overlapping << "\n";
+  os << "Pairs with Adapter Read-Through\t" << num_adapter_read_through
+     << "\n";
+  os << ">>END_MODULE\n";
+
+  os << ">>Insert Size Distribution\n";
+  os << "#Insert Size\tCount\n";
+  for (size_t i = 0; i < insert_size_count.size(); ++i)
+    if (insert_size_count[i] > 0)
+      os << i << "\t" << insert_size_count[i] << "\n";
+  os << ">>END_MODULE\n";
+}
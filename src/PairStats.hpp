@@ -0,0 +1,72 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef PAIRSTATS_HPP
+#define PAIRSTATS_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+/*************************************************************
+ ******************** PAIR STATS *****************************
+ *************************************************************/
+// Metrics of paired-end reads that need both mates at once, counted while
+// the two mates are read in lockstep. Mates overlap when the start of the
+// reverse complement of mate 2 matches mate 1 at some offset, which gives
+// the size of the insert. If mate 2 starts before mate 1, the insert is
+// shorter than the reads, which then run into the adapters.
+class PairStats {
+ public:
+  // overlaps must cover this many bases, and mismatch in at most
+  // overlap_diff_limit of them, or mismatch_percent_limit percent
+  static const size_t min_overlap = 30;
+  static const size_t overlap_diff_limit = 5;
+  static const size_t mismatch_percent_limit = 20;
+
+  size_t num_pairs;
+  size_t num_pairs_compared;
+  size_t num_length_mismatch;
+  size_t total_length_difference;
+  size_t num_overlapping;
+  size_t num_adapter_read_through;
+
+  // number of overlapping pairs with each insert size
+  std::vector<size_t> insert_size_count;
+
+  PairStats();
+
+  // counts a pair of mates whose full lengths are len1 and len2, of which
+  // the first size1 and size2 bases are given
+  void add_pair(const size_t len1, const char *bases1, const size_t size1,
+                const size_t len2, const char *bases2, const size_t size2);
+
+  // counts a pair that was skipped by subsampling
+  void add_skipped_pair() { ++num_pairs; }
+
+  // the metrics in the format of the FastQC data text file
+  void write(std::ostream &os, const std::string &filename1,
+             const std::string &filename2) const;
+
+ private:
+  // reverse complement of mate 2 of the last pair
+  std::string mate2_rc;
+
+  // insert size of the overlap of r1 with the reverse complement of r2,
+  // or zero if they do not overlap
+  size_t find_insert_size(const char *r1, const size_t len1);
+};
+
+#endif
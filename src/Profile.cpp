@@ -0,0 +1,162 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "Profile.hpp"
+
+#include <iomanip>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+using std::string;
+using std::ostream;
+
+typedef std::chrono::steady_clock steady_clock;
+
+/*******************************************************/
+/*************** READER PROFILE ************************/
+/*******************************************************/
+ReaderProfile::ReaderProfile() {
+  num_table_lookups = 0;
+  sampled_table_seconds = 0.0;
+  input_wait_seconds = 0.0;
+  bytes_decompressed = 0;
+}
+
+void
+ReaderProfile::merge(const ReaderProfile &other) {
+  num_table_lookups += other.num_table_lookups;
+  sampled_table_seconds += other.sampled_table_seconds;
+  input_wait_seconds += other.input_wait_seconds;
+  bytes_decompressed += other.bytes_decompressed;
+}
+
+double
+ReaderProfile::table_seconds() const {
+  return sampled_table_seconds * table_sample_step;
+}
+
+/*******************************************************/
+/*************** FILE PROFILE **************************/
+/*******************************************************/
+FileProfile::FileProfile(const string &_filename) : filename(_filename) {}
+
+void
+FileProfile::add(const string &section, const string &key,
+                 const double value) {
+  auto sec = begin(sections);
+  while (sec != end(sections) && sec->first != section)
+    ++sec;
+  if (sec == end(sections)) {
+    sections.push_back(std::make_pair(section, Section()));
+    sec = end(sections) - 1;
+  }
+
+  for (auto &entry : sec->second)
+    if (entry.first == key) {
+      entry.second += value;
+      return;
+    }
+  sec->second.push_back(std::make_pair(key, value));
+}
+
+void
+write_json_string(ostream &out, const string &s) {
+  out << '"';
+  for (const char c : s) {
+    if (c == '"' || c == '\\')
+      out << '\\' << c;
+    else if (c == '\n')
+      out << "\\n";
+    else if (c == '\t')
+      out << "\\t";
+    else if (static_cast<unsigned char>(c) < 0x20)
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<int>(c) << std::dec << std::setfill(' ');
+    else
+      out << c;
+  }
+  out << '"';
+}
+
+void
+FileProfile::write_json(ostream &out) const {
+  const std::ios::fmtflags flags = out.flags();
+  const std::streamsize precision = out.precision();
+  out << std::setprecision(12);
+
+  out << "{\n  \"filename\": ";
+  write_json_string(out, filename);
+  for (auto &sec : sections) {
+    out << ",\n  ";
+    write_json_string(out, sec.first);
+    out << ": {";
+    for (size_t i = 0; i < sec.second.size(); ++i) {
+      out << (i == 0 ? "\n    " : ",\n    ");
+      write_json_string(out, sec.second[i].first);
+      out << ": " << sec.second[i].second;
+    }
+    out << "\n  }";
+  }
+  out << "\n}\n";
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+ProfileTimer::ProfileTimer(FileProfile *_profile, const string &_section,
+                           const string &_key) :
+  profile(_profile), section(_section), key(_key) {
+  if (profile != NULL)
+    start = steady_clock::now();
+}
+
+void
+ProfileTimer::stop() {
+  if (profile == NULL)
+    return;
+  profile->add(section, key, std::chrono::duration<double>(
+    steady_clock::now() - start).count());
+  profile = NULL;
+}
+
+ProfileTimer::~ProfileTimer() {
+  stop();
+}
+
+size_t
+get_peak_rss_bytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  // kilobytes on Linux, bytes on macOS
+#ifdef __APPLE__
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+size_t
+get_major_page_faults() {
+  struct rusage usage;
+#ifdef RUSAGE_THREAD
+  if (getrusage(RUSAGE_THREAD, &usage) != 0)
+    return 0;
+#else
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#endif
+  return static_cast<size_t>(usage.ru_majflt);
+}
@@ -0,0 +1,103 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <ostream>
+
+/*************************************************************
+ ******************** READER PROFILE *************************
+ *************************************************************/
+// Counters kept by a reader while it parses one file. Timing every record
+// would cost more than some of the stages it measures, so only one in
+// table_sample_step lookups of the duplication table is timed and the
+// total is extrapolated from them.
+struct ReaderProfile {
+  static const size_t table_sample_step = 64;
+
+  size_t num_table_lookups;
+  double sampled_table_seconds;
+
+  // time spent waiting for decompressed data, and the amount of it
+  double input_wait_seconds;
+  size_t bytes_decompressed;
+
+  ReaderProfile();
+  void merge(const ReaderProfile &other);
+
+  // estimated time of all duplication table lookups
+  double table_seconds() const;
+};
+
+/*************************************************************
+ ******************** FILE PROFILE ***************************
+ *************************************************************/
+// Times and counters of the stages of processing one file, grouped in
+// sections, written as JSON next to its reports with -profile. Values
+// added to the same key are summed, and keys keep the order in which
+// they were first added.
+class FileProfile {
+ public:
+  explicit FileProfile(const std::string &_filename);
+
+  void add(const std::string &section, const std::string &key,
+           const double value);
+
+  ReaderProfile reader;
+
+  // one JSON object with the filename and an object per section
+  void write_json(std::ostream &out) const;
+
+ private:
+  typedef std::vector<std::pair<std::string, double> > Section;
+  std::string filename;
+  std::vector<std::pair<std::string, Section> > sections;
+};
+
+// time from construction until stop or destruction, added to a key of a
+// profile. Nothing is measured if the profile is NULL
+class ProfileTimer {
+ public:
+  ProfileTimer(FileProfile *_profile, const std::string &_section,
+               const std::string &_key);
+  void stop();
+  ~ProfileTimer();
+
+ private:
+  FileProfile *profile;
+  std::string section;
+  std::string key;
+  std::chrono::steady_clock::time_point start;
+};
+
+// writes a string as a quoted JSON string
+void
+write_json_string(std::ostream &out, const std::string &s);
+
+// peak resident memory of the process, in bytes
+size_t
+get_peak_rss_bytes();
+
+// major page faults of the calling thread, which go to disk, or of the
+// whole process if the system does not count them per thread
+size_t
+get_major_page_faults();
+
+#endif
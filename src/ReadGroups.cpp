@@ -0,0 +1,194 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+
+#include "ReadGroups.hpp"
+
+#include <cstring>
+#include <cctype>
+#include <stdexcept>
+
+using std::string;
+using std::unique_ptr;
+using std::runtime_error;
+using std::to_string;
+
+const string ReadGroups::unassigned_name = "unassigned";
+const string ReadGroups::other_name = "other";
+
+static const size_t no_group = static_cast<size_t>(-1);
+
+static inline bool
+is_space(const char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// an index of one or two barcodes, like ACGTAC or ACGTAC+TTGACA
+static bool
+is_index(const char *from, const char *to) {
+  for (; from != to; ++from)
+    if (*from != 'A' && *from != 'C' && *from != 'G' && *from != 'T' &&
+        *from != 'N' && *from != '+')
+      return false;
+  return true;
+}
+
+bool
+ReadGroups::is_valid_key(const string &group_by) {
+  if (group_by == "name")
+    return true;
+  return group_by.size() == 2 && isalpha(group_by[0]) && isalnum(group_by[1]);
+}
+
+ReadGroups::ReadGroups(const string &group_by, const size_t _max_groups) :
+  by_name(group_by == "name"),
+  tag(by_name ? "" : group_by),
+  max_groups(_max_groups) {
+  if (!is_valid_key(group_by))
+    throw runtime_error("reads can be grouped by name or by a SAM tag of "
+                        "two characters, like RG or BC: " + group_by);
+  if (max_groups == 0)
+    throw runtime_error("there must be at least one group of reads");
+  other_group = no_group;
+  unassigned_group = no_group;
+  num_key_groups = 0;
+  used_names.insert(other_name);
+  used_names.insert(unassigned_name);
+}
+
+bool
+ReadGroups::get_name_key(const char *name, const char *name_end,
+                         const char *&key, size_t &len) {
+  const char *word_end = name;
+  for (; word_end != name_end && !is_space(*word_end); ++word_end) {}
+  const char *comment = word_end;
+  for (; comment != name_end && is_space(*comment); ++comment) {}
+  const char *comment_end = comment;
+  for (; comment_end != name_end && !is_space(*comment_end); ++comment_end) {}
+
+  // an Illumina comment is read:filtered:control:index. Other comments
+  // with colons, like the original names of SRA reads, only have an index
+  // at the end if it is made of bases
+  size_t num_colons = 0;
+  const char *colon = comment;
+  for (const char *c = comment; c != comment_end; ++c)
+    if (*c == ':') {
+      ++num_colons;
+      colon = c + 1;
+    }
+  if (num_colons > 0 && colon != comment_end &&
+      (num_colons == 3 || is_index(colon, comment_end))) {
+    key = colon;
+    len = comment_end - colon;
+    return true;
+  }
+
+  const char *hash =
+    static_cast<const char*>(memchr(name, '#', word_end - name));
+  if (hash == NULL)
+    return false;
+  key = hash + 1;
+  const char *key_end = key;
+  for (; key_end != word_end && *key_end != '/'; ++key_end) {}
+  len = key_end - key;
+  return len > 0;
+}
+
+bool
+ReadGroups::get_tag_key(const char *text, const char *text_end,
+                        const char *&key, size_t &len) const {
+  // TAG:TYPE: followed by at least one character of the value
+  for (const char *field = text; field + 5 < text_end; ++field) {
+    if (field[0] == tag[0] && field[1] == tag[1] && field[2] == ':' &&
+        field[4] == ':' && (field == text || is_space(*(field - 1)))) {
+      key = field + 5;
+      const char *key_end = key;
+      for (; key_end != text_end && !is_space(*key_end); ++key_end) {}
+      len = key_end - key;
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t
+ReadGroups::group_of_record(const char *name, const char *name_end,
+                            const char *tags, const char *tags_end) {
+  const char *key = NULL;
+  size_t len = 0;
+  const bool found = by_name ? get_name_key(name, name_end, key, len) :
+                               get_tag_key(tags, tags_end, key, len);
+  if (!found)
+    return group_of_unassigned();
+  return group_of_key(key, len);
+}
+
+size_t
+ReadGroups::group_of_unassigned() {
+  if (unassigned_group == no_group) {
+    unassigned_group = names.size();
+    names.push_back(unassigned_name);
+    stats.push_back(unique_ptr<FastqStats>(new FastqStats));
+  }
+  return unassigned_group;
+}
+
+size_t
+ReadGroups::add_group(const string &name) {
+  // keys like A/C and A_C have the same safe name, so later ones get a
+  // number to keep their files apart
+  string unique_name = file_safe_name(name);
+  for (size_t copy = 2; !used_names.insert(unique_name).second; ++copy)
+    unique_name = file_safe_name(name) + "_" + to_string(copy);
+
+  names.push_back(unique_name);
+  stats.push_back(unique_ptr<FastqStats>(new FastqStats));
+  return names.size() - 1;
+}
+
+size_t
+ReadGroups::group_of_key(const char *key, const size_t len) {
+  lookup_key.assign(key, len);
+  const auto it = index_of_key.find(lookup_key);
+  if (it != end(index_of_key))
+    return it->second;
+
+  // keys past the last group are all counted as other. They are not
+  // added to the index, so keys that are unique to a few reads, like
+  // UMIs, do not grow it
+  if (num_key_groups >= max_groups) {
+    if (other_group == no_group) {
+      other_group = names.size();
+      names.push_back(other_name);
+      stats.push_back(unique_ptr<FastqStats>(new FastqStats));
+    }
+    return other_group;
+  }
+
+  const size_t group = add_group(lookup_key);
+  ++num_key_groups;
+  index_of_key[lookup_key] = group;
+  return group;
+}
+
+string
+ReadGroups::file_safe_name(const string &name) {
+  string ans(name);
+  for (char &c : ans)
+    if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '+' &&
+        c != '.' && c != '_')
+      c = '_';
+  return ans;
+}
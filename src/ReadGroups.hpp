@@ -0,0 +1,111 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+
+#ifndef READGROUPS_HPP
+#define READGROUPS_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "FastqStats.hpp"
+
+/*************************************************************
+ ******************** READ GROUPS ****************************
+ *************************************************************/
+// Stats of each group of reads of one input, like the samples of a
+// multiplexed run, so each group gets its own reports from one pass over
+// the input. Records are grouped by the barcode in their name or by a SAM
+// tag like RG or BC. The stats of a group are allocated when its first
+// record is seen, and their k-mer and duplication tables grow with the
+// reads of the group, so many small groups take little memory.
+class ReadGroups {
+ public:
+  static const std::string unassigned_name;
+  static const std::string other_name;
+
+  // group_by is "name" or a tag of two characters. Records of keys past
+  // the first max_groups are counted in one group named other_name
+  ReadGroups(const std::string &group_by, const size_t _max_groups);
+
+  const bool by_name;
+  const std::string tag;
+  const size_t max_groups;
+
+  // whether group_by is a key records can be grouped by
+  static bool is_valid_key(const std::string &group_by);
+
+  // Group of a record from its name and the text that has its tags, which
+  // in a FASTQ record are both in the name line. Records without a key
+  // are in the group named unassigned_name
+  size_t group_of_record(const char *name, const char *name_end,
+                         const char *tags, const char *tags_end);
+
+  // group of a key taken from the record by the reader, as BAM tags are
+  size_t group_of_key(const char *key, const size_t len);
+
+  // group of records without a key
+  size_t group_of_unassigned();
+
+  size_t size() const {return names.size();}
+
+  // names are unique and only have characters that are safe to use in
+  // the names of output files, so each group has its own files
+  const std::string &get_name(const size_t group) const {return names[group];}
+  FastqStats &get_stats(const size_t group) {return *stats[group];}
+
+ private:
+  std::unordered_map<std::string, size_t> index_of_key;
+  std::vector<std::string> names;
+  std::vector<std::unique_ptr<FastqStats> > stats;
+
+  // names given to groups so far, which start with other_name and
+  // unassigned_name so no key takes the names of those groups
+  std::unordered_set<std::string> used_names;
+
+  // indices of the groups of other_name and unassigned_name, once they
+  // exist
+  size_t other_group;
+  size_t unassigned_group;
+
+  // number of groups of keys, which excludes other and unassigned
+  size_t num_key_groups;
+
+  // the key being looked up, kept so lookups do not allocate
+  std::string lookup_key;
+
+  // the barcode of a read name, which Illumina writes as the last of the
+  // four fields of the comment ("@name 1:N:0:ACGT+TTGA") and older
+  // pipelines after a # in the name ("@name#ACGT/1"). Other comments only
+  // have a barcode if their last field is made of bases
+  static bool get_name_key(const char *name, const char *name_end,
+                           const char *&key, size_t &len);
+
+  // the value of the tag in text made of whitespace-separated TAG:TYPE:VALUE
+  // fields, as in SAM records and FASTQ comments
+  bool get_tag_key(const char *text, const char *text_end,
+                   const char *&key, size_t &len) const;
+
+  // the key with characters that are unsafe in file names replaced by _
+  static std::string file_safe_name(const std::string &name);
+
+  // adds a group with a name not used by other groups
+  size_t add_group(const std::string &name);
+};
+
+#endif
@@ -0,0 +1,163 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "ResultCache.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+using std::ostringstream;
+using std::runtime_error;
+
+// 64-bit FNV-1a, which is enough to tell inputs and runs apart
+static const uint64_t fnv_offset = 14695981039346656037ull;
+static const uint64_t fnv_prime = 1099511628211ull;
+
+static void
+hash_bytes(uint64_t &h, const char *data, const size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    h ^= static_cast<unsigned char>(data[i]);
+    h *= fnv_prime;
+  }
+}
+
+template <class T> static void
+hash_value(uint64_t &h, const T &v) {
+  hash_bytes(h, reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+static void
+hash_string(uint64_t &h, const string &s) {
+  hash_value(h, static_cast<uint64_t>(s.size()));
+  hash_bytes(h, s.data(), s.size());
+}
+
+// contents of a config file, or nothing if the module that uses it is off
+// and it was not read
+static void
+hash_file(uint64_t &h, const string &filename) {
+  ifstream in(filename, std::ios::binary);
+  ostringstream contents;
+  if (in)
+    contents << in.rdbuf();
+  hash_string(h, filename);
+  hash_string(h, contents.str());
+}
+
+/*******************************************************/
+/*************** RESULT CACHE **************************/
+/*******************************************************/
+ResultCache::ResultCache(const string &_dir, const FalcoConfig &config,
+                         const string &options) : dir(_dir) {
+  struct stat st;
+  if (stat(dir.c_str(), &st) != 0) {
+    if (mkdir(dir.c_str(), S_IRWXU) != 0 && stat(dir.c_str(), &st) != 0)
+      throw runtime_error("failed to create cache directory: " + dir);
+  }
+  else if (!S_ISDIR(st.st_mode))
+    throw runtime_error("cache directory is not a directory: " + dir);
+
+  run_hash = fnv_offset;
+  hash_string(run_hash, FalcoConfig::FalcoVersion);
+  hash_file(run_hash, config.limits_file);
+  hash_file(run_hash, config.adapters_file);
+  hash_file(run_hash, config.contaminants_file);
+  hash_string(run_hash, options);
+}
+
+string
+ResultCache::get_key(const string &filename) const {
+  struct stat st;
+  if (filename == "-" || stat(filename.c_str(), &st) != 0 ||
+      !S_ISREG(st.st_mode))
+    return "";
+
+  const size_t file_size = static_cast<size_t>(st.st_size);
+  uint64_t h = run_hash;
+  hash_value(h, static_cast<uint64_t>(file_size));
+  hash_value(h, static_cast<int64_t>(st.st_mtime));
+
+  // the first and last blocks and evenly spaced ones in between
+  ifstream in(filename, std::ios::binary);
+  if (!in)
+    return "";
+  vector<char> block(sampled_block_size);
+  const size_t last_start =
+    (file_size > sampled_block_size) ? (file_size - sampled_block_size) : 0;
+  for (size_t i = 0; i < num_sampled_blocks; ++i) {
+    const size_t start = (last_start / (num_sampled_blocks - 1)) * i;
+    in.seekg(start);
+    in.read(block.data(), block.size());
+    hash_bytes(h, block.data(), static_cast<size_t>(in.gcount()));
+    in.clear();
+  }
+
+  ostringstream key;
+  key << std::hex << std::setw(16) << std::setfill('0') << h;
+  return key.str();
+}
+
+string
+ResultCache::entry_file(const string &key) const {
+  return dir + "/" + key + ".falco.bin";
+}
+
+bool
+ResultCache::load(const string &key, FastqStats &stats) const {
+  ifstream in(entry_file(key), std::ios::binary);
+  if (!in)
+    return false;
+  // a bad entry must not leave stats half read
+  std::unique_ptr<FastqStats> entry(new FastqStats);
+  try {
+    entry->read_snapshot(in);
+  }
+  catch (const runtime_error &) {
+    return false;
+  }
+  stats = *entry;
+  return true;
+}
+
+void
+ResultCache::store(const string &key, const FastqStats &stats) const {
+  // another thread or process may store the same key at the same time
+  ostringstream tmp;
+  tmp << entry_file(key) << ".tmp." << getpid() << "."
+      << std::hash<std::thread::id>()(std::this_thread::get_id());
+  {
+    ofstream out(tmp.str(), std::ios::binary);
+    if (!out)
+      throw runtime_error("failed to write cache entry: " + tmp.str());
+    stats.write_snapshot(out);
+  }
+  if (std::rename(tmp.str().c_str(), entry_file(key).c_str()) != 0) {
+    std::remove(tmp.str().c_str());
+    throw runtime_error("failed to write cache entry: " + entry_file(key));
+  }
+}
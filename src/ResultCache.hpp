@@ -0,0 +1,65 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef RESULTCACHE_HPP
+#define RESULTCACHE_HPP
+
+#include <string>
+#include <cstdint>
+
+#include "FalcoConfig.hpp"
+#include "FastqStats.hpp"
+
+/*************************************************************
+ ******************** RESULT CACHE ***************************
+ *************************************************************/
+// Stats snapshots of inputs that were read before, so reports of a file
+// that did not change are rendered again without reading it. An input is
+// identified by its size, modification time and a hash of evenly spaced
+// blocks of its bytes, and the run by the falco version, the contents of
+// the limits, adapters and contaminants files and the options that change
+// how reads are counted. Entries are snapshot files named by the hash of
+// all of these, so any change is a miss rather than a stale hit.
+class ResultCache {
+ public:
+  // options are the values of the options that change counting, which
+  // are part of the key of every input. The config files must be read
+  ResultCache(const std::string &_dir, const FalcoConfig &config,
+              const std::string &options);
+
+  // the key of an input, or empty if it cannot be cached, like standard
+  // input
+  std::string get_key(const std::string &filename) const;
+
+  // stats stored for a key, which are not summarized. Entries that cannot
+  // be read are misses
+  bool load(const std::string &key, FastqStats &stats) const;
+
+  // stores the stats of a key, before they are summarized. Entries are
+  // written to a temporary file and renamed, so readers never see half an
+  // entry
+  void store(const std::string &key, const FastqStats &stats) const;
+
+  std::string entry_file(const std::string &key) const;
+
+ private:
+  static const size_t num_sampled_blocks = 16;
+  static const size_t sampled_block_size = (1 << 16);
+
+  const std::string dir;
+  uint64_t run_hash;
+};
+
+#endif
@@ -0,0 +1,243 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+
+#include "RunReport.hpp"
+
+#include <sstream>
+#include <iomanip>
+
+#include "FalcoConfig.hpp"
+#include "Module.hpp"
+#include "OutputWriter.hpp"
+#include "Profile.hpp"
+
+using std::string;
+using std::vector;
+using std::ostream;
+using std::ostringstream;
+using std::lock_guard;
+using std::mutex;
+
+RunReportSample::RunReportSample() {
+  total_sequences = poor_quality = 0;
+  min_read_length = max_read_length = gc_percent = 0;
+  deduplicated_percent = -1.0;
+}
+
+// all modules, in the order of the reports of each file
+static const vector<string> &
+get_module_names() {
+  static const vector<string> names = {
+    ModuleBasicStatistics::module_name,
+    ModulePerBaseSequenceQuality::module_name,
+    ModulePerTileSequenceQuality::module_name,
+    ModulePerSequenceQualityScores::module_name,
+    ModulePerBaseSequenceContent::module_name,
+    ModulePerSequenceGCContent::module_name,
+    ModulePerBaseNContent::module_name,
+    ModuleSequenceLengthDistribution::module_name,
+    ModuleSequenceDuplicationLevels::module_name,
+    ModuleOverrepresentedSequences::module_name,
+    ModuleAdapterContent::module_name,
+    ModuleKmerContent::module_name
+  };
+  return names;
+}
+
+// grade of a module, or empty if it did not run
+static string
+get_grade(const RunReportSample &sample, const string &module_name) {
+  for (const auto &g : sample.grades)
+    if (g.first == module_name)
+      return g.second;
+  return "";
+}
+
+static string
+escape_html(const string &s) {
+  string ans;
+  for (const char c : s) {
+    switch (c) {
+      case '&': ans += "&amp;"; break;
+      case '<': ans += "&lt;"; break;
+      case '>': ans += "&gt;"; break;
+      case '"': ans += "&quot;"; break;
+      default: ans += c;
+    }
+  }
+  return ans;
+}
+
+static string
+format_percent(const double value) {
+  ostringstream out;
+  out << std::fixed << std::setprecision(2) << value;
+  return out.str();
+}
+
+/*******************************************************/
+/*************** RUN REPORT ****************************/
+/*******************************************************/
+RunReport::RunReport(const vector<string> &filenames) {
+  for (const string &filename : filenames)
+    if (index_of_file.count(filename) == 0) {
+      index_of_file[filename] = samples.size();
+      samples.push_back(RunReportSample());
+    }
+  has_sample.assign(samples.size(), false);
+}
+
+// inputs that were not given, like the merged snapshots, go at the end
+void
+RunReport::add_sample(const RunReportSample &sample) {
+  lock_guard<mutex> lock(mtx);
+  const auto it = index_of_file.find(sample.filename);
+  size_t ind = 0;
+  if (it == end(index_of_file)) {
+    ind = samples.size();
+    index_of_file[sample.filename] = ind;
+    samples.push_back(sample);
+    has_sample.push_back(true);
+  }
+  else {
+    ind = it->second;
+    samples[ind] = sample;
+    has_sample[ind] = true;
+  }
+}
+
+vector<const RunReportSample*>
+RunReport::get_samples() const {
+  vector<const RunReportSample*> ans;
+  for (size_t i = 0; i < samples.size(); ++i)
+    if (has_sample[i])
+      ans.push_back(&samples[i]);
+  return ans;
+}
+
+void
+RunReport::write_tsv(ostream &out) const {
+  lock_guard<mutex> lock(mtx);
+  out << "Filename\tTotal Sequences\tSequences flagged as poor quality\t"
+      << "Min length\tMax length\t%GC\tTotal Deduplicated Percentage";
+  for (const string &name : get_module_names())
+    out << "\t" << name;
+  out << "\n";
+
+  for (const RunReportSample *s : get_samples()) {
+    out << s->filename << "\t" << s->total_sequences << "\t"
+        << s->poor_quality << "\t" << s->min_read_length << "\t"
+        << s->max_read_length << "\t" << s->gc_percent << "\t";
+    if (s->deduplicated_percent >= 0.0)
+      out << format_percent(s->deduplicated_percent);
+    for (const string &name : get_module_names())
+      out << "\t" << get_grade(*s, name);
+    out << "\n";
+  }
+}
+
+void
+RunReport::write_json(ostream &out) const {
+  lock_guard<mutex> lock(mtx);
+  out << "{\n  \"falco_version\": ";
+  write_json_string(out, FalcoConfig::FalcoVersion);
+  out << ",\n  \"samples\": [";
+  const vector<const RunReportSample*> rows = get_samples();
+  for (size_t i = 0; i < rows.size(); ++i) {
+    const RunReportSample &s = *rows[i];
+    out << (i == 0 ? "\n    " : ",\n    ") << "{\"filename\": ";
+    write_json_string(out, s.filename);
+    out << ", \"total_sequences\": " << s.total_sequences
+        << ", \"poor_quality\": " << s.poor_quality
+        << ", \"min_length\": " << s.min_read_length
+        << ", \"max_length\": " << s.max_read_length
+        << ", \"gc_percent\": " << s.gc_percent
+        << ", \"total_deduplicated_percentage\": ";
+    if (s.deduplicated_percent >= 0.0)
+      out << format_percent(s.deduplicated_percent);
+    else
+      out << "null";
+    out << ", \"modules\": {";
+    for (size_t j = 0; j < s.grades.size(); ++j) {
+      out << (j == 0 ? "" : ", ");
+      write_json_string(out, s.grades[j].first);
+      out << ": ";
+      write_json_string(out, s.grades[j].second);
+    }
+    out << "}}";
+  }
+  out << (rows.empty() ? "]\n}\n" : "\n  ]\n}\n");
+}
+
+// a table with a row per input and a column per module, whose cells are
+// colored by grade like the icons of the report of each file
+void
+RunReport::write_html(ostream &out) const {
+  lock_guard<mutex> lock(mtx);
+  const vector<const RunReportSample*> rows = get_samples();
+  out << "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n"
+      << "<title>Falco run report</title>\n<style>\n"
+      << "body {font-family: sans-serif; margin: 1em;}\n"
+      << "table {border-collapse: collapse; font-size: 0.85em;}\n"
+      << "th, td {border: 1px solid #ccc; padding: 0.3em 0.5em;}\n"
+      << "th {background: #eee; position: sticky; top: 0;}\n"
+      << "td.num {text-align: right;}\n"
+      << "td.pass {background: #9ed99e;}\n"
+      << "td.warn {background: #f5dd7a;}\n"
+      << "td.fail {background: #f09a9a;}\n"
+      << "</style>\n</head>\n<body>\n"
+      << "<h1>Falco run report</h1>\n<p>" << rows.size()
+      << " inputs, falco " << escape_html(FalcoConfig::FalcoVersion)
+      << "</p>\n<table>\n<tr><th>Filename</th><th>Total Sequences</th>"
+      << "<th>Poor quality</th><th>Length</th><th>%GC</th>"
+      << "<th>Deduplicated %</th>";
+  for (const string &name : get_module_names())
+    out << "<th>" << escape_html(name) << "</th>";
+  out << "</tr>\n";
+
+  for (const RunReportSample *s : rows) {
+    out << "<tr><td>" << escape_html(s->filename) << "</td>"
+        << "<td class=\"num\">" << s->total_sequences << "</td>"
+        << "<td class=\"num\">" << s->poor_quality << "</td>"
+        << "<td class=\"num\">" << s->min_read_length;
+    if (s->max_read_length != s->min_read_length)
+      out << "-" << s->max_read_length;
+    out << "</td><td class=\"num\">" << s->gc_percent << "</td>"
+        << "<td class=\"num\">";
+    if (s->deduplicated_percent >= 0.0)
+      out << format_percent(s->deduplicated_percent);
+    out << "</td>";
+    for (const string &name : get_module_names()) {
+      const string grade = get_grade(*s, name);
+      out << "<td class=\"" << grade << "\">" << grade << "</td>";
+    }
+    out << "</tr>\n";
+  }
+  out << "</table>\n</body>\n</html>\n";
+}
+
+void
+RunReport::write(const string &prefix, OutputWriter *writer) const {
+  ostringstream tsv, json, html;
+  write_tsv(tsv);
+  write_json(json);
+  write_html(html);
+  write_output_file(writer, prefix + ".tsv", tsv.str(), "run report TSV file");
+  write_output_file(writer, prefix + ".json", json.str(),
+                    "run report JSON file");
+  write_output_file(writer, prefix + ".html", html.str(),
+                    "run report HTML file");
+}
@@ -0,0 +1,79 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+
+#ifndef RUNREPORT_HPP
+#define RUNREPORT_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+class OutputWriter;
+
+// The grades and key metrics of one input in the run report
+struct RunReportSample {
+  std::string filename;
+  size_t total_sequences;
+  size_t poor_quality;
+  size_t min_read_length;
+  size_t max_read_length;
+  size_t gc_percent;
+
+  // negative if the duplication module did not run
+  double deduplicated_percent;
+
+  // grade of each module that ran, by module name
+  std::vector<std::pair<std::string, std::string> > grades;
+
+  RunReportSample();
+};
+
+/*************************************************************
+ ******************** RUN REPORT *****************************
+ *************************************************************/
+// One report for all inputs of a run, with a row per input of its module
+// grades and key metrics, written as TSV, JSON and a single HTML page.
+// Inputs are in the order they were given, whatever order they finish in.
+class RunReport {
+ public:
+  explicit RunReport(const std::vector<std::string> &filenames);
+
+  // Adds the row of an input, or replaces the one it had, as when the
+  // reports of a file being followed are refreshed. Safe to call from the
+  // threads that read inputs
+  void add_sample(const RunReportSample &sample);
+
+  // writes prefix.tsv, prefix.json and prefix.html
+  void write(const std::string &prefix, OutputWriter *writer) const;
+
+  void write_tsv(std::ostream &out) const;
+  void write_json(std::ostream &out) const;
+  void write_html(std::ostream &out) const;
+
+ private:
+  mutable std::mutex mtx;
+  std::unordered_map<std::string, size_t> index_of_file;
+  std::vector<RunReportSample> samples;
+  std::vector<bool> has_sample;
+
+  // the rows of inputs that were added, in order
+  std::vector<const RunReportSample*> get_samples() const;
+};
+
+#endif
@@ -0,0 +1,194 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "SequenceTable.hpp"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+
+static const size_t initial_num_slots = (1 << 10);
+
+// same 2-bit codes as actg_to_2bit, with 4 for anything else
+static inline uint8_t
+base_to_code(const char c) {
+  switch (c) {
+    case 'A': return 0;
+    case 'C': return 1;
+    case 'T': return 2;
+    case 'G': return 3;
+  }
+  return 4;
+}
+
+static inline uint64_t
+mix_hash(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+SequenceTable::SequenceTable() {
+  slots.assign(initial_num_slots, 0);
+  slot_mask = initial_num_slots - 1;
+}
+
+void
+SequenceTable::clear() {
+  entries.clear();
+  counts.clear();
+  packed_arena.clear();
+  raw_arena.clear();
+  slots.assign(initial_num_slots, 0);
+  slot_mask = initial_num_slots - 1;
+}
+
+void
+SequenceTable::make_key(const char *seq, const size_t len, Key &key) {
+  key.seq = seq;
+  key.length = len;
+  key.num_words = 0;
+  key.is_packed = (len <= max_length);
+
+  uint64_t word = 0;
+  for (size_t i = 0; i < len && key.is_packed; ++i) {
+    const uint8_t code = base_to_code(seq[i]);
+    key.is_packed = (code != 4);
+    word = (word << 2) | (code & 3);
+    if ((i & 31) == 31) {
+      key.words[key.num_words++] = word;
+      word = 0;
+    }
+  }
+
+  uint64_t h = len;
+  if (key.is_packed) {
+    if ((len & 31) != 0)
+      key.words[key.num_words++] = word;
+    for (size_t i = 0; i < key.num_words; ++i)
+      h = mix_hash(h ^ key.words[i]);
+  }
+  else {
+    for (size_t i = 0; i < len; ++i)
+      h = (h ^ static_cast<unsigned char>(seq[i])) * 0x100000001b3ULL;
+  }
+  key.hash = mix_hash(h ^ key.is_packed);
+}
+
+bool
+SequenceTable::matches(const Entry &e, const Key &key) const {
+  if (e.hash != key.hash || e.length != key.length ||
+      e.is_packed != key.is_packed)
+    return false;
+  if (e.is_packed)
+    return memcmp(packed_arena.data() + e.offset, key.words,
+                  key.num_words * sizeof(uint64_t)) == 0;
+  return memcmp(raw_arena.data() + e.offset, key.seq, key.length) == 0;
+}
+
+size_t
+SequenceTable::probe(const Key &key) const {
+  size_t slot = key.hash & slot_mask;
+  for (; slots[slot] != 0; slot = (slot + 1) & slot_mask)
+    if (matches(entries[slots[slot] - 1], key))
+      return slot;
+  return slot;
+}
+
+size_t
+SequenceTable::find(const char *seq, const size_t len) const {
+  Key key;
+  make_key(seq, len, key);
+  const size_t slot = probe(key);
+  return (slots[slot] == 0) ? not_found : (slots[slot] - 1);
+}
+
+size_t
+SequenceTable::find_or_add(const char *seq, const size_t len,
+                           const bool can_add, bool &is_new) {
+  Key key;
+  make_key(seq, len, key);
+  const size_t slot = probe(key);
+  is_new = (slots[slot] == 0);
+  if (!is_new)
+    return slots[slot] - 1;
+  if (!can_add)
+    return not_found;
+
+  if (len > std::numeric_limits<uint16_t>::max())
+    throw runtime_error("sequence too long to count duplication");
+
+  Entry e;
+  e.hash = key.hash;
+  e.length = len;
+  e.is_packed = key.is_packed;
+  if (key.is_packed) {
+    e.offset = packed_arena.size();
+    packed_arena.insert(end(packed_arena), key.words,
+                        key.words + key.num_words);
+  }
+  else {
+    e.offset = raw_arena.size();
+    raw_arena.insert(end(raw_arena), seq, seq + len);
+  }
+
+  const size_t ind = entries.size();
+  entries.push_back(e);
+  counts.push_back(0);
+  slots[slot] = ind + 1;
+
+  // keep the table at most half full
+  if (2 * entries.size() > slots.size())
+    grow();
+  return ind;
+}
+
+void
+SequenceTable::grow() {
+  slots.assign(2 * slots.size(), 0);
+  slot_mask = slots.size() - 1;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    size_t slot = entries[i].hash & slot_mask;
+    for (; slots[slot] != 0; slot = (slot + 1) & slot_mask) {}
+    slots[slot] = i + 1;
+  }
+}
+
+string
+SequenceTable::get_sequence(const size_t ind) const {
+  static const char code_to_base[] = {'A', 'C', 'T', 'G'};
+  const Entry &e = entries[ind];
+  if (!e.is_packed)
+    return string(raw_arena.data() + e.offset, e.length);
+
+  string ans(e.length, 'N');
+  const uint64_t *words = packed_arena.data() + e.offset;
+  for (size_t i = 0; i < e.length; ++i) {
+    // bases of the last, partially filled word are in its lowest bits
+    const size_t word = i / 32;
+    const size_t bases_in_word =
+      (word + 1) * 32 <= e.length ? 32 : (e.length - word * 32);
+    const size_t shift = 2 * (bases_in_word - 1 - (i & 31));
+    ans[i] = code_to_base[(words[word] >> shift) & 3];
+  }
+  return ans;
+}
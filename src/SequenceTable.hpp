@@ -0,0 +1,96 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef SEQUENCETABLE_HPP
+#define SEQUENCETABLE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*************************************************************
+ ******************** SEQUENCE TABLE *************************
+ *************************************************************/
+// Counts of the sequences used for duplication and overrepresented
+// sequences. Sequences made only of A, C, G and T are packed two bits per
+// base in an arena of 64-bit words, and others (usually with Ns) are kept
+// as characters in a second arena. The hash table is open addressing with
+// linear probing over entry indices, so looking up a read takes a single
+// probe sequence and adding it allocates nothing unless an arena grows.
+// Entries are numbered in the order they were added.
+class SequenceTable {
+ public:
+  static const size_t not_found = static_cast<size_t>(-1);
+
+  // longest sequence that can be stored
+  static const size_t max_length = 128;
+
+  SequenceTable();
+
+  // Searches a sequence. If it is not there and can_add is true, it is
+  // added with count zero and is_new is set. Returns the index of the
+  // entry, or not_found if the sequence is new and was not added.
+  size_t find_or_add(const char *seq, const size_t len, const bool can_add,
+                     bool &is_new);
+
+  // index of a sequence or not_found, which never changes the table
+  size_t find(const char *seq, const size_t len) const;
+
+  size_t &count(const size_t ind) { return counts[ind]; }
+  size_t count(const size_t ind) const { return counts[ind]; }
+  std::string get_sequence(const size_t ind) const;
+
+  size_t size() const { return entries.size(); }
+  size_t num_slots() const { return slots.size(); }
+  bool empty() const { return entries.empty(); }
+  void clear();
+
+ private:
+  struct Entry {
+    uint64_t hash;
+    uint32_t offset;  // position of the key in its arena
+    uint16_t length;  // number of bases
+    bool is_packed;
+  };
+
+  // a sequence as it is searched in the table
+  struct Key {
+    uint64_t words[(2 * max_length + 63) / 64];
+    size_t num_words;
+    const char *seq;
+    size_t length;
+    bool is_packed;
+    uint64_t hash;
+  };
+
+  std::vector<Entry> entries;
+  std::vector<size_t> counts;
+  std::vector<uint64_t> packed_arena;
+  std::vector<char> raw_arena;
+
+  // entry index + 1 in each slot, zero if empty
+  std::vector<uint32_t> slots;
+  size_t slot_mask;
+
+  static void make_key(const char *seq, const size_t len, Key &key);
+  bool matches(const Entry &e, const Key &key) const;
+
+  // slot where a key is or where it would be added
+  size_t probe(const Key &key) const;
+
+  void grow();
+};
+
+#endif
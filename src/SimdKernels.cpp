@@ -0,0 +1,337 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "SimdKernels.hpp"
+
+#include <limits>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD_KERNELS_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SIMD_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+static const char tab_char = 9;
+static const char max_char = std::numeric_limits<char>::max();
+
+/*******************************************************/
+/*************** SCALAR ********************************/
+/*******************************************************/
+void
+encode_bases_scalar(const char *seq, const size_t len, uint8_t *codes) {
+  for (size_t i = 0; i < len; ++i)
+    codes[i] = encode_base(seq[i]);
+}
+
+size_t
+count_gc_scalar(const uint8_t *codes, const size_t len) {
+  size_t ans = 0;
+  for (size_t i = 0; i < len; ++i)
+    ans += (codes[i] & 1);
+  return ans;
+}
+
+void
+summarize_quality_scalar(const char *qual, const size_t len,
+                         char &lowest, int64_t &sum) {
+  for (size_t i = 0; i < len; ++i) {
+    const char c = (qual[i] == tab_char) ? max_char : qual[i];
+    lowest = (c < lowest) ? c : lowest;
+    sum += qual[i];
+  }
+}
+
+#ifdef SIMD_KERNELS_X86
+/*******************************************************/
+/*************** SSE2 **********************************/
+/*******************************************************/
+// Bytes are compared as signed by flipping their top bit and comparing them
+// as unsigned, and summed the same way, subtracting 128 per byte at the end
+
+static void
+encode_bases_sse2(const char *seq, const size_t len, uint8_t *codes) {
+  const __m128i n_base = _mm_set1_epi8('N');
+  const __m128i two_bits = _mm_set1_epi8(3);
+  const __m128i n_code = _mm_set1_epi8(n_base_code);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const __m128i v = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(seq + i));
+    const __m128i is_n = _mm_cmpeq_epi8(v, n_base);
+    const __m128i c = _mm_and_si128(_mm_srli_epi16(v, 1), two_bits);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(codes + i),
+                     _mm_or_si128(_mm_andnot_si128(is_n, c),
+                                  _mm_and_si128(is_n, n_code)));
+  }
+  encode_bases_scalar(seq + i, len - i, codes + i);
+}
+
+static size_t
+count_gc_sse2(const uint8_t *codes, const size_t len) {
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const __m128i v = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(codes + i));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_and_si128(v, one), zero));
+  }
+  return static_cast<size_t>(_mm_cvtsi128_si64(acc)) +
+         static_cast<size_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc))) +
+         count_gc_scalar(codes + i, len - i);
+}
+
+static void
+summarize_quality_sse2(const char *qual, const size_t len,
+                       char &lowest, int64_t &sum) {
+  const __m128i sign = _mm_set1_epi8(static_cast<char>(0x80));
+  const __m128i tab = _mm_set1_epi8(tab_char);
+  const __m128i top = _mm_set1_epi8(max_char);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i low = _mm_set1_epi8(static_cast<char>(0xff));
+  __m128i acc = zero;
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const __m128i v = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(qual + i));
+    const __m128i is_tab = _mm_cmpeq_epi8(v, tab);
+    const __m128i c = _mm_or_si128(_mm_andnot_si128(is_tab, v),
+                                   _mm_and_si128(is_tab, top));
+    low = _mm_min_epu8(low, _mm_xor_si128(c, sign));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_xor_si128(v, sign), zero));
+  }
+
+  if (i != 0) {
+    alignas(16) uint8_t lanes[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), low);
+    uint8_t m = lanes[0];
+    for (size_t j = 1; j < 16; ++j)
+      m = (lanes[j] < m) ? lanes[j] : m;
+    const char block_lowest = static_cast<char>(m ^ 0x80);
+    lowest = (block_lowest < lowest) ? block_lowest : lowest;
+    sum += _mm_cvtsi128_si64(acc) +
+           _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc)) -
+           128 * static_cast<int64_t>(i);
+  }
+  summarize_quality_scalar(qual + i, len - i, lowest, sum);
+}
+
+/*******************************************************/
+/*************** AVX2 **********************************/
+/*******************************************************/
+// Tails shorter than 32 bytes go to the SSE2 kernels, after clearing the
+// upper halves of the registers so the switch between the two is not slow
+__attribute__((target("avx2"))) static void
+encode_bases_avx2(const char *seq, const size_t len, uint8_t *codes) {
+  const __m256i n_base = _mm256_set1_epi8('N');
+  const __m256i two_bits = _mm256_set1_epi8(3);
+  const __m256i n_code = _mm256_set1_epi8(n_base_code);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    const __m256i v = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(seq + i));
+    const __m256i is_n = _mm256_cmpeq_epi8(v, n_base);
+    const __m256i c = _mm256_and_si256(_mm256_srli_epi16(v, 1), two_bits);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(codes + i),
+                        _mm256_blendv_epi8(c, n_code, is_n));
+  }
+  _mm256_zeroupper();
+  encode_bases_sse2(seq + i, len - i, codes + i);
+}
+
+__attribute__((target("avx2"))) static size_t
+count_gc_avx2(const uint8_t *codes, const size_t len) {
+  const __m256i one = _mm256_set1_epi8(1);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc = zero;
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    const __m256i v = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(codes + i));
+    acc = _mm256_add_epi64(acc,
+                           _mm256_sad_epu8(_mm256_and_si256(v, one), zero));
+  }
+  alignas(32) uint64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+  _mm256_zeroupper();
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         count_gc_sse2(codes + i, len - i);
+}
+
+__attribute__((target("avx2"))) static void
+summarize_quality_avx2(const char *qual, const size_t len,
+                       char &lowest, int64_t &sum) {
+  const __m256i sign = _mm256_set1_epi8(static_cast<char>(0x80));
+  const __m256i tab = _mm256_set1_epi8(tab_char);
+  const __m256i top = _mm256_set1_epi8(max_char);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i low = _mm256_set1_epi8(static_cast<char>(0xff));
+  __m256i acc = zero;
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    const __m256i v = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(qual + i));
+    const __m256i c =
+      _mm256_blendv_epi8(v, top, _mm256_cmpeq_epi8(v, tab));
+    low = _mm256_min_epu8(low, _mm256_xor_si256(c, sign));
+    acc = _mm256_add_epi64(acc,
+                           _mm256_sad_epu8(_mm256_xor_si256(v, sign), zero));
+  }
+
+  if (i != 0) {
+    alignas(32) uint8_t lanes[32];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), low);
+    uint8_t m = lanes[0];
+    for (size_t j = 1; j < 32; ++j)
+      m = (lanes[j] < m) ? lanes[j] : m;
+    const char block_lowest = static_cast<char>(m ^ 0x80);
+    lowest = (block_lowest < lowest) ? block_lowest : lowest;
+
+    alignas(32) int64_t sums[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(sums), acc);
+    sum += sums[0] + sums[1] + sums[2] + sums[3] -
+           128 * static_cast<int64_t>(i);
+  }
+  _mm256_zeroupper();
+  summarize_quality_sse2(qual + i, len - i, lowest, sum);
+}
+#endif
+
+#ifdef SIMD_KERNELS_NEON
+/*******************************************************/
+/*************** NEON **********************************/
+/*******************************************************/
+static void
+encode_bases_neon(const char *seq, const size_t len, uint8_t *codes) {
+  const uint8x16_t n_base = vdupq_n_u8('N');
+  const uint8x16_t two_bits = vdupq_n_u8(3);
+  const uint8x16_t n_code = vdupq_n_u8(n_base_code);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const uint8x16_t v =
+      vld1q_u8(reinterpret_cast<const uint8_t*>(seq + i));
+    const uint8x16_t c = vandq_u8(vshrq_n_u8(v, 1), two_bits);
+    vst1q_u8(codes + i, vbslq_u8(vceqq_u8(v, n_base), n_code, c));
+  }
+  encode_bases_scalar(seq + i, len - i, codes + i);
+}
+
+static size_t
+count_gc_neon(const uint8_t *codes, const size_t len) {
+  const uint8x16_t one = vdupq_n_u8(1);
+  size_t ans = 0;
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16)
+    ans += vaddvq_u8(vandq_u8(vld1q_u8(codes + i), one));
+  return ans + count_gc_scalar(codes + i, len - i);
+}
+
+// char is unsigned on most ARM64 systems, so the comparisons and sums
+// follow the signedness of char as the scalar version does
+#ifdef __CHAR_UNSIGNED__
+static void
+summarize_quality_neon(const char *qual, const size_t len,
+                       char &lowest, int64_t &sum) {
+  const uint8x16_t tab = vdupq_n_u8(tab_char);
+  const uint8x16_t top = vdupq_n_u8(max_char);
+  uint8x16_t low = vdupq_n_u8(max_char);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const uint8x16_t v =
+      vld1q_u8(reinterpret_cast<const uint8_t*>(qual + i));
+    low = vminq_u8(low, vbslq_u8(vceqq_u8(v, tab), top, v));
+    sum += vaddlvq_u8(v);
+  }
+  const char block_lowest = static_cast<char>(vminvq_u8(low));
+  lowest = (block_lowest < lowest) ? block_lowest : lowest;
+  summarize_quality_scalar(qual + i, len - i, lowest, sum);
+}
+#else
+static void
+summarize_quality_neon(const char *qual, const size_t len,
+                       char &lowest, int64_t &sum) {
+  const int8x16_t tab = vdupq_n_s8(tab_char);
+  const int8x16_t top = vdupq_n_s8(max_char);
+  int8x16_t low = vdupq_n_s8(max_char);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const int8x16_t v =
+      vld1q_s8(reinterpret_cast<const int8_t*>(qual + i));
+    low = vminq_s8(low, vbslq_s8(vceqq_s8(v, tab), top, v));
+    sum += vaddlvq_s8(v);
+  }
+  const char block_lowest = static_cast<char>(vminvq_s8(low));
+  lowest = (block_lowest < lowest) ? block_lowest : lowest;
+  summarize_quality_scalar(qual + i, len - i, lowest, sum);
+}
+#endif
+#endif
+
+/*******************************************************/
+/*************** DISPATCH ******************************/
+/*******************************************************/
+struct KernelSet {
+  void (*encode_bases)(const char *, const size_t, uint8_t *);
+  size_t (*count_gc)(const uint8_t *, const size_t);
+  void (*summarize_quality)(const char *, const size_t, char &, int64_t &);
+  const char *name;
+};
+
+static KernelSet
+choose_kernels() {
+#if defined(SIMD_KERNELS_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    const KernelSet ans = {encode_bases_avx2, count_gc_avx2,
+                           summarize_quality_avx2, "avx2"};
+    return ans;
+  }
+  const KernelSet ans = {encode_bases_sse2, count_gc_sse2,
+                         summarize_quality_sse2, "sse2"};
+#elif defined(SIMD_KERNELS_NEON)
+  const KernelSet ans = {encode_bases_neon, count_gc_neon,
+                         summarize_quality_neon, "neon"};
+#else
+  const KernelSet ans = {encode_bases_scalar, count_gc_scalar,
+                         summarize_quality_scalar, "scalar"};
+#endif
+  return ans;
+}
+
+static const KernelSet kernels = choose_kernels();
+
+void
+encode_bases(const char *seq, const size_t len, uint8_t *codes) {
+  kernels.encode_bases(seq, len, codes);
+}
+
+size_t
+count_gc(const uint8_t *codes, const size_t len) {
+  return kernels.count_gc(codes, len);
+}
+
+void
+summarize_quality(const char *qual, const size_t len,
+                  char &lowest, int64_t &sum) {
+  kernels.summarize_quality(qual, len, lowest, sum);
+}
+
+const char *
+simd_kernels_name() {
+  return kernels.name;
+}
@@ -0,0 +1,61 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef SIMDKERNELS_HPP
+#define SIMDKERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "aux.hpp"
+
+/*************************************************************
+ ******************** SIMD KERNELS ***************************
+ *************************************************************/
+// Whole-line kernels for the sequence and quality lines of short reads. The
+// best implementation for the CPU (AVX2 or SSE2 on x86-64, NEON on ARM64,
+// plain loops otherwise) is chosen once when the program starts. Histograms
+// indexed by position are not vectorized, only the per-base arithmetic.
+
+// code of N bases, which is never a 2-bit base
+static const uint8_t n_base_code = 4;
+
+// same as actg_to_2bit, except Ns take n_base_code
+static inline uint8_t
+encode_base(const char c) {
+  return (c == 'N') ? n_base_code : actg_to_2bit(c);
+}
+
+// writes the code of each base to codes
+void encode_bases(const char *seq, const size_t len, uint8_t *codes);
+
+// number of C and G in encoded bases
+size_t count_gc(const uint8_t *codes, const size_t len);
+
+// Smallest quality character, ignoring tabs, and sum of the characters.
+// lowest is not changed if len is zero
+void summarize_quality(const char *qual, const size_t len,
+                       char &lowest, int64_t &sum);
+
+// name of the implementation in use
+const char *simd_kernels_name();
+
+// plain loop versions of the kernels, to compare against
+void encode_bases_scalar(const char *seq, const size_t len, uint8_t *codes);
+size_t count_gc_scalar(const uint8_t *codes, const size_t len);
+void summarize_quality_scalar(const char *qual, const size_t len,
+                              char &lowest, int64_t &sum);
+
+#endif
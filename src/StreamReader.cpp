@@ -14,8 +14,12 @@
  */
 
 #include "StreamReader.hpp"
+#include "FastqSplitter.hpp"
+#include "SimdKernels.hpp"
+#include "ReadGroups.hpp"
 #include <vector>
 #include <cstring>
+#include <cerrno>
 #include <algorithm>
 #include <fstream>
 
@@ -33,6 +37,29 @@ template<class T>
 inline T min8(const T a, const T b) {
   return (a < b) ? a : b;
 }
+/****************************************************/
+/***************** READER MODULES *******************/
+/****************************************************/
+size_t
+ReaderModules::from_config(const FalcoConfig &config) {
+  return (config.do_kmer ? kmer : 0) |
+         (config.do_adapter ? adapter : 0) |
+         (config.do_tile ? tile : 0) |
+         (config.do_gc_sequence ? gc_model : 0) |
+         ((config.do_duplication || config.do_overrepresented) ?
+          duplication : 0) |
+         (config.do_sequence_length ? sequence_length : 0) |
+         ((config.do_sequence || config.do_n_content) ? base_content : 0);
+}
+
+size_t
+ReaderModules::pipeline_for(const FalcoConfig &config) {
+  const size_t modules = from_config(config);
+  if (modules == all || modules == no_kmer || modules == quality_only)
+    return modules;
+  return dynamic;
+}
+
 /****************************************************/
 /***************** STREAMREADER *********************/
 /****************************************************/
@@ -42,7 +69,17 @@ get_tile_split_position(FalcoConfig &config) {
   // Count colons to know the formatting pattern
   size_t num_colon = 0;
 
-if (config.is_fastq_gz) {
+  if (config.is_pushed) {
+    const string &name = config.first_pushed_name;
+    for (size_t i = 0; i < name.size(); ++i)
+      num_colon += (name[i] == ':');
+  }
+  else if (config.is_stdin) {
+    const string &text = config.stdin_text;
+    for (size_t i = 0; i < text.size() && text[i] != '\n'; ++i)
+      num_colon += (text[i] == ':');
+  }
+  else if (config.is_fastq_gz) {
     gzFile in = gzopen(filename.c_str(), "rb");
     if (!in) {
       throw std::runtime_error("problem reading input file: " + filename);
@@ -69,7 +106,6 @@ if (config.is_fastq_gz) {
     const auto lim(end(first_line));
     for (auto itr(begin(first_line)); itr != lim; ++itr) {
       num_colon += (*itr == ':');
-      std::cout << config.is_fastq_gz << std::endl;
     }
   }
   // Copied from fastqc
@@ -81,21 +117,6 @@ if (config.is_fastq_gz) {
   return 0; // no tile information on read name
 }
 
-// function to turn a vector into array for adapter hashes and fast lookup
-array<size_t, Constants::max_adapters>
-make_adapters(const vector<size_t> &adapter_hashes) {
-  if (adapter_hashes.size() > Constants::max_adapters)
-    throw runtime_error("Number of adapters is larger than 128, which hinders "
-                        "visualziation and speed of falco. Please keep it to "
-                        "under 128");
-
-  array<size_t, Constants::max_adapters> ans;
-  for (size_t i = 0; i < adapter_hashes.size(); ++i)
-    ans[i] = adapter_hashes[i];
-
-  return ans;
-}
-
 StreamReader::StreamReader(FalcoConfig &config,
                            const size_t _buffer_size,
                            const char _field_separator,
@@ -104,8 +125,6 @@ StreamReader::StreamReader(FalcoConfig &config,
   do_sequence_hash(config.do_duplication || config.do_overrepresented),
   do_kmer(config.do_kmer),
   do_adapter(config.do_adapter),
-  do_adapter_optimized(config.do_adapter_optimized),
-  do_sliding_window(do_adapter_optimized || do_kmer),
   do_n_content(config.do_n_content),
   do_quality_base(config.do_quality_base),
   do_sequence(config.do_sequence),
@@ -113,6 +132,7 @@ StreamReader::StreamReader(FalcoConfig &config,
   do_quality_sequence(config.do_quality_sequence),
   do_tile(config.do_tile),
   do_sequence_length(config.do_sequence_length),
+  do_base_content(config.do_sequence || config.do_n_content),
 
   // Here are the usual stream reader configs
   field_separator(_field_separator),
@@ -123,21 +143,14 @@ StreamReader::StreamReader(FalcoConfig &config,
   tile_ignore(!do_tile || tile_split_point == 0),
 
   // Here are the const adapters
-  do_adapters_slow(config.do_adapter && !config.do_adapter_optimized),
-  adapter_seqs(config.adapter_seqs),
-
-  num_adapters(config.adapter_hashes.size()),
-  adapter_size(config.adapter_size),
-  //for case size == 32 expr (1ull << 64) -1 gives 0.
-  //We need to set mask as all 64 bits 1 => use SIZE_MAX in this case
-  adapter_mask(adapter_size == 32? SIZE_MAX: (1ull << (2*adapter_size)) - 1),
-  adapters(make_adapters(config.adapter_hashes)),
+  adapter_automaton(*config.parsed->adapter_automaton),
   trim_value_3p(config.trim_value_3p),
-  filename(config.filename)
+  filename(config.filename),
+  is_stdin(config.is_stdin)
   {
 
   // Allocates buffer to temporarily store reads
-  buffer = new char[buffer_size];
+  buffer = new char[buffer_size + 1];
   buffer[buffer_size] = '\0';
 
   // duplication init
@@ -145,6 +158,11 @@ StreamReader::StreamReader(FalcoConfig &config,
 
   // Tile init
   tile_cur = 0;
+  tile_row = 0;
+
+  // bins of long read positions
+  long_bin = 0;
+  next_long_bin_start = 0;
 
   // keep track of which reads to do tile
   next_read = 0;
@@ -155,6 +173,72 @@ StreamReader::StreamReader(FalcoConfig &config,
 
   // GS: test
   leftover_ind = 0;
+
+  // sequences are counted directly in the stats
+  sequence_sync = NULL;
+  sync_worker = 0;
+  profile = NULL;
+  keep_bases = false;
+
+  // all reads go to the stats given to read_entry
+  groups = NULL;
+  cur_group = 0;
+
+  // only readers that set it use the short line kernels
+  data_last = NULL;
+  base_codes.resize(buffer_size);
+}
+
+// value of a counter that starts at zero and moves forward by period every
+// time it is reached by a read that is processed. Processed reads are
+// multiples of read_step, so the counter stops if period is not
+static inline size_t
+sampling_counter_at(const size_t read_index, const size_t period,
+                    const size_t read_step) {
+  if (read_index == 0) return 0;
+  if (period % read_step != 0) return period;
+  return ((read_index + period - 1)/period)*period;
+}
+
+void
+StreamReader::skip_to_read(const size_t read_index) {
+  next_read = sampling_counter_at(read_index, read_step, read_step);
+  next_kmer_read = sampling_counter_at(read_index, num_reads_for_kmer,
+                                       read_step);
+  next_tile_read = tile_ignore ? 0 :
+    sampling_counter_at(read_index, num_reads_for_tile, read_step);
+}
+
+StreamReader::GroupSampling::GroupSampling() {
+  next_read = next_tile_read = next_kmer_read = 0;
+  continue_storing_sequences = true;
+}
+
+void
+StreamReader::switch_sampling(const size_t group) {
+  if (group_sampling.empty() || group != cur_group) {
+    if (!group_sampling.empty()) {
+      GroupSampling &prev = group_sampling[cur_group];
+      prev.next_read = next_read;
+      prev.next_tile_read = next_tile_read;
+      prev.next_kmer_read = next_kmer_read;
+      prev.continue_storing_sequences = continue_storing_sequences;
+    }
+    if (group >= group_sampling.size())
+      group_sampling.resize(group + 1);
+    const GroupSampling &next = group_sampling[group];
+    next_read = next.next_read;
+    next_tile_read = next.next_tile_read;
+    next_kmer_read = next.next_kmer_read;
+    continue_storing_sequences = next.continue_storing_sequences;
+    cur_group = group;
+  }
+}
+
+FastqStats &
+StreamReader::switch_to_group(const size_t group) {
+  switch_sampling(group);
+  return groups->get_stats(group);
 }
 
 // Makes sure that any subclass deletes the buffer
@@ -237,7 +321,7 @@ StreamReader::get_tile_value() {
 }
 
 // Gets the tile from the sequence name (if applicable)
-void
+template <size_t Modules> void
 StreamReader::read_tile_line(FastqStats &stats) {
 
   do_tile_read = (do_read && stats.num_reads == next_tile_read);
@@ -247,7 +331,7 @@ StreamReader::read_tile_line(FastqStats &stats) {
   }
   // if there is no tile information in the fastq header, fast
   // forward this line
-  if (tile_ignore) {
+  if (!uses<Modules>(ReaderModules::tile, true) || tile_ignore) {
     read_fast_forward_line();
     return;
   }
@@ -259,14 +343,7 @@ StreamReader::read_tile_line(FastqStats &stats) {
   }
 
   get_tile_value();
-  // allocate vector for tile if it doesn't exist
-  if (stats.tile_position_quality.find(tile_cur) ==
-      end(stats.tile_position_quality)) {
-    stats.tile_position_quality[tile_cur] =
-      vector<double> (stats.max_read_length , 0.0);
-    stats.tile_position_count[tile_cur] =
-      vector<size_t> (stats.max_read_length, 0);
-  }
+  tile_row = stats.get_tile_index(tile_cur);
 }
 
 
@@ -276,79 +353,109 @@ StreamReader::read_tile_line(FastqStats &stats) {
 
 // This is probably the most important function for speed, so it must be really
 // optimized at all times
-void
-StreamReader::process_sequence_base_from_buffer(FastqStats &stats) {
+template <size_t Modules> void
+StreamReader::process_sequence_code(FastqStats &stats, const uint8_t code) {
   // I will count the Ns even if asked to ignore, as checking ifs take time
-  if (base_from_buffer == 'N') {
-    ++stats.n_base_count[read_pos];
+  if (code == n_base_code) {
+    if (uses<Modules>(ReaderModules::base_content, do_base_content))
+      ++stats.n_base_count[read_pos];
     num_bases_after_n = 1;  // start over the current kmer
+    adapter_state = AdapterAutomaton::root;
   }
 
   // ATGC bases
   else {
     // increments basic statistic counts
-    cur_gc_count += (actg_to_2bit(base_from_buffer) & 1);
-    ++stats.base_count[
-      (read_pos << Constants::bit_shift_base) |
-      actg_to_2bit(base_from_buffer)];
+    if (uses<Modules>(ReaderModules::base_content, do_base_content))
+      ++stats.base_count[(read_pos << Constants::bit_shift_base) | code];
 
-    if (do_sliding_window) {
+    if (uses<Modules>(ReaderModules::kmer, do_kmer)) {
       // Update k-mer sequence
-      cur_kmer = ((cur_kmer << Constants::bit_shift_base) |
-                  actg_to_2bit(base_from_buffer));
+      cur_kmer = ((cur_kmer << Constants::bit_shift_base) | code);
 
       // registers k-mer if seen at least k nucleotides since the last n
-      if (do_kmer && do_kmer_read && (num_bases_after_n >= Constants::kmer_size)) {
-
-          ++stats.kmer_count[(read_pos << Constants::bit_shift_kmer)
-                           | (cur_kmer & Constants::kmer_mask)];
+      if (do_kmer_read && (num_bases_after_n == Constants::kmer_size)) {
+          stats.add_kmer(read_pos, cur_kmer & Constants::kmer_mask);
           ++stats.pos_kmer_count[read_pos];
       }
 
-      // GS: slow, need to use fsm
-      if (do_adapter_optimized && (num_bases_after_n == adapter_size)) {
-        cur_kmer &= adapter_mask;
-        for (size_t i = 0; i != num_adapters; ++i) {
-          if (cur_kmer == adapters[i]) {
-            ++stats.pos_adapter_count[(read_pos << Constants::bit_shift_adapter)
-                                    | i];
-          }
-        }
-      }
+      num_bases_after_n += (num_bases_after_n != Constants::kmer_size);
+    }
 
-      num_bases_after_n += (num_bases_after_n != adapter_size);
+    // counts every adapter that ends in this base
+    if (uses<Modules>(ReaderModules::adapter, do_adapter)) {
+      adapter_state = adapter_automaton.next_state(adapter_state, code);
+      if (adapter_automaton.has_matches(adapter_state)) {
+        const uint32_t *lim = adapter_automaton.matches_end(adapter_state);
+        for (const uint32_t *it = adapter_automaton.matches_begin(adapter_state);
+             it != lim; ++it)
+          ++stats.pos_adapter_count[
+            (read_pos << Constants::bit_shift_adapter) | *it];
+      }
     }
   }
 }
 
+template <size_t Modules> void
+StreamReader::process_sequence_base_from_buffer(FastqStats &stats) {
+  const uint8_t code = encode_base(base_from_buffer);
+  cur_gc_count += (code & 1);
+  process_sequence_code<Modules>(stats, code);
+}
+
 // slower version of process_sequence_base_from_buffer that dynamically
-// allocates if base position is not already cached
-void
+// allocates if base position is not already cached. K-mers and adapters
+// are counted in the bin of the position
+template <size_t Modules> void
 StreamReader::process_sequence_base_from_leftover(FastqStats &stats) {
+  if (read_pos == next_long_bin_start) {
+    ++long_bin;
+    next_long_bin_start = FastqStats::long_bin_start(long_bin + 1);
+  }
+
   if (base_from_buffer == 'N') {
-    ++stats.long_n_base_count[leftover_ind];
+    if (uses<Modules>(ReaderModules::base_content, do_base_content))
+      ++stats.long_n_base_count[leftover_ind];
     num_bases_after_n = 1;  // start over the current kmer
+    adapter_state = AdapterAutomaton::root;
   }
 
   // ATGC bases
   else {
     // increments basic statistic counts
-    cur_gc_count += (actg_to_2bit(base_from_buffer) & 1);
-    ++stats.long_base_count[(leftover_ind << Constants::bit_shift_base)
-                          | actg_to_2bit(base_from_buffer)];
+    const uint8_t code = actg_to_2bit(base_from_buffer);
+    cur_gc_count += (code & 1);
+    if (uses<Modules>(ReaderModules::base_content, do_base_content))
+      ++stats.long_base_count[(leftover_ind << Constants::bit_shift_base)
+                          | code];
+
+    if (uses<Modules>(ReaderModules::kmer, do_kmer)) {
+      cur_kmer = ((cur_kmer << Constants::bit_shift_base) | code);
+      if (do_kmer_read && (num_bases_after_n == Constants::kmer_size))
+        stats.add_long_kmer(long_bin, cur_kmer & Constants::kmer_mask);
+      num_bases_after_n += (num_bases_after_n != Constants::kmer_size);
+    }
 
-    // WE WILL NOT DO KMER STATS OUTSIDE OF BUFFER
+    if (uses<Modules>(ReaderModules::adapter, do_adapter)) {
+      adapter_state = adapter_automaton.next_state(adapter_state, code);
+      if (adapter_automaton.has_matches(adapter_state)) {
+        const uint32_t *lim = adapter_automaton.matches_end(adapter_state);
+        for (const uint32_t *it = adapter_automaton.matches_begin(adapter_state);
+             it != lim; ++it)
+          stats.add_long_adapter(long_bin, *it);
+      }
+    }
   }
 }
 
 // Gets statistics after reading the entire sequence line
-void
+template <size_t Modules> void
 StreamReader::postprocess_sequence_line(FastqStats &stats) {
   // Updates basic statistics total GC
   stats.total_gc += cur_gc_count;
 
   // read length frequency histogram
-  if (do_sequence_length) {
+  if (uses<Modules>(ReaderModules::sequence_length, do_sequence_length)) {
     if (still_in_buffer) {
       stats.empty_reads += (read_pos == 0);
       if (read_pos != 0)
@@ -364,7 +471,8 @@ StreamReader::postprocess_sequence_line(FastqStats &stats) {
      (read_pos) : (stats.max_read_length));
 
   // FastQC's gc model summarized, if requested
-  if (do_gc_sequence && read_pos != 0) {
+  if (uses<Modules>(ReaderModules::gc_model, do_gc_sequence) &&
+      read_pos != 0) {
     // If we haven't passed the short base threshold, we use the cached models
     if (still_in_buffer) {
       // if we haven't passed the truncation point, use the current values,
@@ -373,21 +481,64 @@ StreamReader::postprocess_sequence_line(FastqStats &stats) {
         truncated_length = read_pos;
         truncated_gc_count = cur_gc_count;
       }
-      for (const auto &v :
-          stats.gc_models[truncated_length].models[truncated_gc_count]) {
-        stats.gc_count[v.percent] += v.increment;
-      }
+      ++stats.gc_cell_count[
+        FastqStats::gc_cell(truncated_length, truncated_gc_count)];
 
     // if the read length is too large, we just use the discrete percentage
     }
     else {
-      ++stats.gc_count[100 * cur_gc_count / read_pos];
+      ++stats.long_gc_count[100 * cur_gc_count / read_pos];
     }
   }
 }
 
+// length of the line starting at cur_char if it can be read with the whole
+// line kernels: it is in memory up to data_last, fits the buffer and does
+// not need to be trimmed. Returns not_short_line otherwise
+inline size_t
+StreamReader::get_short_line_length() const {
+  if (data_last == NULL)
+    return not_short_line;
+
+  const char *line_end = static_cast<const char*>(
+    memchr(cur_char, field_separator, data_last + 1 - cur_char));
+  const size_t len = line_end - cur_char;
+  if (len > buffer_size || (trim_value_3p != 0 && len > trim_value_3p))
+    return not_short_line;
+  return len;
+}
+
+// Same as the loop in read_sequence_line for a short line. Bases are
+// converted and GC is counted by the SIMD kernels, then the histograms are
+// filled base by base
+template <size_t Modules> void
+StreamReader::read_short_sequence_line(FastqStats &stats, const size_t len) {
+  if (uses<Modules>(ReaderModules::duplication, do_sequence_hash) ||
+      keep_bases)
+    memcpy(buffer, cur_char, len);
+  encode_bases(cur_char, len, base_codes.data());
+  cur_gc_count = count_gc(base_codes.data(), len);
+
+  // GC counts at the last multiple of 100 positions, including that base
+  if (uses<Modules>(ReaderModules::gc_model, do_gc_sequence) && len > 100) {
+    truncated_length = 100*((len - 1)/100);
+    truncated_gc_count = count_gc(base_codes.data(), truncated_length + 1);
+    next_truncation = truncated_length + 100;
+  }
+
+  // nothing else is done base by base if these modules are off
+  if (uses<Modules>(ReaderModules::base_content, do_base_content) ||
+      uses<Modules>(ReaderModules::kmer, do_kmer) ||
+      uses<Modules>(ReaderModules::adapter, do_adapter)) {
+    for (; read_pos < len; ++read_pos)
+      process_sequence_code<Modules>(stats, base_codes[read_pos]);
+  }
+  read_pos = len;
+  cur_char += len;
+}
+
 // Reads the line that has the biological sequence
-void
+template <size_t Modules> void
 StreamReader::read_sequence_line(FastqStats &stats) {
   if (!do_read) {
     read_fast_forward_line();
@@ -398,19 +549,16 @@ StreamReader::read_sequence_line(FastqStats &stats) {
   cur_gc_count = 0;
   truncated_gc_count = 0;
   num_bases_after_n = 1;
+  adapter_state = AdapterAutomaton::root;
   still_in_buffer = true;
   next_truncation = 100;
   do_kmer_read = (stats.num_reads == next_kmer_read);
 
-  if (do_adapters_slow) {
-    const string seq_line_str = cur_char;
-    for (size_t i = 0; i != num_adapters; ++i) {
-      const size_t adapt_index = seq_line_str.find(adapter_seqs[i], 0);
-      if (adapt_index < stats.SHORT_READ_THRESHOLD) {
-        ++stats.pos_adapter_count[((adapt_index + adapter_seqs[i].length() - 1) << Constants::bit_shift_adapter)
-                                  | i];
-      }
-    }
+  const size_t short_len = get_short_line_length();
+  if (short_len != not_short_line) {
+    read_short_sequence_line<Modules>(stats, short_len);
+    postprocess_sequence_line<Modules>(stats);
+    return;
   }
 
   /*********************************************************/
@@ -425,12 +573,14 @@ StreamReader::read_sequence_line(FastqStats &stats) {
     if (read_pos == buffer_size) {
       still_in_buffer = false;
       leftover_ind = 0;
+      long_bin = 0;
+      next_long_bin_start = FastqStats::long_bin_start(1);
     }
 
     // Make sure we have memory space to process new base
     if (!still_in_buffer) {
       if (leftover_ind == stats.num_extra_bases) {
-        stats.allocate_new_base(tile_ignore);
+        stats.allocate_new_bases(leftover_ind + 1);
       }
     }
 
@@ -440,19 +590,20 @@ StreamReader::read_sequence_line(FastqStats &stats) {
     // statistics updated base by base
     // use buffer
     if (still_in_buffer) {
-      process_sequence_base_from_buffer(stats);
+      process_sequence_base_from_buffer<Modules>(stats);
     }
 
     // use dynamic allocation
     else {
-      process_sequence_base_from_leftover(stats);
+      process_sequence_base_from_leftover<Modules>(stats);
 
       // Increase leftover pos if no longer in buffer
       ++leftover_ind;
     }
 
     // Truncate GC counts to multiples of 100
-    if (do_gc_sequence && read_pos == next_truncation) {
+    if (uses<Modules>(ReaderModules::gc_model, do_gc_sequence) &&
+        read_pos == next_truncation) {
       truncated_gc_count = cur_gc_count;
       truncated_length = read_pos;
       next_truncation += 100;
@@ -460,14 +611,26 @@ StreamReader::read_sequence_line(FastqStats &stats) {
   }
 
   // statistics summarized after the read
-  postprocess_sequence_line(stats);
+  postprocess_sequence_line<Modules>(stats);
 }
 
 /*******************************************************/
 /*************** QUALITY PROCESSING ********************/
 /*******************************************************/
+// Adds the current quality to the row of the tile of the read. Rows are
+// made as long as the longest read before each quality line, so they
+// only grow here if the quality line is longer than the sequence
+inline void
+StreamReader::add_tile_quality(FastqStats &stats) {
+  if (read_pos == stats.tile_row_size)
+    stats.grow_tile_rows(read_pos + 1);
+  const size_t ind = tile_row*stats.tile_row_size + read_pos;
+  stats.tile_position_quality[ind] += quality_value;
+  ++stats.tile_position_count[ind];
+}
+
 // Process quality value the fast way from buffer
-void
+template <size_t Modules> void
 StreamReader::process_quality_base_from_buffer(FastqStats &stats) {
   // Average quality in position
   ++stats.position_quality_count[
@@ -475,37 +638,59 @@ StreamReader::process_quality_base_from_buffer(FastqStats &stats) {
   ];
 
   // Tile processing
-  if (!tile_ignore && do_tile_read && tile_cur != 0) {
-    // allocate more base space if necessary
-    if (stats.tile_position_quality[tile_cur].size() == read_pos) {
-      stats.tile_position_quality[tile_cur].push_back(0.0);
-      stats.tile_position_count[tile_cur].push_back(0);
-    }
-    stats.tile_position_quality[tile_cur][read_pos]
-        += quality_value;
-    ++stats.tile_position_count[tile_cur][read_pos];
-  }
+  if (uses<Modules>(ReaderModules::tile, true) && !tile_ignore &&
+      do_tile_read && tile_cur != 0)
+    add_tile_quality(stats);
 }
 
 // Slow version of function above
-void
+template <size_t Modules> void
 StreamReader::process_quality_base_from_leftover(FastqStats &stats) {
   // Average quality in position
   ++stats.long_position_quality_count[
     (leftover_ind << Constants::bit_shift_quality) | quality_value];
 
   // Tile processing
-  if (!tile_ignore) {
-    if (do_tile_read && tile_cur != 0) {
-      stats.tile_position_quality[tile_cur][read_pos]
-        += quality_value;
-      ++stats.tile_position_count[tile_cur][read_pos];
+  if (uses<Modules>(ReaderModules::tile, true) && !tile_ignore &&
+      do_tile_read && tile_cur != 0)
+    add_tile_quality(stats);
+}
+
+// Same as the loop in read_quality_line for a short line, with the lowest
+// character and the quality sum found by the SIMD kernels
+template <size_t Modules> void
+StreamReader::read_short_quality_line(FastqStats &stats, const size_t len) {
+  char lowest = stats.lowest_char;
+  int64_t sum = 0;
+  summarize_quality(cur_char, len, lowest, sum);
+  stats.lowest_char = lowest;
+  cur_quality = static_cast<size_t>(sum) - len*Constants::quality_zero;
+
+  for (; read_pos < len; ++read_pos) {
+    quality_value = cur_char[read_pos] - Constants::quality_zero;
+    ++stats.position_quality_count[
+      (read_pos << Constants::bit_shift_quality) | quality_value
+    ];
+  }
+
+  // Tile processing
+  if (uses<Modules>(ReaderModules::tile, true) && !tile_ignore &&
+      do_tile_read && tile_cur != 0) {
+    stats.reserve_tile_positions(len);
+    double *tile_quality =
+      stats.tile_position_quality.data() + tile_row*stats.tile_row_size;
+    size_t *tile_count =
+      stats.tile_position_count.data() + tile_row*stats.tile_row_size;
+    for (size_t i = 0; i < len; ++i) {
+      tile_quality[i] += cur_char[i] - Constants::quality_zero;
+      ++tile_count[i];
     }
   }
+  cur_char += len;
 }
 
 // Reads the quality line of each base.
-void
+template <size_t Modules> void
 StreamReader::read_quality_line(FastqStats &stats) {
   if (!do_read) {
     read_fast_forward_line_eof();
@@ -515,6 +700,18 @@ StreamReader::read_quality_line(FastqStats &stats) {
   read_pos = 0;
   cur_quality = 0;
   still_in_buffer = true;
+  if (do_tile_read && !tile_ignore)
+    stats.reserve_tile_positions(stats.max_read_length);
+
+  // the short line path only looks for one separator
+  const size_t short_len = (field_separator == line_separator) ?
+    get_short_line_length() : not_short_line;
+  if (short_len != not_short_line) {
+    read_short_quality_line<Modules>(stats, short_len);
+    if (read_pos != 0)
+      ++stats.quality_count[cur_quality / read_pos];
+    return;
+  }
 
   // For quality, we do not look for the separator, but rather for an explicit
   // newline or EOF in case the file does not end with newline or we are getting
@@ -543,12 +740,12 @@ StreamReader::read_quality_line(FastqStats &stats) {
 
     // Fast bases from buffer
     if (still_in_buffer) {
-      process_quality_base_from_buffer(stats);
+      process_quality_base_from_buffer<Modules>(stats);
     }
 
     // Slow bases from dynamic allocation
     else {
-      process_quality_base_from_leftover(stats);
+      process_quality_base_from_leftover<Modules>(stats);
       ++leftover_ind;
     }
 
@@ -576,15 +773,21 @@ get_truncate_point(const size_t read_pos) {
     read_pos : Constants::unique_reads_truncate;
 }
 
-void
-StreamReader::postprocess_fastq_record(FastqStats &stats) {
-  if (do_sequence_hash) {
-    buffer[get_truncate_point(read_pos)] = '\0';
-    sequence_to_hash = string(buffer);
+inline void
+StreamReader::count_sequence(FastqStats &stats) {
+  const size_t len = get_truncate_point(read_pos);
+  if (sequence_sync != NULL)
+    sequence_sync->count(sync_worker, buffer, len, stats);
+  else {
+    bool is_new;
+    const size_t ind = stats.sequence_count.find_or_add(
+      buffer, len, continue_storing_sequences, is_new
+    );
+
     // New sequence found
-    if (stats.sequence_count.count(sequence_to_hash) == 0) {
-      if (continue_storing_sequences) {
-        stats.sequence_count.insert({{sequence_to_hash, 1}});
+    if (is_new) {
+      if (ind != SequenceTable::not_found) {
+        ++stats.sequence_count.count(ind);
         stats.count_at_limit = stats.num_reads;
         ++stats.num_unique_seen;
 
@@ -594,10 +797,27 @@ StreamReader::postprocess_fastq_record(FastqStats &stats) {
       }
     }
     else {
-      ++stats.sequence_count[sequence_to_hash];
+      ++stats.sequence_count.count(ind);
       stats.count_at_limit += continue_storing_sequences;
     }
   }
+}
+
+template <size_t Modules> void
+StreamReader::postprocess_fastq_record(FastqStats &stats) {
+  if (uses<Modules>(ReaderModules::duplication, do_sequence_hash)) {
+    if (profile == NULL)
+      count_sequence(stats);
+    else if (profile->num_table_lookups++ %
+             ReaderProfile::table_sample_step != 0)
+      count_sequence(stats);
+    else {
+      const auto start = std::chrono::steady_clock::now();
+      count_sequence(stats);
+      profile->sampled_table_seconds += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    }
+  }
   // counts tile if applicable
   if (!tile_ignore) {
     if (do_tile_read) {
@@ -632,12 +852,34 @@ get_line_separator(const string &filename) {
   return '\n';
 }
 
+// standard input cannot be reopened, so its first bytes are used instead
+char
+get_line_separator(const FalcoConfig &config) {
+  if (!config.is_stdin)
+    return get_line_separator(config.filename);
+
+  const size_t pos = config.stdin_text.find_first_of("\n\r");
+  return (pos == string::npos) ? '\n' : config.stdin_text[pos];
+}
+
 // Set fastq field_separator as line_separator
 FastqReader::FastqReader(FalcoConfig &_config,
                          const size_t _buffer_size) :
   StreamReader(_config, _buffer_size,
-               get_line_separator(_config.filename), get_line_separator(_config.filename)) {
-  filebuf = new char[RESERVE_SIZE];
+               get_line_separator(_config), get_line_separator(_config)) {
+  filebuf = NULL;
+  last = NULL;
+  map_size = 0;
+  range_start = 0;
+  range_end_read = std::numeric_limits<size_t>::max();
+  file_end = NULL;
+  block_end_char = '\0';
+}
+
+void
+FastqReader::set_range(const size_t start, const size_t end_read) {
+  range_start = start;
+  range_end_read = end_read;
 }
 
 size_t
@@ -653,55 +895,158 @@ get_file_size(const string &filename) {
   return ret;
 }
 
-// Load fastq with zlib
+// Memory maps the fastq file
 size_t
 FastqReader::load() {
-  fileobj = fopen(filename.c_str(), "r");
-  if (fileobj == NULL)
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw runtime_error("Cannot open FASTQ file : " + filename);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
     throw runtime_error("Cannot open FASTQ file : " + filename);
-  return get_file_size(filename);
+  }
+  const size_t file_size = static_cast<size_t>(st.st_size);
+  if (range_start > file_size) {
+    close(fd);
+    throw runtime_error("Cannot seek in FASTQ file : " + filename);
+  }
+
+  // reserve space for the file plus the separator at the end. If the file
+  // size is a multiple of the page size, the separator goes in an extra
+  // anonymous page, otherwise in the zeroed tail of the last file page
+  const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  map_size = ((file_size + page_size) / page_size) * page_size;
+  void *addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    close(fd);
+    throw runtime_error("Cannot map FASTQ file : " + filename);
+  }
+  if (file_size > 0 &&
+      mmap(addr, file_size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(addr, map_size);
+    close(fd);
+    throw runtime_error("Cannot map FASTQ file : " + filename);
+  }
+  close(fd);
+
+  filebuf = static_cast<char*>(addr);
+  last = filebuf + file_size;
+  file_end = last;
+  *last = field_separator;
+  data_last = last;
+
+  // pages are only read once and in order
+  madvise(filebuf, map_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  madvise(filebuf, map_size, MADV_HUGEPAGE);
+#endif
+
+  cur_char = filebuf + range_start;
+  return file_size;
+}
+
+size_t
+FastqReader::load_appended(const bool whole_file) {
+  const size_t start = (filebuf == NULL) ? range_start : (cur_char - filebuf);
+  if (filebuf != NULL) {
+    munmap(filebuf, map_size);
+    filebuf = NULL;
+  }
+  range_start = start;
+  const size_t file_size = load();
+  if (whole_file)
+    return last - cur_char;
+
+  // records are four lines, the last one ending in a newline
+  size_t num_lines = 0;
+  char *complete_end = cur_char;
+  for (char *itr = cur_char; itr < last; ++itr) {
+    itr = static_cast<char*>(memchr(itr, '\n', last - itr));
+    if (itr == NULL)
+      break;
+    if (++num_lines % 4 == 0)
+      complete_end = itr + 1;
+  }
+  if (complete_end < filebuf + file_size) {
+    last = complete_end;
+    *last = field_separator;
+    data_last = last;
+  }
+  return complete_end - cur_char;
+}
+
+void
+FastqReader::set_block(const size_t start, const size_t end) {
+  if (filebuf + end > file_end || start > end)
+    throw runtime_error("Cannot seek in FASTQ file : " + filename);
+
+  if (last != file_end)
+    *last = block_end_char;
+  last = filebuf + end;
+  if (last != file_end) {
+    block_end_char = *last;
+    *last = field_separator;
+  }
+  data_last = last;
+  cur_char = filebuf + start;
+
+  // blocks are not read in file order, so each is read ahead on its own
+  const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t page_start = (start / page_size) * page_size;
+  madvise(filebuf + page_start, end - page_start, MADV_WILLNEED);
 }
 
-// straightforward
 inline bool
 FastqReader::is_eof() {
-  return feof(fileobj);
+  return cur_char >= last;
 }
 
 FastqReader::~FastqReader() {
-  free(filebuf);
-  fclose(fileobj);
+  if (filebuf != NULL)
+    munmap(filebuf, map_size);
 }
 
-// Parses fastq gz by reading line by line into the gzbuf
-bool
-FastqReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
-  cur_char = fgets(filebuf, RESERVE_SIZE, fileobj);
+inline char *
+FastqReader::next_line(char *from) const {
+  char *newline = static_cast<char*>(memchr(from, '\n', last - from));
+  return (newline == NULL) ? last : (newline + 1);
+}
 
-  // need to check here if we did not hit eof
-  if (is_eof())
+// Parses fastq records directly from the mapped file
+template <size_t Modules> bool
+FastqReader::read_entry_with(FastqStats &file_stats, size_t &num_bytes_read) {
+  if (file_stats.num_reads == range_end_read || is_eof())
     return false;
 
-  do_read = (stats.num_reads == next_read);
+  // records of each group are counted in the stats of the group, whose
+  // key is in the name line
+  FastqStats &stats = (groups == NULL) ? file_stats :
+    switch_to_group(groups->group_of_record(cur_char + 1, next_line(cur_char),
+                                            cur_char + 1, next_line(cur_char)));
 
+  do_read = (stats.num_reads == next_read);
 
-  read_tile_line(stats);
-  skip_separator();
+  // lines of reads that are skipped are not parsed at all
+  if (do_read)
+    read_tile_line<Modules>(stats);
+  cur_char = next_line(cur_char);
 
-  cur_char = fgets(filebuf, RESERVE_SIZE, fileobj);
-  read_sequence_line(stats);
-  skip_separator();
+  if (do_read)
+    read_sequence_line<Modules>(stats);
+  cur_char = next_line(cur_char);
 
-  cur_char = fgets(filebuf, RESERVE_SIZE, fileobj);
-  read_fast_forward_line();
-  skip_separator();
+  cur_char = next_line(cur_char);
 
-  cur_char = fgets(filebuf, RESERVE_SIZE, fileobj);
-  read_quality_line(stats);
-  skip_separator();
+  if (do_read)
+    read_quality_line<Modules>(stats);
+  cur_char = next_line(cur_char);
 
   if (do_read)
-    postprocess_fastq_record(stats);
+    postprocess_fastq_record<Modules>(stats);
 
   next_read += do_read*read_step;
 
@@ -710,10 +1055,24 @@ FastqReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
 
   // Returns if file should keep being checked
   if (check_bytes_read(stats.num_reads))
-    num_bytes_read = ftell(fileobj);
-  return (!is_eof() && cur_char != 0);
+    num_bytes_read = cur_char - filebuf;
+  return !is_eof();
 }
 
+bool
+FastqReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
+  return read_entry_with<ReaderModules::dynamic>(stats, num_bytes_read);
+}
+
+template bool
+FastqReader::read_entry_with<ReaderModules::dynamic>(FastqStats&, size_t&);
+template bool
+FastqReader::read_entry_with<ReaderModules::all>(FastqStats&, size_t&);
+template bool
+FastqReader::read_entry_with<ReaderModules::no_kmer>(FastqStats&, size_t&);
+template bool
+FastqReader::read_entry_with<ReaderModules::quality_only>(FastqStats&, size_t&);
+
 /*******************************************************/
 /*************** READ FASTQ GZ RCORD *******************/
 /*******************************************************/
@@ -721,58 +1080,121 @@ FastqReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
 GzFastqReader::GzFastqReader(FalcoConfig &_config,
                              const size_t _buffer_size) :
   StreamReader(_config, _buffer_size, '\n', '\n') {
-  gzbuf = new char[RESERVE_SIZE];
+  decompressor = NULL;
+  num_threads = 1;
+  last = NULL;
+  if (is_stdin) {
+    stdin_head = _config.stdin_head;
+    stdin_compressed = _config.is_fastq_gz;
+  }
+}
+
+void
+GzFastqReader::set_num_threads(const size_t _num_threads) {
+  num_threads = _num_threads;
 }
 
-// Load fastq with zlib
+// Starts decompressing the file in the background. The size of standard
+// input is not known, so it is reported as zero
 size_t
 GzFastqReader::load() {
-  fileobj = gzopen(filename.c_str(), "r");
-  if (fileobj == Z_NULL)
-    throw runtime_error("Cannot open gzip FASTQ file : " + filename);
-
-  return get_file_size(filename);
+  decompressor = is_stdin ?
+    new GzDecompressor(stdin_head, stdin_compressed, num_threads) :
+    new GzDecompressor(filename, num_threads);
+  window.assign(1, '\n');
+  cur_char = last = data_last = window.data();
+  return is_stdin ? 0 : get_file_size(filename);
 }
 
-// straightforward
 inline bool
 GzFastqReader::is_eof() {
-  return gzeof(fileobj);
+  return cur_char >= last;
 }
 
 GzFastqReader::~GzFastqReader() {
-  free(gzbuf);
-  gzclose_r(fileobj);
+  delete decompressor;
+}
+
+inline char *
+GzFastqReader::next_line(char *from) const {
+  char *newline = static_cast<char*>(memchr(from, '\n', last - from));
+  return (newline == NULL) ? last : (newline + 1);
 }
 
-// Parses fastq gz by reading line by line into the gzbuf
 bool
-GzFastqReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
-  cur_char = gzgets(fileobj, gzbuf, RESERVE_SIZE);
+GzFastqReader::fill_record() {
+  static const size_t lines_per_record = 4;
+  size_t num_lines = 0;
+  char *scan = cur_char;
+  for (;;) {
+    for (; num_lines < lines_per_record; ++num_lines) {
+      char *newline = static_cast<char*>(memchr(scan, '\n', last - scan));
+      if (newline == NULL) break;
+      scan = newline + 1;
+    }
+    if (num_lines == lines_per_record)
+      return true;
 
-  // need to check here if we did not hit eof
-  if (is_eof()) {
-    return false;
+    // the record continues in the next chunk, so we keep the part we have
+    const size_t num_left = last - cur_char;
+    const size_t num_scanned = scan - cur_char;
+    if (profile == NULL) {
+      if (!decompressor->next_chunk(chunk))
+        return !is_eof();
+    }
+    else {
+      const auto start = std::chrono::steady_clock::now();
+      const bool got_chunk = decompressor->next_chunk(chunk);
+      profile->input_wait_seconds += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+      if (!got_chunk)
+        return !is_eof();
+      profile->bytes_decompressed += chunk.size();
+    }
+
+    memmove(window.data(), cur_char, num_left);
+    window.resize(num_left + chunk.size() + 1);
+    memcpy(window.data() + num_left, chunk.data(), chunk.size());
+    window.back() = '\n';
+
+    cur_char = window.data();
+    last = cur_char + window.size() - 1;
+    data_last = last;
+    scan = cur_char + num_scanned;
   }
+}
+
+// Parses fastq gz records from the decompressed chunks
+template <size_t Modules> bool
+GzFastqReader::read_entry_with(FastqStats &file_stats,
+                               size_t &num_bytes_read) {
+  if (!fill_record())
+    return false;
+
+  // same as in FastqReader
+  FastqStats &stats = (groups == NULL) ? file_stats :
+    switch_to_group(groups->group_of_record(cur_char + 1, next_line(cur_char),
+                                            cur_char + 1, next_line(cur_char)));
+
   do_read = (stats.num_reads == next_read);
 
-  read_tile_line(stats);
-  skip_separator();
+  // lines of reads that are skipped are not parsed at all
+  if (do_read)
+    read_tile_line<Modules>(stats);
+  cur_char = next_line(cur_char);
 
-  cur_char = gzgets(fileobj, gzbuf, RESERVE_SIZE);
-  read_sequence_line(stats);
-  skip_separator();
+  if (do_read)
+    read_sequence_line<Modules>(stats);
+  cur_char = next_line(cur_char);
 
-  cur_char = gzgets(fileobj, gzbuf, RESERVE_SIZE);
-  read_fast_forward_line();
-  skip_separator();
+  cur_char = next_line(cur_char);
 
-  cur_char = gzgets(fileobj, gzbuf, RESERVE_SIZE);
-  read_quality_line(stats);
-  skip_separator();
+  if (do_read)
+    read_quality_line<Modules>(stats);
+  cur_char = next_line(cur_char);
 
   if (do_read)
-    postprocess_fastq_record(stats);
+    postprocess_fastq_record<Modules>(stats);
 
   next_read += do_read*read_step;
 
@@ -781,10 +1203,24 @@ GzFastqReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
 
   // Returns if file should keep being checked
   if (check_bytes_read(stats.num_reads))
-    num_bytes_read = gzoffset(fileobj);
-  return !is_eof();
+    num_bytes_read = decompressor->get_compressed_offset();
+  return true;
+}
+
+bool
+GzFastqReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
+  return read_entry_with<ReaderModules::dynamic>(stats, num_bytes_read);
 }
 
+template bool
+GzFastqReader::read_entry_with<ReaderModules::dynamic>(FastqStats&, size_t&);
+template bool
+GzFastqReader::read_entry_with<ReaderModules::all>(FastqStats&, size_t&);
+template bool
+GzFastqReader::read_entry_with<ReaderModules::no_kmer>(FastqStats&, size_t&);
+template bool
+GzFastqReader::read_entry_with<ReaderModules::quality_only>(FastqStats&, size_t&);
+
 /*******************************************************/
 /*************** READ SAM RECORD ***********************/
 /*******************************************************/
@@ -792,145 +1228,451 @@ GzFastqReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
 SamReader::SamReader(FalcoConfig &_config,
                      const size_t _buffer_size) :
   StreamReader(_config, _buffer_size,
-               '\t', get_line_separator(_config.filename)) {
-  filebuf = new char[RESERVE_SIZE];
+               '\t', get_line_separator(_config)),
+  line_size(_config.sam_line_size) {
+  fd = -1;
+  head_pos = 0;
+  input_done = false;
+  last = line_end = NULL;
+  window_offset = 0;
+  if (is_stdin)
+    stdin_head = _config.stdin_head;
 }
 
+// header lines are skipped a whole line at a time
 size_t
 SamReader::load() {
-  fileobj = fopen(filename.c_str(), "r");
-  if (fileobj == NULL)
+  fd = is_stdin ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
     throw runtime_error("Cannot open SAM file : " + filename);
+#ifdef POSIX_FADV_SEQUENTIAL
+  if (!is_stdin)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 
-  // skip sam header
-  char first_char_in_line;
-  while (!is_eof() && ((first_char_in_line = fgetc(fileobj)) == '@')) {
-    ungetc(first_char_in_line, fileobj);
-    cur_char = fgets(filebuf, RESERVE_SIZE, fileobj);
-  }
-  return get_file_size(filename);
+  window.assign(block_size + 2, '\n');
+  window[1] = '\t';
+  cur_char = last = data_last = window.data();
+
+  while (fill_line() && *cur_char == '@')
+    cur_char = line_end + 1;
+  return is_stdin ? 0 : get_file_size(filename);
 }
 
 inline bool
 SamReader::is_eof() {
-  return feof(fileobj);
+  return cur_char >= last;
 }
 
-bool
-SamReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
-  cur_char = fgets(filebuf, RESERVE_SIZE, fileobj);
+size_t
+SamReader::read_input(char *to, const size_t max_bytes) {
+  if (head_pos < stdin_head.size()) {
+    const size_t num_bytes = std::min(stdin_head.size() - head_pos, max_bytes);
+    memcpy(to, stdin_head.data() + head_pos, num_bytes);
+    head_pos += num_bytes;
+    return num_bytes;
+  }
 
-  if (is_eof()) return false;
-  do_read = (stats.num_reads == next_read);
+  for (;;) {
+    const ssize_t num_bytes = read(fd, to, max_bytes);
+    if (num_bytes >= 0)
+      return static_cast<size_t>(num_bytes);
+    if (errno != EINTR)
+      throw runtime_error("Cannot read SAM file : " + filename);
+  }
+}
 
-  read_tile_line(stats);
-  skip_separator();
+bool
+SamReader::fill_line() {
+  // past a last line without a newline
+  if (cur_char > last)
+    cur_char = last;
+
+  char *scan = cur_char;
+  for (;;) {
+    line_end = static_cast<char*>(memchr(scan, '\n', last - scan));
+    if (line_end != NULL)
+      return true;
 
-  for (size_t i = 0; i < 8; ++i) {
-    read_fast_forward_line();
-    skip_separator();
+    // the last line may not end in a newline, so it ends at the one past
+    // the data
+    if (input_done) {
+      line_end = last;
+      return cur_char < last;
+    }
+
+    // the line continues in the next block, so we keep the part we have
+    const size_t num_left = last - cur_char;
+    if (num_left >= line_size)
+      throw runtime_error("SAM line longer than " +
+                          std::to_string(line_size >> 20) + " MB in " +
+                          filename);
+    window_offset += cur_char - window.data();
+    memmove(window.data(), cur_char, num_left);
+    if (window.size() < num_left + block_size + 2)
+      window.resize(num_left + block_size + 2);
+
+    const size_t num_read = read_input(window.data() + num_left, block_size);
+    input_done = (num_read == 0);
+    cur_char = window.data();
+    last = cur_char + num_left + num_read;
+    last[0] = '\n';
+    last[1] = '\t';
+    scan = cur_char + num_left;
   }
+}
 
-  // field 10
-  read_sequence_line(stats);
-  skip_separator();
+inline char *
+SamReader::next_field(char *from) const {
+  char *tab = static_cast<char*>(memchr(from, '\t', line_end - from));
+  if (tab == NULL)
+    return NULL;
+  for (++tab; *tab == '\t'; ++tab) {}
+  return tab;
+}
 
-  // field 11
-  read_quality_line(stats);
-  if (do_read)
-    postprocess_fastq_record(stats);
+FastqStats &
+SamReader::group_stats_of_line() {
+  char *name_end = static_cast<char*>(memchr(cur_char, '\t',
+                                             line_end - cur_char));
+  if (name_end == NULL)
+    name_end = line_end;
+  char *tags = cur_char;
+  for (size_t i = 0; i < 11 && tags != NULL; ++i)
+    tags = next_field(tags);
+  if (tags == NULL)
+    tags = line_end;
+  return switch_to_group(groups->group_of_record(cur_char, name_end,
+                                                 tags, line_end));
+}
+
+template <size_t Modules> bool
+SamReader::read_entry_with(FastqStats &file_stats, size_t &num_bytes_read) {
+  if (!fill_line())
+    return false;
+
+  FastqStats &stats = (groups == NULL) ? file_stats : group_stats_of_line();
+
+  do_read = (stats.num_reads == next_read);
+
+  // lines of reads that are skipped are not parsed at all. The sequence is
+  // field 10 and the qualities field 11, after which the tags are skipped
+  if (do_read) {
+    char *line_start = cur_char;
+    char *seq = line_start;
+    for (size_t i = 0; i < 9 && seq != NULL; ++i)
+      seq = next_field(seq);
+    char *qual = (seq == NULL) ? NULL : next_field(seq);
+    if (qual == NULL)
+      throw runtime_error("SAM record with fewer than 11 fields at byte " +
+                          std::to_string(window_offset +
+                                         (line_start - window.data())) +
+                          " of " + filename);
+
+    data_last = line_end;
+    read_tile_line<Modules>(stats);
+    cur_char = seq;
+    read_sequence_line<Modules>(stats);
+    cur_char = qual;
+    read_quality_line<Modules>(stats);
+    postprocess_fastq_record<Modules>(stats);
+  }
+  cur_char = line_end + 1;
 
   next_read += do_read*read_step;
   ++stats.num_reads;
 
-  // skips all tags after quality until newline
-  for (; *cur_char != line_separator && !is_eof(); ++cur_char)
-
   if (check_bytes_read(stats.num_reads))
-    num_bytes_read = ftell(fileobj);
+    num_bytes_read = window_offset + (cur_char - window.data());
+  return true;
+}
 
-  // Returns if file should keep being checked
-  return (!is_eof() && cur_char != 0);
+bool
+SamReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
+  return read_entry_with<ReaderModules::dynamic>(stats, num_bytes_read);
 }
 
+template bool
+SamReader::read_entry_with<ReaderModules::dynamic>(FastqStats&, size_t&);
+template bool
+SamReader::read_entry_with<ReaderModules::all>(FastqStats&, size_t&);
+template bool
+SamReader::read_entry_with<ReaderModules::no_kmer>(FastqStats&, size_t&);
+template bool
+SamReader::read_entry_with<ReaderModules::quality_only>(FastqStats&, size_t&);
+
 SamReader::~SamReader() {
-  free(filebuf);
-  fclose(fileobj);
+  if (fd >= 0 && fd != STDIN_FILENO)
+    close(fd);
+}
+
+/*******************************************************/
+/*************** READ RECORDS IN MEMORY ****************/
+/*******************************************************/
+// the record is copied into lines, so both separators are newlines
+MemoryReader::MemoryReader(FalcoConfig &_config, const size_t _buffer_size) :
+  StreamReader(_config, _buffer_size, '\n', '\n') {
+  name = seq = qual = NULL;
+  name_len = len = 0;
+  has_record = false;
+  last = NULL;
+}
+
+void
+MemoryReader::set_record(const char *_name, const size_t _name_len,
+                         const char *_seq, const char *_qual,
+                         const size_t _len) {
+  name = _name;
+  name_len = (_name == NULL) ? 0 : _name_len;
+  seq = _seq;
+  qual = _qual;
+  len = _len;
+  has_record = true;
+}
+
+size_t
+MemoryReader::load() {
+  record.assign(1, '\n');
+  cur_char = last = data_last = record.data();
+  return 0;
+}
+
+inline bool
+MemoryReader::is_eof() {
+  return cur_char >= last;
+}
+
+// same lines as the BAM reader decodes, with * for a missing sequence or
+// missing qualities
+void
+MemoryReader::copy_record() {
+  record.resize(name_len + 2*std::max(len, static_cast<size_t>(1)) + 3);
+
+  char *out = record.data();
+  memcpy(out, name, name_len);
+  out += name_len;
+  *out++ = '\n';
+
+  if (len == 0) {
+    *out++ = '*';
+    *out++ = '\n';
+    *out++ = '*';
+  }
+  else {
+    memcpy(out, seq, len);
+    out += len;
+    *out++ = '\n';
+    if (qual == NULL)
+      *out++ = '*';
+    else {
+      memcpy(out, qual, len);
+      out += len;
+    }
+  }
+  *out = '\n';
+
+  cur_char = record.data();
+  last = data_last = out;
+}
+
+template <size_t Modules> bool
+MemoryReader::read_entry_with(FastqStats &stats, size_t &num_bytes_read) {
+  if (!has_record)
+    return false;
+  has_record = false;
+
+  do_read = (stats.num_reads == next_read);
+
+  // reads that are skipped are not copied at all
+  if (do_read) {
+    copy_record();
+    read_tile_line<Modules>(stats);
+    cur_char = static_cast<char*>(memchr(cur_char, '\n', last - cur_char)) + 1;
+
+    read_sequence_line<Modules>(stats);
+    cur_char = static_cast<char*>(memchr(cur_char, '\n', last - cur_char)) + 1;
+
+    read_quality_line<Modules>(stats);
+    postprocess_fastq_record<Modules>(stats);
+  }
+
+  next_read += do_read*read_step;
+  ++stats.num_reads;
+  num_bytes_read += name_len + 2*len;
+  return true;
 }
 
+bool
+MemoryReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
+  return read_entry_with<ReaderModules::dynamic>(stats, num_bytes_read);
+}
+
+template bool
+MemoryReader::read_entry_with<ReaderModules::dynamic>(FastqStats&, size_t&);
+template bool
+MemoryReader::read_entry_with<ReaderModules::all>(FastqStats&, size_t&);
+template bool
+MemoryReader::read_entry_with<ReaderModules::no_kmer>(FastqStats&, size_t&);
+template bool
+MemoryReader::read_entry_with<ReaderModules::quality_only>(FastqStats&, size_t&);
+
 #ifdef USE_HTS
 /*******************************************************/
 /*************** READ BAM RECORD ***********************/
 /*******************************************************/
 
-// set sam separator as tab
+// the record is decoded into lines, so both separators are newlines
 BamReader::BamReader(FalcoConfig &_config, const size_t _buffer_size) :
-  StreamReader(_config, _buffer_size, '\t', '\n') {
-  rd_ret = 0;
+  StreamReader(_config, _buffer_size, '\n', '\n') {
+  hts = NULL;
+  hdr = NULL;
+  b = NULL;
+  num_threads = 1;
+  last = NULL;
+}
+
+void
+BamReader::set_num_threads(const size_t _num_threads) {
+  num_threads = _num_threads;
 }
 
+// The size of standard input is not known, so it is reported as zero
 size_t
 BamReader::load() {
   if (!(hts = hts_open(filename.c_str(), "r")))
     throw runtime_error("cannot load bam file : " + filename);
 
+  if (num_threads > 1 && hts_set_threads(hts, num_threads) != 0)
+    throw runtime_error("failed to start threads to read: " + filename);
+
   if (!(hdr = sam_hdr_read(hts)))
     throw runtime_error("failed to read header from file: " + filename);
 
   if (!(b = bam_init1()))
     throw runtime_error("failed to read record from file: " + filename);
 
-  // GS TODO: implement this properly
-  return 1;
+  return is_stdin ? 0 : get_file_size(filename);
 }
 
-// We will check eof on the >> operator
 inline bool
 BamReader::is_eof() {
-  return (cur_char == last - 1);
+  return cur_char >= last;
 }
 
-bool
-BamReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
-  if ((rd_ret = sam_read1(hts, hdr, b)) >= 0) {
-    fmt_ret = 0;
-
-    // GS TODO: implement this properly
-    num_bytes_read = 0;
-    if ((fmt_ret = sam_format1(hdr, b, &hts->line)) > 0) {
-      // define char* values for processing lines char by char
-      cur_char = hts->line.s;
-      last = cur_char + strlen(hts->line.s) - 1;
-
-      do_read = (stats.num_reads == next_read);
-
-      // Now read it as regular sam
-      read_tile_line(stats);
-      skip_separator();
-      for (size_t i = 0; i < 8; ++i) {
-        read_fast_forward_line();
-        skip_separator();
-      }
+// Writes the name, sequence and quality of the record the same way
+// sam_format1 would, without formatting the other fields
+void
+BamReader::decode_record() {
+  static const char nt16_to_base[] = "=ACMGRSVTWYHKDBN";
+
+  const char *name = bam_get_qname(b);
+  const size_t name_len = strlen(name);
+  const size_t len = b->core.l_qseq;
+  record.resize(name_len + 2*std::max(len, static_cast<size_t>(1)) + 3);
+
+  char *out = record.data();
+  memcpy(out, name, name_len);
+  out += name_len;
+  *out++ = '\n';
+
+  const uint8_t *seq = bam_get_seq(b);
+  const uint8_t *qual = bam_get_qual(b);
+  if (len == 0) {
+    *out++ = '*';
+    *out++ = '\n';
+    *out++ = '*';
+  }
+  else {
+    for (size_t i = 0; i < len; ++i)
+      *out++ = nt16_to_base[bam_seqi(seq, i)];
+    *out++ = '\n';
 
-      read_sequence_line(stats);
-      skip_separator();
-      read_quality_line(stats);
-      
-      if (do_read)
-        postprocess_fastq_record(stats);
+    // missing qualities are stored as 0xff
+    if (qual[0] == 0xff)
+      *out++ = '*';
+    else
+      for (size_t i = 0; i < len; ++i)
+        *out++ = static_cast<char>(qual[i] + Constants::quality_zero);
+  }
+  *out = '\n';
 
-      next_read += do_read*read_step;
-      ++stats.num_reads;
-      return true;
-    }
-    else throw runtime_error("failed reading record from: " + filename);
+  cur_char = record.data();
+  last = data_last = out;
+}
+
+FastqStats &
+BamReader::group_stats_of_record() {
+  const char *name = bam_get_qname(b);
+  if (groups->by_name)
+    return switch_to_group(groups->group_of_record(name, name + strlen(name),
+                                                   NULL, NULL));
+
+  // tags with a single character or a string are keys, others are not
+  const uint8_t *value = bam_aux_get(b, groups->tag.c_str());
+  if (value != NULL && *value == 'A') {
+    const char key = bam_aux2A(value);
+    return switch_to_group(groups->group_of_key(&key, 1));
+  }
+  if (value != NULL && (*value == 'Z' || *value == 'H')) {
+    const char *key = bam_aux2Z(value);
+    return switch_to_group(groups->group_of_key(key, strlen(key)));
+  }
+  return switch_to_group(groups->group_of_unassigned());
+}
 
+template <size_t Modules> bool
+BamReader::read_entry_with(FastqStats &file_stats, size_t &num_bytes_read) {
+  const int rd_ret = sam_read1(hts, hdr, b);
+
+  // -1 is the end of the file, anything lower is an error
+  if (rd_ret < -1)
+    throw runtime_error("failed reading record from: " + filename);
+  if (rd_ret < 0)
     return false;
+
+  FastqStats &stats = (groups == NULL) ? file_stats : group_stats_of_record();
+
+  do_read = (stats.num_reads == next_read);
+
+  // reads that are skipped are not decoded at all
+  if (do_read) {
+    decode_record();
+    read_tile_line<Modules>(stats);
+    cur_char = static_cast<char*>(memchr(cur_char, '\n', last - cur_char)) + 1;
+
+    read_sequence_line<Modules>(stats);
+    cur_char = static_cast<char*>(memchr(cur_char, '\n', last - cur_char)) + 1;
+
+    read_quality_line<Modules>(stats);
+    postprocess_fastq_record<Modules>(stats);
   }
-  // If I could not read another line it means it's eof
-  return false;
+
+  next_read += do_read*read_step;
+  ++stats.num_reads;
+
+  // the upper bits of the virtual offset are the compressed offset
+  if (check_bytes_read(stats.num_reads)) {
+    BGZF *bgzf = hts_get_bgzfp(hts);
+    if (bgzf != NULL)
+      num_bytes_read = bgzf_tell(bgzf) >> 16;
+  }
+  return true;
+}
+
+bool
+BamReader::read_entry(FastqStats &stats, size_t &num_bytes_read) {
+  return read_entry_with<ReaderModules::dynamic>(stats, num_bytes_read);
 }
 
+template bool
+BamReader::read_entry_with<ReaderModules::dynamic>(FastqStats&, size_t&);
+template bool
+BamReader::read_entry_with<ReaderModules::all>(FastqStats&, size_t&);
+template bool
+BamReader::read_entry_with<ReaderModules::no_kmer>(FastqStats&, size_t&);
+template bool
+BamReader::read_entry_with<ReaderModules::quality_only>(FastqStats&, size_t&);
+
 BamReader::~BamReader() {
   if (hdr) {
     bam_hdr_destroy(hdr);
@@ -30,10 +30,57 @@
 
 #ifdef USE_HTS
 #include <htslib/sam.h>
+#include <htslib/bgzf.h>
 #endif
 
 #include "FalcoConfig.hpp"
 #include "FastqStats.hpp"
+#include "GzDecompressor.hpp"
+#include "AdapterAutomaton.hpp"
+#include "Profile.hpp"
+
+class SequenceCountSync;
+class ReadGroups;
+
+/*************************************************************
+ ******************** READER MODULES *************************
+ *************************************************************/
+// Work in the reading loop that belongs to modules that can be turned off,
+// one bit each. The readers are templates over a set of these bits, so the
+// checks in the loop are resolved at compile time for a few common sets of
+// modules. Any other set uses the dynamic pipeline, which checks the config
+struct ReaderModules {
+  static const size_t kmer = 1;
+  static const size_t adapter = 1 << 1;
+  static const size_t tile = 1 << 2;
+  static const size_t gc_model = 1 << 3;
+  static const size_t duplication = 1 << 4;
+  static const size_t sequence_length = 1 << 5;
+  static const size_t base_content = 1 << 6;
+
+  // every module, which is the dynamic pipeline if this bit is set
+  static const size_t all = (1 << 7) - 1;
+  static const size_t dynamic_flag = 1 << 7;
+
+  // pipelines compiled ahead of time
+  static const size_t dynamic = all | dynamic_flag;
+  static const size_t no_kmer = all & ~kmer;  // the default limits
+  static const size_t quality_only = tile;
+
+  // modules used by a config
+  static size_t from_config(const FalcoConfig &config);
+
+  // the compiled pipeline for a config
+  static size_t pipeline_for(const FalcoConfig &config);
+};
+
+// whether a pipeline runs a module. Only the dynamic pipeline needs to
+// look at the config
+template <size_t Modules> static inline bool
+uses(const size_t module, const bool configured) {
+  return ((Modules & module) != 0) &&
+         ((Modules & ReaderModules::dynamic_flag) == 0 || configured);
+}
 
 /*************************************************************
  ******************** STREAM READER **************************
@@ -46,15 +93,14 @@ class StreamReader{
   const bool do_sequence_hash,
              do_kmer,
              do_adapter,
-             do_adapter_optimized,
-             do_sliding_window,
              do_n_content,
              do_quality_base,
              do_sequence,
              do_gc_sequence,
              do_quality_sequence,
              do_tile,
-             do_sequence_length;
+             do_sequence_length,
+             do_base_content;
 
   // This will tell me which character to look for to go to the next field
   const char field_separator;
@@ -76,15 +122,10 @@ class StreamReader{
   const bool tile_ignore;
 
   /************ ADAPTER SEARCH ***********/
-  const bool do_adapters_slow;
-  const std::vector<std::string> adapter_seqs;
-
-  const size_t num_adapters;
-  const size_t adapter_size;
-  const size_t adapter_mask;
-  const std::array<size_t, Constants::max_adapters> adapters;
+  const AdapterAutomaton &adapter_automaton;
 
   const std::string filename;
+  const bool is_stdin;
 
     // keep track of reads for which to do kmer and tile count
   static const size_t num_reads_for_tile = 10;
@@ -118,9 +159,14 @@ class StreamReader{
   // Number of bases that have overflown the buffer
   size_t leftover_ind;
 
+  // bin of the current position past the buffer, and where the next starts
+  size_t long_bin;
+  size_t next_long_bin_start;
+
   /********* TILE PARSING ********/
-  // tile value parsed from line 1 of each record
+  // tile value parsed from line 1 of each record, and its index in stats
   size_t tile_cur;
+  size_t tile_row;
 
   // Temp variables to be updated as you pass through the file
   size_t read_pos;  // which base we are at in the read
@@ -129,6 +175,7 @@ class StreamReader{
   size_t cur_quality;  // Sum of quality values in read
   size_t num_bases_after_n;  // count of k-mers that reset at every N
   size_t cur_kmer;  // 32-mer hash as you pass through the sequence line
+  uint32_t adapter_state;  // adapter automaton state after the last base
 
   // variables for gc model
   GCModelValue value;
@@ -139,7 +186,51 @@ class StreamReader{
   // Temporarily store line 2 out of 4 to know the base to which
   // quality characters are associated
   std::string leftover_buffer;
-  std::string sequence_to_hash;  // sequence marked for duplication
+
+  // last byte of the data in memory, which must be a field separator, or
+  // NULL if the reader cannot guarantee one. Lines that end before it and
+  // fit the buffer are read with the SIMD kernels
+  char *data_last;
+  static const size_t not_short_line = static_cast<size_t>(-1);
+
+  // 2-bit code of each base of a short line
+  std::vector<uint8_t> base_codes;
+
+  // when one file is split across threads, sequences for duplication are
+  // counted through this object, which keeps the order of the file
+  SequenceCountSync *sequence_sync;
+  size_t sync_worker;
+
+  // counters of -profile, or NULL if the file is not profiled
+  ReaderProfile *profile;
+
+  // whether the bases of every read are kept in buffer after it was read,
+  // which otherwise is only certain if duplication is counted. Paired
+  // mates are compared through them
+  bool keep_bases;
+
+  // Reads are counted in the stats of the group of each record instead of
+  // the stats given to read_entry if groups is not NULL. The sampling
+  // counters of a group are kept while records of other groups are read,
+  // so each group is sampled as if it had been read on its own. The mates
+  // of interleaved pairs are sampled apart the same way
+  ReadGroups *groups;
+  struct GroupSampling {
+    size_t next_read;
+    size_t next_tile_read;
+    size_t next_kmer_read;
+    bool continue_storing_sequences;
+    GroupSampling();
+  };
+  std::vector<GroupSampling> group_sampling;
+  size_t cur_group;
+
+  // keeps the sampling counters of the current group and moves to those
+  // of another
+  void switch_sampling(const size_t group);
+
+  // stats of a group, after moving the sampling counters to it
+  FastqStats &switch_to_group(const size_t group);
   /************ FUNCTIONS TO PROCESS READS AND BASES ***********/
   // gets and puts bases from and to buffer
   inline void put_base_in_buffer();  // puts base in buffer or leftover
@@ -149,31 +240,59 @@ class StreamReader{
   // should be parsed
   inline void get_tile_value();
 
+  template <size_t Modules>
+  inline void process_sequence_code(FastqStats &stats, const uint8_t code);
+  template <size_t Modules>
   inline void process_sequence_base_from_buffer(FastqStats &stats);
+  template <size_t Modules>
   inline void process_sequence_base_from_leftover(FastqStats &stats);
+  template <size_t Modules>
   inline void postprocess_sequence_line(FastqStats &stats);
 
+  inline void add_tile_quality(FastqStats &stats);
+  template <size_t Modules>
   inline void process_quality_base_from_buffer(FastqStats &stats);
+  template <size_t Modules>
   inline void process_quality_base_from_leftover(FastqStats &stats);
 
+  // counts the sequence in the buffer for duplication
+  inline void count_sequence(FastqStats &stats);
+  template <size_t Modules>
   inline void postprocess_fastq_record(FastqStats &stats);
 
   /************ FUNCTIONS TO READ LINES IN DIFFERENT WAYS ***********/
   inline void read_fast_forward_line();  // run this to ignore a line
   inline void read_fast_forward_line_eof();  // run this to ignore a line until EOF
   inline void skip_separator();  // keep going forward while = separator
+  template <size_t Modules>
   inline void read_tile_line(FastqStats &stats);  // get tile from read name
+  template <size_t Modules>
   inline void read_sequence_line(FastqStats &stats);  // parse sequence
+  template <size_t Modules>
   inline void read_quality_line(FastqStats &stats);  // parse quality
 
+  // whole line versions of the two above for short reads in memory
+  inline size_t get_short_line_length() const;
+  template <size_t Modules>
+  inline void read_short_sequence_line(FastqStats &stats, const size_t len);
+  template <size_t Modules>
+  inline void read_short_quality_line(FastqStats &stats, const size_t len);
+
   /************ FUNCTIONS FOR PROGRESS BAR ***********/
   inline bool check_bytes_read(const size_t line_num);
 
   StreamReader(FalcoConfig &config, const size_t buffer_size,
                const char _field_separator, const char _line_separator);
 
+  // Sets the sampling counters (read step, tiles, kmers) to the values they
+  // would have after reading the first read_index reads of the file, so
+  // stats.num_reads must start at read_index too
+  void skip_to_read(const size_t read_index);
+
   /************ FUNCTIONS TO IMPLEMENT BASED ON FILE FORMAT  ***********/
   virtual size_t load() = 0;
+  // reads one record with the dynamic pipeline. Each reader also has a
+  // read_entry_with template over the modules of the pipeline
   virtual bool read_entry (FastqStats &stats, size_t &num_bytes_read) = 0;
   virtual bool is_eof() = 0;  // whether file has ended, for each file type
   virtual ~StreamReader() = 0;
@@ -185,16 +304,48 @@ class StreamReader{
 /*******************************************************/
 class FastqReader : public StreamReader {
  private:
-  static const size_t RESERVE_SIZE = (1<<26);
+  // the file is memory mapped, followed by one line separator so line
+  // parsers always stop before the end of the mapping
   char *filebuf;
-  FILE *fileobj;
+  char *last;
+  size_t map_size;
+
+  // start of the line after the one cur_char is in, same as fgets would
+  inline char *next_line(char *from) const;
+
+  // byte offset to start reading from and the read index to stop at
+  size_t range_start;
+  size_t range_end_read;
+
+  // end of the mapped file, and the byte that the separator at the end of
+  // a block replaced
+  char *file_end;
+  char block_end_char;
 
  public:
   FastqReader(FalcoConfig &fc, const size_t _buffer_size);
 
+  // Only read the records from byte offset start (which must be the start
+  // of a record) until stats.num_reads reaches end_read
+  void set_range(const size_t start, const size_t end_read);
+
   size_t load();
+
+  // Maps the file again after more was appended to it, keeping the
+  // position of the next record. Unless whole_file is set, only complete
+  // records are read, so a record still being written is read after a
+  // later call. Returns the number of bytes of new records.
+  size_t load_appended(const bool whole_file);
+
+  // After load, reads the records between two byte offsets (which must be
+  // the starts of records or the end of the file) until the next call.
+  // Reads keep being numbered from where the last block stopped
+  void set_block(const size_t start, const size_t end);
+
   bool is_eof();
   bool read_entry(FastqStats &stats, size_t &num_bytes_read);
+  template <size_t Modules>
+  bool read_entry_with(FastqStats &stats, size_t &num_bytes_read);
   ~FastqReader();
 };
 
@@ -203,15 +354,35 @@ class FastqReader : public StreamReader {
 /*******************************************************/
 class GzFastqReader : public StreamReader {
  private:
-  static const size_t RESERVE_SIZE = (1<<26);
-  char *gzbuf;
-  gzFile fileobj;
+  GzDecompressor *decompressor;
+  size_t num_threads;
+
+  // standard input already read by the config, and whether it is gzipped
+  std::vector<char> stdin_head;
+  bool stdin_compressed;
+
+  // decompressed data still to be parsed, followed by one line separator
+  std::vector<char> window;
+  std::vector<char> chunk;
+  char *last;
+
+  // start of the line after the one cur_char is in
+  inline char *next_line(char *from) const;
+
+  // moves data from decompressed chunks into the window until it has a whole
+  // record or the file ends. Returns false if there is nothing left to parse
+  bool fill_record();
 
  public:
   GzFastqReader(FalcoConfig &fc, const size_t _buffer_size);
+
+  // threads used to inflate BGZF blocks
+  void set_num_threads(const size_t _num_threads);
   size_t load();
   bool is_eof();
   bool read_entry(FastqStats &stats, size_t &num_bytes_read);
+  template <size_t Modules>
+  bool read_entry_with(FastqStats &stats, size_t &num_bytes_read);
   ~GzFastqReader();
 };
 
@@ -219,20 +390,96 @@ class GzFastqReader : public StreamReader {
 /*************** READ SAM RECORD ***********************/
 /*******************************************************/
 
+// Reads the file in large blocks into a window, which keeps the part of a
+// line that continues in the next block, and jumps between the fields of
+// each line with memchr. Only the name, sequence and quality fields of the
+// reads that are kept are parsed.
 class SamReader : public StreamReader {
  private:
-  static const size_t RESERVE_SIZE = (1<<26);
-  char *filebuf;
-  FILE *fileobj;
+  // bytes read from the input at a time
+  static const size_t block_size = (1 << 22);
+
+  // longest line the window may have to hold
+  const size_t line_size;
+  int fd;
+
+  // standard input already read by the config, parsed before the stream
+  std::vector<char> stdin_head;
+  size_t head_pos;
+  bool input_done;
+
+  // data still to be parsed from cur_char to last, followed by a newline
+  // and a tab, and the number of input bytes before the window
+  std::vector<char> window;
+  char *last;
+  size_t window_offset;
+
+  // newline at the end of the line that starts at cur_char
+  char *line_end;
+
+  // reads up to max_bytes from the head or the stream into to
+  size_t read_input(char *to, const size_t max_bytes);
+
+  // reads blocks until the window has the whole line that starts at
+  // cur_char, and sets line_end. Returns false if there is nothing left
+  bool fill_line();
+
+  // start of the field after the one from is in, skipping runs of tabs as
+  // skip_separator does, or NULL if this is the last field of the line
+  inline char *next_field(char *from) const;
+
+  // stats of the group of the line that starts at cur_char, whose tags
+  // follow the eleventh field
+  FastqStats &group_stats_of_line();
 
  public:
   SamReader(FalcoConfig &fc, const size_t _buffer_size);
   size_t load();
   bool is_eof();
   bool read_entry(FastqStats &stats, size_t &num_bytes_read);
+  template <size_t Modules>
+  bool read_entry_with(FastqStats &stats, size_t &num_bytes_read);
   ~SamReader();
 };
 
+/*******************************************************/
+/*************** READ RECORDS IN MEMORY ****************/
+/*******************************************************/
+// Records given one at a time by a program that already has them in
+// memory, such as an aligner linking libfalco. Each record is copied one
+// field per line, as the BAM reader decodes its records, only if it is
+// not skipped by the read step.
+class MemoryReader : public StreamReader {
+ private:
+  // the record given to set_record, not copied yet
+  const char *name;
+  size_t name_len;
+  const char *seq;
+  const char *qual;
+  size_t len;
+  bool has_record;
+
+  std::vector<char> record;
+  char *last;
+
+  void copy_record();
+
+ public:
+  MemoryReader(FalcoConfig &fc, const size_t _buffer_size);
+
+  // the record read by the next call to read_entry_with. The strings must
+  // stay valid until then. qual has Phred+33 characters, or is NULL if
+  // the record has no qualities
+  void set_record(const char *_name, const size_t _name_len,
+                  const char *_seq, const char *_qual, const size_t _len);
+
+  size_t load();
+  bool is_eof();
+  bool read_entry(FastqStats &stats, size_t &num_bytes_read);
+  template <size_t Modules>
+  bool read_entry_with(FastqStats &stats, size_t &num_bytes_read);
+};
+
 #ifdef USE_HTS
 /*******************************************************/
 /*************** READ BAM RECORD ***********************/
@@ -243,13 +490,28 @@ class BamReader : public StreamReader {
   htsFile *hts;
   bam_hdr_t *hdr;
   bam1_t *b;
-  int rd_ret, fmt_ret;
+  size_t num_threads;
+
+  // name, sequence and quality of the current record decoded from its
+  // packed form, one per line
+  std::vector<char> record;
   char *last;
+
+  void decode_record();
+
+  // stats of the group of the current record, by its name or its tag
+  FastqStats &group_stats_of_record();
+
  public:
   BamReader(FalcoConfig &fc, const size_t _buffer_size);
+
+  // threads htslib uses to inflate BGZF blocks
+  void set_num_threads(const size_t _num_threads);
   size_t load();
   bool is_eof();
   bool read_entry(FastqStats &stats, size_t &num_bytes_read);
+  template <size_t Modules>
+  bool read_entry_with(FastqStats &stats, size_t &num_bytes_read);
   ~BamReader();
 };
 #endif
@@ -0,0 +1,352 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include "WorkScheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <thread>
+#include <fstream>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+using std::string;
+using std::vector;
+using std::function;
+using std::thread;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::ostream;
+using std::to_string;
+
+typedef std::chrono::steady_clock steady_clock;
+
+// size of inputs that cannot be stat'ed, like standard input, which are
+// started first since they may be the largest
+static const size_t unknown_size = std::numeric_limits<size_t>::max();
+
+static size_t
+get_input_size(const string &filename) {
+  struct stat st;
+  if (filename == "-" || stat(filename.c_str(), &st) != 0)
+    return unknown_size;
+  return static_cast<size_t>(st.st_size);
+}
+
+static double
+seconds_since(const steady_clock::time_point &start) {
+  return std::chrono::duration<double>(steady_clock::now() - start).count();
+}
+
+/*******************************************************/
+/*************** CORES AND NUMA NODES ******************/
+/*******************************************************/
+// cores in a list like "0-3,8,10-11", as the kernel writes them
+static vector<int>
+parse_core_list(const string &list) {
+  vector<int> cores;
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == string::npos)
+      end = list.size();
+    const string range = list.substr(pos, end - pos);
+    const size_t dash = range.find('-');
+    try {
+      const int first = std::stoi(range.substr(0, dash));
+      const int last =
+        (dash == string::npos) ? first : std::stoi(range.substr(dash + 1));
+      for (int core = first; core <= last; ++core)
+        cores.push_back(core);
+    }
+    catch (const std::exception &) {}
+    pos = end + 1;
+  }
+  return cores;
+}
+
+// Cores this process may run on, ordered so consecutive threads go to
+// different NUMA nodes and each node's cores are taken in increasing order,
+// which puts threads on different physical cores before their hyperthreads
+// on most machines. Empty if the cores cannot be found or set
+static vector<int>
+get_core_order() {
+  vector<int> order;
+#ifdef __linux__
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    return order;
+
+  vector<bool> in_node(CPU_SETSIZE, false);
+  vector<vector<int> > node_cores;
+  const string node_dir = "/sys/devices/system/node";
+  DIR *dir = opendir(node_dir.c_str());
+  if (dir != NULL) {
+    vector<int> nodes;
+    for (struct dirent *d = readdir(dir); d != NULL; d = readdir(dir)) {
+      const string name = d->d_name;
+      if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+          name.find_first_not_of("0123456789", 4) == string::npos)
+        nodes.push_back(std::stoi(name.substr(4)));
+    }
+    closedir(dir);
+    std::sort(begin(nodes), end(nodes));
+
+    for (const int node : nodes) {
+      std::ifstream in(node_dir + "/node" + to_string(node) + "/cpulist");
+      string list;
+      std::getline(in, list);
+      vector<int> cores;
+      for (const int core : parse_core_list(list))
+        if (core >= 0 && core < CPU_SETSIZE && !in_node[core] &&
+            CPU_ISSET(core, &allowed)) {
+          in_node[core] = true;
+          cores.push_back(core);
+        }
+      if (!cores.empty())
+        node_cores.push_back(cores);
+    }
+  }
+
+  // cores of no node, which are all of them without NUMA information
+  vector<int> other_cores;
+  for (int core = 0; core < CPU_SETSIZE; ++core)
+    if (!in_node[core] && CPU_ISSET(core, &allowed))
+      other_cores.push_back(core);
+  if (!other_cores.empty())
+    node_cores.push_back(other_cores);
+
+  for (size_t i = 0; order.size() < static_cast<size_t>(CPU_COUNT(&allowed));
+       ++i)
+    for (const vector<int> &cores : node_cores)
+      if (i < cores.size())
+        order.push_back(cores[i]);
+#endif
+  return order;
+}
+
+// runs the calling thread on a single core from now on
+static void
+pin_to_core(const int core) {
+#ifdef __linux__
+  cpu_set_t cores;
+  CPU_ZERO(&cores);
+  CPU_SET(core, &cores);
+  pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+#else
+  (void)core;
+#endif
+}
+
+/*******************************************************/
+/*************** WORK SCHEDULER ************************/
+/*******************************************************/
+WorkScheduler::WorkScheduler(const vector<string> &filenames,
+                             const size_t _num_threads,
+                             const bool _pin_threads) :
+  num_threads(std::max(_num_threads, static_cast<size_t>(1))),
+  pin_threads(_pin_threads) {
+  bytes_left = 0;
+  for (const string &filename : filenames) {
+    QueuedFile file;
+    file.filename = filename;
+    file.size = get_input_size(filename);
+    if (file.size != unknown_size)
+      bytes_left += file.size;
+    queue.push_back(file);
+  }
+
+  // files of the same size keep the order they were given in
+  std::stable_sort(begin(queue), end(queue),
+    [](const QueuedFile &a, const QueuedFile &b) {return a.size > b.size;});
+
+  next_file = 0;
+  num_busy_with_files = 0;
+  stopped = false;
+  ThreadTiming t;
+  t.num_files = t.num_ranges_helped = 0;
+  t.file_seconds = t.help_seconds = t.idle_seconds = 0.0;
+  timing.assign(num_threads, t);
+  if (pin_threads)
+    core_order = get_core_order();
+}
+
+void
+WorkScheduler::run(const FileTask &task) {
+  // the calling thread works as thread 0, and gets back the cores it could
+  // run on before once all threads finish
+#ifdef __linux__
+  cpu_set_t caller_cores;
+  const bool restore_cores = !core_order.empty() &&
+    sched_getaffinity(0, sizeof(caller_cores), &caller_cores) == 0;
+#endif
+
+  vector<thread> threads;
+  for (size_t i = 1; i < num_threads; ++i)
+    threads.push_back(thread(&WorkScheduler::work, this, i, std::cref(task)));
+  work(0, task);
+  for (auto &t : threads)
+    t.join();
+
+#ifdef __linux__
+  if (restore_cores)
+    sched_setaffinity(0, sizeof(caller_cores), &caller_cores);
+#endif
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+bool
+WorkScheduler::take_file(QueuedFile &file, bool &split) {
+  lock_guard<mutex> lock(mtx);
+  if (stopped || next_file == queue.size())
+    return false;
+
+  // a file larger than its share of the files not started yet would be
+  // the last one to finish if it were read by a single thread
+  file = queue[next_file++];
+  split = false;
+  if (file.size != unknown_size) {
+    split = (num_threads > 1 && file.size > bytes_left / num_threads);
+    bytes_left -= file.size;
+  }
+  ++num_busy_with_files;
+  return true;
+}
+
+void
+WorkScheduler::work(const size_t thread_id, const FileTask &task) {
+  ThreadTiming &t = timing[thread_id];
+  if (!core_order.empty())
+    pin_to_core(core_order[thread_id % core_order.size()]);
+
+  QueuedFile file;
+  bool split = false;
+  while (take_file(file, split)) {
+    const steady_clock::time_point start = steady_clock::now();
+    try {
+      task(file.filename, split);
+    }
+    catch (...) {
+      lock_guard<mutex> lock(mtx);
+      if (!error)
+        error = std::current_exception();
+      stopped = true;
+    }
+    t.file_seconds += seconds_since(start);
+    ++t.num_files;
+
+    lock_guard<mutex> lock(mtx);
+    --num_busy_with_files;
+    cv.notify_all();
+  }
+  help(thread_id);
+}
+
+bool
+WorkScheduler::take_range(RangeJob &job, size_t &range) {
+  if (job.next_range == job.num_ranges)
+    return false;
+  range = job.next_range++;
+  return true;
+}
+
+void
+WorkScheduler::help(const size_t thread_id) {
+  ThreadTiming &t = timing[thread_id];
+  unique_lock<mutex> lock(mtx);
+  for (;;) {
+    // ranges can only be added by threads that are still reading a file
+    RangeJob *job = NULL;
+    size_t range = 0;
+    const steady_clock::time_point wait_start = steady_clock::now();
+    cv.wait(lock, [&]() {
+      for (RangeJob *j : jobs)
+        if (take_range(*j, range)) {
+          job = j;
+          return true;
+        }
+      return num_busy_with_files == 0;
+    });
+    t.idle_seconds += seconds_since(wait_start);
+    if (job == NULL)
+      return;
+
+    lock.unlock();
+    const steady_clock::time_point start = steady_clock::now();
+    (*job->run_range)(range);
+    t.help_seconds += seconds_since(start);
+    ++t.num_ranges_helped;
+    lock.lock();
+
+    ++job->num_finished;
+    cv.notify_all();
+  }
+}
+
+void
+WorkScheduler::run_ranges(const size_t num_ranges,
+                          const function<void(const size_t)> &run_range) {
+  RangeJob job;
+  job.num_ranges = num_ranges;
+  job.next_range = 0;
+  job.num_finished = 0;
+  job.run_range = &run_range;
+
+  unique_lock<mutex> lock(mtx);
+  jobs.push_back(&job);
+  cv.notify_all();
+
+  size_t range = 0;
+  while (take_range(job, range)) {
+    lock.unlock();
+    run_range(range);
+    lock.lock();
+    ++job.num_finished;
+  }
+
+  // ranges taken by other threads may still be running
+  cv.wait(lock, [&]() {return job.num_finished == job.num_ranges;});
+  jobs.remove(&job);
+}
+
+void
+WorkScheduler::report_timing(ostream &out) const {
+  const std::ios::fmtflags flags = out.flags();
+  const std::streamsize precision = out.precision();
+  for (size_t i = 0; i < timing.size(); ++i) {
+    const ThreadTiming &t = timing[i];
+    out << "[thread " << i;
+    if (!core_order.empty())
+      out << ", core " << core_order[i % core_order.size()];
+    out << "] " << t.num_files << " files, "
+        << t.num_ranges_helped << " ranges of other files, "
+        << std::fixed << std::setprecision(2)
+        << (t.file_seconds + t.help_seconds) << "s busy, "
+        << t.idle_seconds << "s idle\n";
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
@@ -0,0 +1,120 @@
+/* Copyright (C) 2019 Guilherme De Sena Brandine and
+ *                    Andrew D. Smith
+ * Authors: Guilherme De Sena Brandine, Andrew Smith
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef WORKSCHEDULER_HPP
+#define WORKSCHEDULER_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <ostream>
+
+/*************************************************************
+ ******************** WORK SCHEDULER *************************
+ *************************************************************/
+// Runs input files on a pool of threads that take the next file from a
+// shared queue, largest first, so a few large files do not leave most
+// threads idle at the end. A file may also be read as ranges that any
+// thread without a file of its own helps to run.
+//
+// Threads may also be pinned to cores, spread over the NUMA nodes of the
+// machine. Each thread allocates the stats of the files and ranges it
+// reads, so their pages are first touched, and placed, in the memory of
+// the node the thread runs on.
+class WorkScheduler {
+ public:
+  // Processes one file. split is a hint that the file is large compared to
+  // the work left, so it is worth reading it with run_ranges
+  typedef std::function<void(const std::string &filename,
+                             const bool split)> FileTask;
+
+  WorkScheduler(const std::vector<std::string> &filenames,
+                const size_t _num_threads, const bool _pin_threads = false);
+
+  const size_t num_threads;
+  const bool pin_threads;
+
+  // Runs task on every file until all are done, and rethrows the first
+  // error of any task after all threads finish
+  void run(const FileTask &task);
+
+  // Calls run_range(i) for i from 0 to num_ranges - 1 and returns when all
+  // calls returned. Ranges start in increasing order of i, by the calling
+  // thread or by idle ones, so a range only ever waits on ranges that are
+  // already running. run_range must not throw.
+  void run_ranges(const size_t num_ranges,
+                  const std::function<void(const size_t)> &run_range);
+
+  // time each thread spent on files, on ranges of other threads' files
+  // and waiting for work
+  void report_timing(std::ostream &out) const;
+
+ private:
+  struct QueuedFile {
+    std::string filename;
+    size_t size;
+  };
+
+  struct RangeJob {
+    size_t num_ranges;
+    size_t next_range;
+    size_t num_finished;
+    const std::function<void(const size_t)> *run_range;
+  };
+
+  struct ThreadTiming {
+    size_t num_files;
+    size_t num_ranges_helped;
+    double file_seconds;
+    double help_seconds;
+    double idle_seconds;
+  };
+
+  // files not taken yet, and the sum of their sizes
+  std::vector<QueuedFile> queue;
+  size_t next_file;
+  size_t bytes_left;
+
+  // guards the variables below
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::list<RangeJob*> jobs;
+  size_t num_busy_with_files;
+  bool stopped;
+  std::exception_ptr error;
+
+  std::vector<ThreadTiming> timing;
+
+  // cores threads are pinned to, thread i to core_order[i % size], or
+  // empty if threads are not pinned
+  std::vector<int> core_order;
+
+  void work(const size_t thread_id, const FileTask &task);
+
+  // takes the next file if any is left
+  bool take_file(QueuedFile &file, bool &split);
+
+  // runs ranges of other files until no file or range is left
+  void help(const size_t thread_id);
+
+  // a range of the job, if it has any left to start
+  static bool take_range(RangeJob &job, size_t &range);
+};
+
+#endif
@@ -16,16 +16,30 @@
  */
 
 #include <fstream>
+#include <sstream>
 #include <chrono>
+#include <algorithm>
 
 #include "smithlab_utils.hpp"
 #include "OptionParser.hpp"
 #include "FalcoConfig.hpp"
 #include "FastqStats.hpp"
 #include "StreamReader.hpp"
+#include "FastqSplitter.hpp"
 #include "HtmlMaker.hpp"
 #include "Module.hpp"
+#include "WorkScheduler.hpp"
+#include "Profile.hpp"
+#include "PairStats.hpp"
+#include "ResultCache.hpp"
+#include "GzDecompressor.hpp"
+#include "OutputWriter.hpp"
+#include "RunReport.hpp"
+#include "ReadGroups.hpp"
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
 
 using std::string;
 using std::runtime_error;
@@ -36,8 +50,12 @@ using std::vector;
 using std::ifstream;
 using std::ofstream;
 using std::ostream;
+using std::ostringstream;
+using std::make_pair;
 using std::to_string;
+using std::count;
 using std::thread;
+using std::function;
 
 using std::chrono::system_clock;
 using std::chrono::duration_cast;
@@ -70,33 +88,496 @@ static bool dir_exists(const string &path) {
   return false;
 }
 
+// Reads all records with the reader pipeline compiled for Modules, calling
+// report with the number of bytes read after each record. Reading stops
+// early if report returns false
+template <size_t Modules, typename T, typename Report> void
+read_all_entries(T &in, FastqStats &stats, size_t &tot_bytes_read,
+                 Report report) {
+  while (in.template read_entry_with<Modules>(stats, tot_bytes_read))
+    if (!report())
+      break;
+}
+
+// Same as above, choosing the compiled pipeline from the value of
+// ReaderModules::pipeline_for
+template <typename T, typename Report> void
+read_all_entries(T &in, FastqStats &stats, const size_t pipeline,
+                 size_t &tot_bytes_read, Report report) {
+  switch (pipeline) {
+    case ReaderModules::all:
+      read_all_entries<ReaderModules::all>(in, stats, tot_bytes_read, report);
+      break;
+    case ReaderModules::no_kmer:
+      read_all_entries<ReaderModules::no_kmer>(in, stats, tot_bytes_read,
+                                               report);
+      break;
+    case ReaderModules::quality_only:
+      read_all_entries<ReaderModules::quality_only>(in, stats, tot_bytes_read,
+                                                    report);
+      break;
+    default:
+      read_all_entries<ReaderModules::dynamic>(in, stats, tot_bytes_read,
+                                               report);
+  }
+}
+
+// progress of inputs of unknown size, in the same line as the progress bar
+static void
+report_bytes_read(const size_t num_bytes, const bool finished) {
+  cerr << "\r[running falco] " << (num_bytes >> 20) << " MB of input read";
+  if (finished)
+    cerr << '\n';
+}
+
+// whether the metrics converged, which is only checked once every
+// reads_between_checkpoints reads
+static bool
+metrics_converged(const FastqStats &stats, ConvergenceTracker *convergence,
+                  size_t &next_checkpoint) {
+  if (convergence == NULL || stats.num_reads < next_checkpoint)
+    return false;
+  next_checkpoint = stats.num_reads + Constants::reads_between_checkpoints;
+  return convergence->add_checkpoint(stats);
+}
+
 // Read any file type until the end and logs progress
-// in is an StreamReader object type
+// in is an StreamReader object type. If convergence is given, reading
+// stops once the metrics converged
 template <typename T> void
-read_stream_into_stats(T &in, FastqStats &stats, FalcoConfig &falco_config) {
+read_stream_into_stats(T &in, FastqStats &stats, FalcoConfig &falco_config,
+                       const size_t pipeline,
+                       ConvergenceTracker *convergence = NULL) {
   // open file
   size_t file_size = in.load();
   size_t tot_bytes_read = 0;
 
-  // Read record by record
+  // Read record by record. The size of standard input is not known, so
+  // only the amount of input read so far is shown
   const bool quiet = falco_config.quiet;
+  const bool size_known = (file_size > 0);
+  ProgressBar progress(size_known ? file_size : 1, "running falco");
+  size_t next_report = Constants::bytes_between_reports;
+  size_t next_checkpoint = Constants::reads_between_checkpoints;
+  if (!quiet && size_known)
+    progress.report(cerr, 0);
+  read_all_entries(in, stats, pipeline, tot_bytes_read, [&]() {
+    if (!quiet) {
+      if (size_known) {
+        if (progress.time_to_report(tot_bytes_read))
+          progress.report(cerr, tot_bytes_read);
+      }
+      else if (tot_bytes_read >= next_report) {
+        report_bytes_read(tot_bytes_read, false);
+        next_report = tot_bytes_read + Constants::bytes_between_reports;
+      }
+    }
+    return !metrics_converged(stats, convergence, next_checkpoint);
+  });
+
+  // if I could not get tile information from read names, I need to tell this to
+  // config so it does not output tile data on the summary or html
+  if (in.tile_ignore) {
+    falco_config.do_tile = false;
+  }
+
+  if (!quiet && !size_known)
+    report_bytes_read(tot_bytes_read, true);
+  else if (tot_bytes_read < file_size && !quiet)
+    progress.report(cerr, file_size);
+
+}
+
+// Reads the ranges of a split uncompressed FASTQ file in parallel, each
+// into its own FastqStats, then merges them in file order. Ranges are run
+// by this thread and by any idle thread of the scheduler, which allocates
+// the stats of the range so they are in the memory of its NUMA node. Sampling and
+// duplication follow the order of the file, so results are the same as
+// reading it in a single thread.
+static void
+read_split_fastq_into_stats(const vector<FastqRange> &ranges,
+                            FastqStats &stats, FalcoConfig &falco_config,
+                            const size_t pipeline,
+                            WorkScheduler &scheduler,
+                            ReaderProfile *profile) {
+  const size_t num_ranges = ranges.size();
+  vector<std::unique_ptr<FastqStats> > partial_stats(num_ranges);
+  vector<ReaderProfile> partial_profiles(num_ranges);
+  std::unique_ptr<std::atomic<size_t>[]>
+    bytes_read(new std::atomic<size_t>[num_ranges]);
+  for (size_t i = 0; i < num_ranges; ++i)
+    bytes_read[i] = 0;
+
+  vector<std::exception_ptr> errors(num_ranges);
+  bool tile_ignore = false;
+
+  // whichever thread is running a range reports the progress of all
+  const bool quiet = falco_config.quiet;
+  const size_t file_size = ranges.back().end;
   ProgressBar progress(file_size, "running falco");
+  std::mutex progress_mtx;
   if (!quiet)
     progress.report(cerr, 0);
-  while (in.read_entry(stats, tot_bytes_read)) {
-    if (!quiet && progress.time_to_report(tot_bytes_read))
+  auto report_progress = [&]() {
+    std::unique_lock<std::mutex> lock(progress_mtx, std::try_to_lock);
+    if (!lock.owns_lock())
+      return;
+    size_t tot_bytes_read = 0;
+    for (size_t j = 0; j < num_ranges; ++j)
+      tot_bytes_read += bytes_read[j];
+    if (progress.time_to_report(tot_bytes_read))
       progress.report(cerr, tot_bytes_read);
+  };
+
+  SequenceCountSync sequence_sync(stats, ranges, falco_config.read_step);
+  scheduler.run_ranges(num_ranges, [&](const size_t i) {
+    try {
+      const FastqRange &range = ranges[i];
+      partial_stats[i].reset(new FastqStats);
+      FastqStats &local_stats = *partial_stats[i];
+      FastqReader in(falco_config, FastqStats::SHORT_READ_THRESHOLD);
+      if (i + 1 < num_ranges)
+        in.set_range(range.start, range.first_read + range.num_reads);
+      else
+        in.set_range(range.start, std::numeric_limits<size_t>::max());
+      in.skip_to_read(range.first_read);
+      in.sequence_sync = &sequence_sync;
+      in.sync_worker = i;
+      if (profile != NULL)
+        in.profile = &partial_profiles[i];
+
+      // reads are numbered from the start of the file
+      in.load();
+      local_stats.num_reads = range.first_read;
+      size_t tot_bytes_read = 0;
+      read_all_entries(in, local_stats, pipeline, tot_bytes_read, [&]() {
+        if (tot_bytes_read > range.start)
+          bytes_read[i] = tot_bytes_read - range.start;
+        if (!quiet)
+          report_progress();
+        return true;
+      });
+
+      sequence_sync.finish(i, local_stats);
+      local_stats.num_reads -= range.first_read;
+      if (i + 1 < num_ranges && local_stats.num_reads != range.num_reads)
+        throw runtime_error("failed to read all records from position " +
+                            to_string(range.start) + " of " +
+                            falco_config.filename);
+      if (i == 0)
+        tile_ignore = in.tile_ignore;
+    }
+    catch (...) {
+      errors[i] = std::current_exception();
+      sequence_sync.abort();
+    }
+  });
+
+  for (auto &e : errors)
+    if (e) std::rethrow_exception(e);
+
+  if (!quiet)
+    progress.report(cerr, file_size);
+
+  for (size_t i = 0; i < num_ranges; ++i)
+    stats.merge(*partial_stats[i]);
+
+  if (profile != NULL)
+    for (auto &p : partial_profiles)
+      profile->merge(p);
+
+  if (tile_ignore)
+    falco_config.do_tile = false;
+}
+
+// index with the lowest num_bits bits of i in reverse order
+static size_t
+reverse_bits(size_t i, const size_t num_bits) {
+  size_t ans = 0;
+  for (size_t j = 0; j < num_bits; ++j, i >>= 1)
+    ans = (ans << 1) | (i & 1);
+  return ans;
+}
+
+// Reads blocks of bytes_per_sample_block bytes of an uncompressed FASTQ
+// file until its metrics converge. Blocks are taken in the bit-reversed
+// order of their index (the first, the middle, the two quarters...), so
+// the reads seen at any time are evenly spread over the file rather than
+// coming from its first tiles. Blocks start and end at the first record
+// past multiples of the block size.
+static void
+read_fastq_blocks_into_stats(FastqReader &in, FastqStats &stats,
+                             FalcoConfig &falco_config,
+                             const size_t pipeline,
+                             ConvergenceTracker &convergence) {
+  const size_t file_size = in.load();
+  const size_t block_size = Constants::bytes_per_sample_block;
+  const size_t num_blocks =
+    std::max((file_size + block_size - 1) / block_size, size_t(1));
+  size_t num_bits = 0;
+  while ((size_t(1) << num_bits) < num_blocks)
+    ++num_bits;
+
+  const auto block_start = [&](const size_t block) {
+    if (block == 0)
+      return size_t(0);
+    if (block >= num_blocks)
+      return file_size;
+    return get_next_record_start(falco_config.filename, block*block_size,
+                                 file_size);
+  };
+
+  const bool quiet = falco_config.quiet;
+  ProgressBar progress(std::max(file_size, size_t(1)), "running falco");
+  if (!quiet)
+    progress.report(cerr, 0);
+
+  size_t tot_bytes_read = 0;
+  size_t bytes_done = 0;
+  size_t next_checkpoint = Constants::reads_between_checkpoints;
+  bool converged = false;
+  for (size_t i = 0; i < (size_t(1) << num_bits) && !converged; ++i) {
+    const size_t block = reverse_bits(i, num_bits);
+    if (block >= num_blocks)
+      continue;
+    const size_t start = block_start(block);
+    const size_t end = block_start(block + 1);
+    if (start >= end)
+      continue;
+
+    in.set_block(start, end);
+    read_all_entries(in, stats, pipeline, tot_bytes_read, [&]() {
+      converged = metrics_converged(stats, &convergence, next_checkpoint);
+      return !converged;
+    });
+
+    bytes_done += end - start;
+    if (!quiet && progress.time_to_report(bytes_done))
+      progress.report(cerr, bytes_done);
   }
 
-  // if I could not get tile information from read names, I need to tell this to
-  // config so it does not output tile data on the summary or html
-  if (in.tile_ignore) {
+  if (!quiet)
+    progress.report(cerr, std::max(file_size, size_t(1)));
+
+  if (in.tile_ignore)
     falco_config.do_tile = false;
+}
+
+// whether a file has at least one whole line, from which the format of
+// the read names is taken
+static bool
+has_complete_line(const string &filename) {
+  ifstream in(filename);
+  string line;
+  return std::getline(in, line) && !in.eof();
+}
+
+// Reads an uncompressed FASTQ file that is still being written, such as
+// the output of a basecaller. Records are counted into the same stats as
+// they are appended, and refresh is called with the records read so far
+// every interval seconds. Reading ends when no record was appended for
+// timeout seconds, after which the last record is read even if it has no
+// newline at the end.
+static void
+follow_fastq_into_stats(FastqStats &stats, FalcoConfig &falco_config,
+                        const size_t pipeline, const size_t interval,
+                        const size_t timeout,
+                        const function<void(const FastqStats &,
+                                            const FalcoConfig &)> &refresh,
+                        ReaderProfile *profile) {
+  typedef std::chrono::steady_clock steady_clock;
+  const auto seconds_since = [](const steady_clock::time_point &t) {
+    return static_cast<size_t>(std::chrono::duration_cast<
+      std::chrono::seconds>(steady_clock::now() - t).count());
+  };
+  const std::chrono::seconds poll_wait(1);
+
+  steady_clock::time_point last_growth = steady_clock::now();
+  while (!has_complete_line(falco_config.filename)) {
+    if (seconds_since(last_growth) >= timeout)
+      throw runtime_error("no records were written to " +
+                          falco_config.filename + " in " +
+                          to_string(timeout) + "s");
+    std::this_thread::sleep_for(poll_wait);
   }
 
-  if (tot_bytes_read < file_size && !quiet)
+  FastqReader in(falco_config, FastqStats::SHORT_READ_THRESHOLD);
+  in.profile = profile;
+  const bool quiet = falco_config.quiet;
+  size_t tot_bytes_read = 0;
+  size_t num_reads_refreshed = 0;
+  last_growth = steady_clock::now();
+  steady_clock::time_point last_refresh = last_growth;
+  for (;;) {
+    const bool grew = (in.load_appended(false) > 0);
+    if (grew) {
+      read_all_entries(in, stats, pipeline, tot_bytes_read,
+                       []() {return true;});
+      last_growth = steady_clock::now();
+    }
+
+    if (stats.num_reads > num_reads_refreshed &&
+        seconds_since(last_refresh) >= interval) {
+      FalcoConfig refresh_config(falco_config);
+      if (in.tile_ignore)
+        refresh_config.do_tile = false;
+      refresh(stats, refresh_config);
+      num_reads_refreshed = stats.num_reads;
+      last_refresh = steady_clock::now();
+      if (!quiet)
+        log_process("Refreshed reports after " + to_string(stats.num_reads) +
+                    " reads");
+    }
+
+    if (seconds_since(last_growth) >= timeout)
+      break;
+    if (!grew)
+      std::this_thread::sleep_for(poll_wait);
+  }
+
+  if (in.load_appended(true) > 0)
+    read_all_entries(in, stats, pipeline, tot_bytes_read,
+                       []() {return true;});
+
+  if (in.tile_ignore)
+    falco_config.do_tile = false;
+}
+
+// Reads both mates of each pair into their own stats, one record each at
+// a time, so pair metrics see the two mates together. Mates are read by
+// their own reader, or by in1 if in2 is NULL and they are interleaved in
+// one file, which keeps the sampling counters of each mate apart so they
+// are sampled as if they had been read from two files.
+template <size_t Modules, typename T, typename Report> void
+read_all_pairs(T &in1, T *in2, FastqStats &stats1, FastqStats &stats2,
+               PairStats &pairs, size_t &tot_bytes_read, Report report) {
+  const bool interleaved = (in2 == NULL);
+  T &mate2_in = interleaved ? in1 : *in2;
+  size_t mate2_bytes_read = 0;
+  size_t &mate2_bytes = interleaved ? tot_bytes_read : mate2_bytes_read;
+
+  // bases of the first mate, which the reader of interleaved pairs
+  // overwrites with those of the second
+  string mate1_bases;
+  size_t mate1_length = 0;
+  for (;;) {
+    const size_t num_pairs = stats1.num_reads;
+    if (interleaved)
+      in1.switch_sampling(0);
+    in1.template read_entry_with<Modules>(stats1, tot_bytes_read);
+    const bool do_read = in1.do_read;
+    mate1_length = in1.read_pos;
+    if (interleaved && do_read)
+      mate1_bases.assign(in1.buffer, std::min(in1.read_pos, in1.buffer_size));
+
+    if (interleaved)
+      in1.switch_sampling(1);
+    mate2_in.template read_entry_with<Modules>(stats2, mate2_bytes);
+
+    const bool got_mate1 = (stats1.num_reads > num_pairs);
+    const bool got_mate2 = (stats2.num_reads > num_pairs);
+    if (got_mate1 != got_mate2)
+      throw runtime_error("mates have different numbers of reads after " +
+                          to_string(num_pairs) + " pairs in " +
+                          in1.filename + (interleaved ? "" :
+                                          " and " + in2->filename));
+    if (!got_mate1)
+      return;
+
+    // mates are sampled together since they have the same read numbers
+    if (do_read)
+      pairs.add_pair(mate1_length,
+                     interleaved ? mate1_bases.data() : in1.buffer,
+                     std::min(mate1_length, in1.buffer_size),
+                     mate2_in.read_pos, mate2_in.buffer,
+                     std::min(mate2_in.read_pos, mate2_in.buffer_size));
+    else
+      pairs.add_skipped_pair();
+    report();
+  }
+}
+
+static void
+set_reader_threads(FastqReader &, const size_t) {}
+
+static void
+set_reader_threads(GzFastqReader &in, const size_t num_threads) {
+  in.set_num_threads(num_threads);
+}
+
+// Same as read_stream_into_stats for the two mates of paired-end reads.
+// Interleaved mates are read from mate1 by a single reader
+template <typename T> void
+read_pair_into_stats(FalcoConfig &config1, FalcoConfig &config2,
+                     FastqStats &stats1, FastqStats &stats2,
+                     PairStats &pairs, const size_t pipeline,
+                     const size_t num_threads, const bool interleaved) {
+  T in1(config1, FastqStats::SHORT_READ_THRESHOLD);
+  std::unique_ptr<T> in2(interleaved ? NULL :
+                         new T(config2, FastqStats::SHORT_READ_THRESHOLD));
+  set_reader_threads(in1, num_threads);
+  in1.keep_bases = true;
+  const size_t file_size = in1.load();
+  if (!interleaved) {
+    set_reader_threads(*in2, num_threads);
+    in2->keep_bases = true;
+    in2->load();
+  }
+
+  const bool quiet = config1.quiet;
+  ProgressBar progress(file_size, "running falco");
+  if (!quiet)
+    progress.report(cerr, 0);
+  size_t tot_bytes_read = 0;
+  auto report = [&]() {
+    if (!quiet && progress.time_to_report(tot_bytes_read))
+      progress.report(cerr, tot_bytes_read);
+  };
+
+  switch (pipeline) {
+    case ReaderModules::all:
+      read_all_pairs<ReaderModules::all>(in1, in2.get(), stats1, stats2,
+        pairs, tot_bytes_read, report);
+      break;
+    case ReaderModules::no_kmer:
+      read_all_pairs<ReaderModules::no_kmer>(in1, in2.get(), stats1, stats2,
+        pairs, tot_bytes_read, report);
+      break;
+    case ReaderModules::quality_only:
+      read_all_pairs<ReaderModules::quality_only>(in1, in2.get(), stats1,
+        stats2, pairs, tot_bytes_read, report);
+      break;
+    default:
+      read_all_pairs<ReaderModules::dynamic>(in1, in2.get(), stats1, stats2,
+        pairs, tot_bytes_read, report);
+  }
+  if (!quiet)
     progress.report(cerr, file_size);
 
+  if (in1.tile_ignore)
+    config1.do_tile = false;
+  if (interleaved ? in1.tile_ignore : in2->tile_ignore)
+    config2.do_tile = false;
+}
+
+// key metrics of the run report, from the modules that have them
+template <typename T> static void
+add_key_metrics(const T &, RunReportSample &) {}
+
+static void
+add_key_metrics(const ModuleBasicStatistics &module,
+                RunReportSample &sample) {
+  sample.total_sequences = module.total_sequences;
+  sample.poor_quality = module.num_poor;
+  sample.min_read_length = module.min_read_length;
+  sample.max_read_length = module.max_read_length;
+  sample.gc_percent = module.avg_gc;
+}
+
+static void
+add_key_metrics(const ModuleSequenceDuplicationLevels &module,
+                RunReportSample &sample) {
+  sample.deduplicated_percent = module.get_total_deduplicated_pct();
 }
 
 // Write module content into html maker if requested
@@ -110,7 +591,9 @@ write_if_requested(T module,
                    const string &filename,
                    ostream &summary_txt,
                    ostream &qc_data_txt,
-                   HtmlMaker &html_maker) {
+                   HtmlMaker &html_maker,
+                   FileProfile *profile,
+                   RunReportSample *sample) {
   html_maker.put_comment(module.placeholder_cs, module.placeholder_ce,
                          requested);
 
@@ -124,12 +607,19 @@ write_if_requested(T module,
 
 
   // calculates module summary, mandatory before writing
+  ProfileTimer summarize_timer(profile, "module_summarize_seconds",
+                               T::module_name);
   module.summarize(stats);
+  summarize_timer.stop();
 
   // writes what was requested
+  ProfileTimer text_timer(profile, "seconds", "write_text");
   if (!skip_short_summary) module.write_short_summary(summary_txt, filename);
   if (!skip_text) module.write(qc_data_txt);
+  text_timer.stop();
   if (!skip_html) {
+    ProfileTimer html_timer(profile, "seconds", "render_html");
+
     // puts the module name
     html_maker.put_data(module.placeholder_name, T::module_name);
 
@@ -140,6 +630,11 @@ write_if_requested(T module,
     html_maker.put_data(module.placeholder_data,
                         module.html_data);
   }
+
+  if (sample != NULL) {
+    sample->grades.push_back(make_pair(T::module_name, module.grade));
+    add_key_metrics(module, *sample);
+  }
 }
 
 void
@@ -153,35 +648,27 @@ write_results(const FalcoConfig &falco_config,
               const string &outdir,
               const string &summary_filename,
               const string &data_filename,
-              const string &report_filename) {
-
-  // Here we open the short summary ofstream
-  ofstream summary_txt;
-  if (!skip_short_summary) {
-    const string summary_file =
-      (summary_filename.empty() ?
-      (outdir + "/" + file_prefix + "summary.txt") : (summary_filename));
-    summary_txt.open(summary_file.c_str(), std::ofstream::binary);
-
-    if (!summary_txt.good())
-      throw runtime_error("Failed to create output summary file: " + summary_file);
-
-    if (!falco_config.quiet)
-      log_process("Writing summary to " + summary_file);
-  }
-
-  // Here we open the full text summary
-  ofstream qc_data_txt;
+              const string &report_filename,
+              FileProfile *profile,
+              OutputWriter *writer,
+              RunReport *run_report) {
+
+  // outputs are rendered in memory and then written, by the writer thread
+  // if there is one, so this thread does not wait on the file system
+  const string summary_file =
+    (summary_filename.empty() ?
+    (outdir + "/" + file_prefix + "summary.txt") : (summary_filename));
+  ostringstream summary_txt;
+  if (!skip_short_summary && !falco_config.quiet)
+    log_process("Writing summary to " + summary_file);
+
+  // Here we start the full text summary
+  const string qc_data_file =
+    (data_filename.empty() ?
+     (outdir + "/" + file_prefix + "fastqc_data.txt") :
+     (data_filename));
+  ostringstream qc_data_txt;
   if (!skip_text) {
-    const string qc_data_file =
-      (data_filename.empty() ?
-       (outdir + "/" + file_prefix + "fastqc_data.txt") :
-       (data_filename));
-    qc_data_txt.open(qc_data_file.c_str(), std::ofstream::binary);
-
-    if (!qc_data_txt.good())
-      throw runtime_error("Failed to create output data file: " + qc_data_file);
-
     if (!falco_config.quiet)
       log_process("Writing text report to " + qc_data_file);
 
@@ -191,26 +678,22 @@ write_results(const FalcoConfig &falco_config,
       qc_data_txt << "##Call\t" << falco_config.call << "\n";
   }
 
-  // Here we open the html ostream and maker object
+  // Here we start the html and maker object
   HtmlMaker html_maker = HtmlMaker();
-  ofstream html;
+  const string html_file =
+    (report_filename.empty() ?
+     (outdir + "/" + file_prefix + "fastqc_report.html") :
+     (report_filename));
   if (!skip_html) {
-    // Decide html filename based on input
-    const string html_file =
-      (report_filename.empty() ? 
-       (outdir + "/" + file_prefix + "fastqc_report.html") :
-       (report_filename));
-
     if (!falco_config.quiet)
       log_process("Writing HTML report to " + html_file);
-
-    html.open(html_file.c_str(), std::ofstream::binary);
-    if (!html.good())
-      throw runtime_error("Failed to create output HTML report file: " + html_file);
-
     html_maker.put_file_details(falco_config);
   }
 
+  RunReportSample sample;
+  sample.filename = falco_config.filename;
+  RunReportSample *report_sample = (run_report == NULL) ? NULL : &sample;
+
   // Now we create modules if requested, summarize them and kill them
   //  Basic Statistics
   write_if_requested(ModuleBasicStatistics(falco_config),
@@ -219,7 +702,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
 
 
   //  Per base sequence quality
@@ -229,7 +712,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
 
   //  Per tile sequence quality
   write_if_requested(ModulePerTileSequenceQuality(falco_config),
@@ -238,7 +721,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
 
   //  Per sequence quality scores
   write_if_requested(ModulePerSequenceQualityScores(falco_config),
@@ -247,7 +730,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
 
   //  Per base sequence content
   write_if_requested(ModulePerBaseSequenceContent(falco_config),
@@ -256,7 +739,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
   //  Per sequence GC content
   write_if_requested(ModulePerSequenceGCContent(falco_config),
                      stats,
@@ -264,7 +747,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
 
   //  Per base N content
   write_if_requested(ModulePerBaseNContent(falco_config),
@@ -273,7 +756,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
 
   //  Sequence Length Distribution
   write_if_requested(ModuleSequenceLengthDistribution(falco_config),
@@ -282,7 +765,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
 
   //  Sequence Duplication Levels
   write_if_requested(ModuleSequenceDuplicationLevels(falco_config),
@@ -291,7 +774,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
 
   //  Overrepresented sequences
   write_if_requested(ModuleOverrepresentedSequences(falco_config),
@@ -300,7 +783,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
   //  Adapter Content
   write_if_requested(ModuleAdapterContent(falco_config),
                      stats,
@@ -308,7 +791,7 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
   //  Kmer Content
   write_if_requested(ModuleKmerContent(falco_config),
                      stats,
@@ -316,11 +799,26 @@ write_results(const FalcoConfig &falco_config,
                      skip_text, skip_html, skip_short_summary,
                      falco_config.filename_stripped,
                      summary_txt, qc_data_txt,
-                     html_maker);
+                     html_maker, profile, report_sample);
 
 
+  ostringstream html;
+  if (!skip_html) {
+    ProfileTimer html_timer(profile, "seconds", "render_html");
+    html_maker.write(html);
+  }
+
+  if (!skip_short_summary)
+    write_output_file(writer, summary_file, summary_txt.str(),
+                      "output summary file");
+  if (!skip_text)
+    write_output_file(writer, qc_data_file, qc_data_txt.str(),
+                      "output data file");
   if (!skip_html)
-    html << html_maker.html_boilerplate;
+    write_output_file(writer, html_file, html.str(),
+                      "output HTML report file");
+  if (run_report != NULL)
+    run_report->add_sample(sample);
 }
 
 inline bool
@@ -328,6 +826,147 @@ file_exists(const string &file_name) {
   return (access(file_name.c_str(), F_OK) == 0);
 }
 
+/******************* STATS SNAPSHOTS ******************************/
+static void
+write_snapshot_file(const FalcoConfig &falco_config, const FastqStats &stats,
+                    const string &snapshot_file) {
+  ofstream out(snapshot_file, std::ofstream::binary);
+  if (!out)
+    throw runtime_error("Failed to create stats snapshot file: " +
+                        snapshot_file);
+  if (!falco_config.quiet)
+    log_process("Writing stats snapshot to " + snapshot_file);
+  stats.write_snapshot(out);
+}
+
+// Adds up the snapshots written with -snapshot and writes the reports of
+// all of them together, named merged_*, without reading any reads
+static void
+merge_snapshot_files(FalcoConfig &falco_config,
+                     const vector<string> &snapshot_files,
+                     const bool skip_text, const bool skip_html,
+                     const bool skip_short_summary, const bool do_call,
+                     const string &outdir,
+                     const string &summary_filename,
+                     const string &data_filename,
+                     const string &report_filename,
+                     OutputWriter *writer, RunReport *run_report) {
+  FastqStats stats;
+  for (const string &snapshot_file : snapshot_files) {
+    if (!falco_config.quiet)
+      log_process("Merging stats snapshot " + snapshot_file);
+    ifstream in(snapshot_file, std::ifstream::binary);
+    if (!in)
+      throw runtime_error("cannot open stats snapshot: " + snapshot_file);
+    FastqStats snapshot_stats;
+    snapshot_stats.read_snapshot(in);
+    stats.merge(snapshot_stats);
+  }
+
+  falco_config.filename = falco_config.filename_stripped = "merged";
+
+  // inputs without tile information in their read names have no tiles
+  if (stats.tile_names.empty())
+    falco_config.do_tile = false;
+
+  stats.summarize();
+  write_results(falco_config, stats, skip_text, skip_html,
+                skip_short_summary, do_call, "merged_",
+                outdir.empty() ? "." : outdir,
+                summary_filename, data_filename, report_filename, NULL,
+                writer, run_report);
+}
+
+// Memory of the stats of a file or of a read group, with kmer counts for
+// reads up to the short read threshold and a full duplication table
+static size_t
+estimate_bytes_per_stats(const FalcoConfig &falco_config) {
+  size_t bytes = sizeof(FastqStats);
+  if (falco_config.do_kmer)
+    bytes += (FastqStats::SHORT_READ_THRESHOLD << Constants::bit_shift_kmer) *
+             sizeof(uint32_t);
+  if (falco_config.do_duplication || falco_config.do_overrepresented)
+    bytes += Constants::unique_reads_stop_counting *
+             (Constants::unique_reads_max_length + 4*sizeof(size_t));
+  return bytes;
+}
+
+// Memory a thread may need to read a file: the stats of the file and of
+// each of its num_groups read groups, and the buffers of the reader of
+// gzipped or SAM files, whichever is larger
+static size_t
+estimate_bytes_per_thread(const FalcoConfig &falco_config,
+                          const size_t num_groups) {
+  return (num_groups + 1)*estimate_bytes_per_stats(falco_config) +
+         std::max(GzDecompressor::max_buffered_bytes(),
+                  falco_config.sam_line_size);
+}
+
+// Fits the threads in the memory budget: the SAM line buffer is shrunk
+// first, down to its minimum, and then fewer threads are run
+static void
+fit_threads_to_memory_budget(FalcoConfig &falco_config,
+                             const size_t num_groups) {
+  const size_t budget = falco_config.memory_budget;
+  if (num_groups >= budget / estimate_bytes_per_stats(falco_config))
+    throw runtime_error("-memory of " + to_string(budget >> 20) + " MB is "
+                        "too small for the stats of " +
+                        to_string(num_groups) + " read groups, lower "
+                        "-max-groups or raise -memory");
+  const size_t bytes_per_thread = budget / falco_config.threads;
+  const size_t needed = estimate_bytes_per_thread(falco_config, num_groups);
+  if (needed > bytes_per_thread) {
+    const size_t excess = needed - bytes_per_thread;
+    falco_config.sam_line_size = (falco_config.sam_line_size > excess) ?
+      std::max(falco_config.sam_line_size - excess,
+               Constants::min_sam_line_size) :
+      Constants::min_sam_line_size;
+  }
+
+  const size_t min_bytes = estimate_bytes_per_thread(falco_config, num_groups);
+  const size_t max_threads = budget / min_bytes;
+  if (max_threads == 0)
+    throw runtime_error("-memory must be at least " +
+                        to_string((min_bytes >> 20) + 1) + " MB to read one "
+                        "file");
+  if (falco_config.threads > max_threads) {
+    if (!falco_config.quiet)
+      log_process("Running " + to_string(max_threads) + " threads instead of " +
+                  to_string(falco_config.threads) + " to fit in " +
+                  to_string(budget >> 20) + " MB of memory");
+    falco_config.threads = max_threads;
+  }
+}
+
+// Directory and name prefix of the outputs of a file. If outdir is empty
+// they go next to the input
+static void
+get_output_location(const FalcoConfig &falco_config, const string &outdir,
+                    string &cur_outdir, string &file_prefix) {
+  const string &filename = falco_config.filename;
+  string file_basename;
+  if (falco_config.is_stdin) {
+    cur_outdir = outdir.empty() ? "." : outdir;
+    file_basename = "stdin";
+  }
+  else if (outdir.empty()) {
+    const size_t last_slash_idx = filename.rfind('/');
+    // if file was given with relative path in the current dir, we set a dot
+    if (last_slash_idx == string::npos) {
+      cur_outdir = ".";
+      file_basename = filename;
+    }
+    else {
+      cur_outdir = filename.substr(0, last_slash_idx);
+      file_basename = filename.substr(last_slash_idx + 1);
+    }
+  }
+  else {
+    cur_outdir = outdir;
+  }
+  file_prefix = file_basename + "_";
+}
+
 // Basic struct to pass falco option which are not in falco_config to the threads
 // Probably not the best way to do this, but it works...
 // Include them in the falco_config object is probably a better idea...
@@ -337,50 +976,76 @@ struct args_struct {
      bool skip_html_arg;
      bool skip_short_summary_arg;
      bool do_call_arg;
+     size_t threads_per_file_arg;
+     string forced_file_format_arg;
+     bool snapshot_arg;
+     size_t follow_interval_arg;
+     size_t follow_timeout_arg;
+     bool profile_arg;
+     double converge_tolerance_arg;
+     size_t converge_checkpoints_arg;
+     const ResultCache *cache_arg;
+     OutputWriter *writer_arg;
+     RunReport *run_report_arg;
+     string group_by_arg;
+     size_t max_groups_arg;
 };
 
-// Function to prepare balanced chunks of files for the threads
-std::vector<std::vector<std::string>> 
-makeChunks(const std::vector<std::string>& filenames, size_t numChunks) {
-    // Calculate the average number of filenames per chunk
-    size_t averagePerChunk = filenames.size() / numChunks;
-    // Calculate the number of chunks that will have one additional filename
-    size_t extraChunks = filenames.size() % numChunks;
-    std::vector<std::vector<std::string>> chunks;
-    size_t currentIndex = 0;
-    for (size_t chunkIndex = 0; chunkIndex < numChunks; chunkIndex++) {
-        size_t chunkSize = averagePerChunk;
-        // Distribute the additional filenames across the chunks
-        if (chunkIndex < extraChunks) {
-            chunkSize++;
-        }
-        std::vector<std::string> chunk;
-        for (size_t i = 0; i < chunkSize; i++) {
-            chunk.push_back(filenames[currentIndex]);
-            currentIndex++;
-        }
-        chunks.push_back(chunk);
+// Writes the outputs of every group of reads of a file, named like those
+// of the file with the name of the group after the file name. Groups are
+// summarized and written by this thread and by idle threads of the
+// scheduler
+static void
+write_group_results(const FalcoConfig &falco_config, ReadGroups &groups,
+                    const string &file_prefix, const string &outdir,
+                    const struct args_struct &args,
+                    WorkScheduler &scheduler) {
+  if (!falco_config.quiet)
+    log_process("Writing reports of " + to_string(groups.size()) +
+                " read groups");
+
+  vector<std::exception_ptr> errors(groups.size());
+  scheduler.run_ranges(groups.size(), [&](const size_t i) {
+    try {
+      const string &name = groups.get_name(i);
+      FalcoConfig group_config(falco_config);
+      group_config.filename = falco_config.filename + " " + name;
+      group_config.filename_stripped =
+        falco_config.filename_stripped + " " + name;
+      const string group_prefix = file_prefix + name + "_";
+
+      FastqStats &stats = groups.get_stats(i);
+      if (args.snapshot_arg)
+        write_snapshot_file(group_config, stats,
+                            outdir + "/" + group_prefix + "falco.bin");
+      stats.summarize();
+      write_results(group_config, stats, args.skip_text_arg,
+                    args.skip_html_arg, args.skip_short_summary_arg,
+                    args.do_call_arg, group_prefix, outdir, "", "", "",
+                    NULL, args.writer_arg, args.run_report_arg);
     }
-    return chunks;
-}
-
+    catch (...) {
+      errors[i] = std::current_exception();
+    }
+  });
 
+  for (auto &e : errors)
+    if (e) std::rethrow_exception(e);
+}
 
 // File Processing function for multithreading support
 // Taken from main section 
 
-// TODO Need to implement error handling inside the function and a error report inside the main
 // Note that the FalcoConfig MUST be passed by value to prevent race condition between the threads
 void 
-processFile(FalcoConfig falco_config, const std::vector<std::string> &chunk, struct args_struct args) {
+processFile(FalcoConfig falco_config, const string &filename, const bool split,
+            struct args_struct args, WorkScheduler &scheduler) {
 
        // As we are running in multithread, the custom output name are not supported
-       // forced_file_format don't have to be overridden, but as there is no error handling
-       // it is better to not risk it for now
        string data_filename = "";
        string report_filename = "";
        string summary_filename = "";
-       string forced_file_format;
+       const string forced_file_format = args.forced_file_format_arg;
 
        // Could replace these by just calling args. in the rest of the function
        // But I'm lazy and I don't want to risk forgetting something
@@ -392,109 +1057,348 @@ processFile(FalcoConfig falco_config, const std::vector<std::string> &chunk, str
        const string outdir = args.outdir_arg;
        
 
-for (const auto &filename : chunk) {
-
       const time_point file_start_time = system_clock::now();
 
+      // stages of -profile, timed only if it was requested
+      std::unique_ptr<FileProfile> profile(
+        args.profile_arg ? new FileProfile(filename) : NULL);
+      ProfileTimer total_timer(profile.get(), "seconds", "total");
+      ReaderProfile *reader_profile = args.profile_arg ? &profile->reader : NULL;
+
       falco_config.filename = filename;
 
       // if format was not provided, we have to guess it by the filename
       falco_config.format = forced_file_format;
 
       /****************** BEGIN PROCESSING CONFIG ******************/
-      // define file type, read limits, adapters, contaminants and fail
-      // early if any of the required files is not present
-      //
+      // define file type. Limits, adapters and contaminants were read once
+      // for all files before any of them started
+      ProfileTimer setup_timer(profile.get(), "seconds", "setup");
       falco_config.setup();
+      setup_timer.stop();
+
+      // checks for modules that are off are compiled out of the reader
+      // for the most common sets of modules
+      const size_t pipeline = ReaderModules::pipeline_for(falco_config);
 
       /****************** END PROCESSING CONFIG *******************/
       if (!falco_config.quiet)
         log_process("Started reading file " + falco_config.filename);
       FastqStats stats; // allocate all space to summarize data
 
+      string cur_outdir;
+      string file_prefix;
+      get_output_location(falco_config, outdir, cur_outdir, file_prefix);
+
+      // with -group-by, readers count the reads of each group in stats of
+      // its own, and stats is left empty
+      std::unique_ptr<ReadGroups> groups(args.group_by_arg.empty() ? NULL :
+        new ReadGroups(args.group_by_arg, args.max_groups_arg));
+
+      // inputs that did not change since a run with the same config are
+      // restored from the cache instead of read
+      const ResultCache *cache = args.cache_arg;
+      const string cache_key = (cache != NULL) ? cache->get_key(filename) : "";
+      const bool cache_hit = !cache_key.empty() && cache->load(cache_key, stats);
+
       // Initializes a reader given the file format
-      if (falco_config.is_sam) {
+      ProfileTimer read_timer(profile.get(), "seconds", "read");
+      const size_t major_faults_before = get_major_page_faults();
+      std::unique_ptr<ConvergenceTracker> convergence(
+        (args.converge_tolerance_arg > 0.0) ?
+        new ConvergenceTracker(args.converge_tolerance_arg,
+                               args.converge_checkpoints_arg) : NULL);
+      const bool follow = (args.follow_interval_arg > 0);
+      if (follow && (!falco_config.is_fastq || falco_config.is_stdin))
+        throw runtime_error("-follow needs an uncompressed FASTQ file: " +
+                            filename);
+
+      if (cache_hit) {
+        if (!falco_config.quiet)
+          log_process("restored stats from cache entry " +
+                      cache->entry_file(cache_key));
+
+        // inputs without tile information in their read names have no tiles
+        if (stats.tile_names.empty())
+          falco_config.do_tile = false;
+      }
+      else if (follow) {
+        if (!falco_config.quiet)
+          log_process("following file as uncompressed FASTQ format");
+
+        // reports of the reads so far are written from a copy of the stats,
+        // since summarizing changes them
+        follow_fastq_into_stats(stats, falco_config, pipeline,
+          args.follow_interval_arg, args.follow_timeout_arg,
+          [&](const FastqStats &partial, const FalcoConfig &partial_config) {
+            std::unique_ptr<FastqStats> summary(new FastqStats(partial));
+            summary->summarize();
+            write_results(partial_config, *summary, skip_text, skip_html,
+                          skip_short_summary, do_call, file_prefix,
+                          cur_outdir, summary_filename, data_filename,
+                          report_filename, NULL, args.writer_arg,
+                          args.run_report_arg);
+          }, reader_profile);
+      }
+      else if (falco_config.is_sam) {
         if (!falco_config.quiet)
           log_process("reading file as SAM format");
         SamReader in(falco_config, stats.SHORT_READ_THRESHOLD);
-        read_stream_into_stats(in, stats, falco_config);
+        in.profile = reader_profile;
+        in.groups = groups.get();
+        read_stream_into_stats(in, stats, falco_config, pipeline,
+                               convergence.get());
       }
 #ifdef USE_HTS
       else if (falco_config.is_bam) {
         if (!falco_config.quiet)
           log_process("reading file as BAM format");
         BamReader in(falco_config, stats.SHORT_READ_THRESHOLD);
-        read_stream_into_stats(in, stats, falco_config);
+        in.set_num_threads(args.threads_per_file_arg);
+        in.profile = reader_profile;
+        in.groups = groups.get();
+        read_stream_into_stats(in, stats, falco_config, pipeline,
+                               convergence.get());
       }
 #endif
 
-      else if (falco_config.is_fastq_gz) {
+      // standard input cannot be mapped, so it is read in chunks like the
+      // output of the gzip decompressor
+      else if (falco_config.is_fastq_gz ||
+               (falco_config.is_fastq && falco_config.is_stdin)) {
         if (!falco_config.quiet)
-          log_process("reading file as gzipped FASTQ format");
+          log_process(falco_config.is_fastq_gz ?
+                      "reading file as gzipped FASTQ format" :
+                      "reading file as uncompressed FASTQ format");
         GzFastqReader in(falco_config, stats.SHORT_READ_THRESHOLD);
-        read_stream_into_stats(in,stats,falco_config);
+        in.set_num_threads(args.threads_per_file_arg);
+        in.profile = reader_profile;
+        in.groups = groups.get();
+        read_stream_into_stats(in, stats, falco_config, pipeline,
+                               convergence.get());
       }
-      else if (falco_config.is_fastq) {
+      else if (falco_config.is_fastq && convergence) {
         if (!falco_config.quiet)
-          log_process("reading file as uncompressed FASTQ format");
+          log_process("reading file as uncompressed FASTQ format in "
+                      "evenly spaced blocks");
         FastqReader in(falco_config, stats.SHORT_READ_THRESHOLD);
-        read_stream_into_stats(in, stats, falco_config);
+        in.profile = reader_profile;
+        read_fastq_blocks_into_stats(in, stats, falco_config, pipeline,
+                                     *convergence);
+      }
+      else if (falco_config.is_fastq) {
+        // idle threads of the scheduler help reading large files, which
+        // are read whole if reads are grouped
+        const vector<FastqRange> ranges = (split && !groups) ?
+          split_fastq_file(filename, scheduler.num_threads,
+                           Constants::min_bytes_per_split) :
+          vector<FastqRange>();
+
+        if (ranges.size() > 1) {
+          if (!falco_config.quiet)
+            log_process("reading file as uncompressed FASTQ format in " +
+                        to_string(ranges.size()) + " ranges");
+          read_split_fastq_into_stats(ranges, stats, falco_config, pipeline,
+                                      scheduler, reader_profile);
+        }
+        else {
+          if (!falco_config.quiet)
+            log_process("reading file as uncompressed FASTQ format");
+          FastqReader in(falco_config, stats.SHORT_READ_THRESHOLD);
+          in.profile = reader_profile;
+          in.groups = groups.get();
+          read_stream_into_stats(in, stats, falco_config, pipeline);
+        }
       }
       else {
         throw runtime_error("Cannot recognize file format for file "
                             + falco_config.filename);
       }
 
+      read_timer.stop();
+
       if (!falco_config.quiet) {
         log_process("Finished reading file");
+        if (convergence && convergence->converged())
+          log_process("Metrics converged after " +
+                      to_string(stats.num_reads) + " reads");
+        else if (convergence)
+          log_process("Metrics did not converge before the end of the file");
       }
 
-      stats.summarize();
+      if (profile) {
+        const ReaderProfile &r = profile->reader;
+        profile->add("seconds", "input_wait", r.input_wait_seconds);
+        profile->add("seconds", "duplication_table", r.table_seconds());
+        profile->add("counters", "reads", stats.num_reads);
+        struct stat st;
+        if (!falco_config.is_stdin && stat(filename.c_str(), &st) == 0)
+          profile->add("counters", "bytes_read", st.st_size);
+        profile->add("counters", "bytes_decompressed", r.bytes_decompressed);
+        profile->add("counters", "major_page_faults",
+                     get_major_page_faults() - major_faults_before);
+        profile->add("counters", "duplication_table_lookups",
+                     r.num_table_lookups);
+        profile->add("counters", "duplication_table_entries",
+                     stats.sequence_count.size());
+        profile->add("counters", "duplication_table_slots",
+                     stats.sequence_count.num_slots());
+        if (stats.sequence_count.num_slots() > 0)
+          profile->add("counters", "duplication_table_load_factor",
+                       static_cast<double>(stats.sequence_count.size()) /
+                       stats.sequence_count.num_slots());
+      }
 
-       // if oudir is empty we will set it as the filename path
-      string cur_outdir;
-      string file_basename;
-      if (outdir.empty()) {
-        const size_t last_slash_idx = filename.rfind('/');
-        // if file was given with relative path in the current dir, we set a dot
-        if (last_slash_idx == string::npos) {
-          cur_outdir = ".";
-          file_basename = filename;
-        }
-        else {
-          cur_outdir = falco_config.filename.substr(0, last_slash_idx);
-          file_basename = falco_config.filename.substr(last_slash_idx + 1);
-        }
+      if (!cache_key.empty() && !cache_hit) {
+        if (!falco_config.quiet)
+          log_process("Writing cache entry " + cache->entry_file(cache_key));
+        cache->store(cache_key, stats);
+      }
+
+      if (groups) {
+        write_group_results(falco_config, *groups, file_prefix, cur_outdir,
+                            args, scheduler);
       }
       else {
-        cur_outdir = outdir;
+        // the counts before they are summarized, for falco merge
+        if (args.snapshot_arg)
+          write_snapshot_file(falco_config, stats,
+                              cur_outdir + "/" + file_prefix + "falco.bin");
+
+        ProfileTimer summarize_timer(profile.get(), "seconds",
+                                     "summarize_stats");
+        stats.summarize();
+        summarize_timer.stop();
+        write_results(falco_config, stats, skip_text, skip_html,
+                     skip_short_summary, do_call, file_prefix, cur_outdir,
+                     summary_filename, data_filename, report_filename,
+                     profile.get(), args.writer_arg, args.run_report_arg);
       }
 
-      // Write results
-//      const string file_prefix = (all_seq_filenames.size() == 1) ?
-//                                 ("") : (file_basename + "_");
-      const string file_prefix = file_basename + "_";
-      write_results(falco_config, stats, skip_text, skip_html,
-                   skip_short_summary, do_call, file_prefix, cur_outdir,
-                   summary_filename, data_filename, report_filename);
+      if (profile) {
+        total_timer.stop();
+        profile->add("counters", "peak_rss_bytes", get_peak_rss_bytes());
+        const string profile_file =
+          cur_outdir + "/" + file_prefix + "falco_profile.json";
+        ofstream out(profile_file, std::ofstream::binary);
+        if (!out.good())
+          throw runtime_error("Failed to create profile file: " + profile_file);
+        if (!falco_config.quiet)
+          log_process("Writing profile to " + profile_file);
+        profile->write_json(out);
+      }
 
       /************************** TIME SUMMARY *****************************/
       if (!falco_config.quiet)
         cerr << "Elapsed time for file " << filename << ": "
              << get_seconds_since(file_start_time) << "s" << endl;
-    }
-//  }
-  //catch (const runtime_error &e) {
-  //  cerr << e.what() << endl;
-  //  return EXIT_FAILURE;
-  // }
-  //return EXIT_SUCCESS;
+}
+
+// Processes the two mates of paired-end reads in one pass, writing the
+// outputs of each mate as if it was read on its own and the pair metrics
+// next to those of the first mate. mate2 is empty if the mates of each
+// pair are interleaved in mate1.
+void
+processPair(FalcoConfig falco_config, const string &mate1,
+            const string &mate2, struct args_struct args) {
+  const time_point file_start_time = system_clock::now();
+  const bool interleaved = mate2.empty();
+
+  FalcoConfig config1(falco_config);
+  FalcoConfig config2(falco_config);
+  config1.filename = mate1;
+  config2.filename = interleaved ? mate1 : mate2;
+  config1.format = config2.format = args.forced_file_format_arg;
+  config1.setup();
+  config2.setup();
+
+  if (config1.is_stdin || config2.is_stdin ||
+      !(config1.is_fastq || config1.is_fastq_gz) ||
+      !(config2.is_fastq || config2.is_fastq_gz))
+    throw runtime_error("-paired needs FASTQ files: " + mate1 +
+                        (interleaved ? "" : ", " + mate2));
+  if (config1.is_fastq_gz != config2.is_fastq_gz)
+    throw runtime_error("mates must be both gzipped or both uncompressed: " +
+                        mate1 + ", " + mate2);
+
+  const size_t pipeline = ReaderModules::pipeline_for(config1);
+  if (!falco_config.quiet)
+    log_process("Started reading pairs of " + mate1 +
+                (interleaved ? " (interleaved)" : " and " + mate2));
+
+  std::unique_ptr<FastqStats> stats1(new FastqStats);
+  std::unique_ptr<FastqStats> stats2(new FastqStats);
+  PairStats pairs;
+  if (config1.is_fastq_gz)
+    read_pair_into_stats<GzFastqReader>(config1, config2, *stats1, *stats2,
+      pairs, pipeline, args.threads_per_file_arg, interleaved);
+  else
+    read_pair_into_stats<FastqReader>(config1, config2, *stats1, *stats2,
+      pairs, pipeline, args.threads_per_file_arg, interleaved);
+
+  if (!falco_config.quiet)
+    log_process("Finished reading " + to_string(pairs.num_pairs) + " pairs");
+
+  // interleaved mates are told apart by an R1 or R2 after the file name
+  string outdir1, prefix1, outdir2, prefix2;
+  get_output_location(config1, args.outdir_arg, outdir1, prefix1);
+  get_output_location(config2, args.outdir_arg, outdir2, prefix2);
+  const string pair_prefix = prefix1;
+  if (interleaved) {
+    prefix1 += "R1_";
+    prefix2 += "R2_";
+
+    // the file name is not in the reports, only in the run report rows
+    config1.filename = mate1 + " R1";
+    config2.filename = mate1 + " R2";
+  }
+
+  FalcoConfig *configs[] = {&config1, &config2};
+  FastqStats *stats[] = {stats1.get(), stats2.get()};
+  const string *outdirs[] = {&outdir1, &outdir2};
+  const string *prefixes[] = {&prefix1, &prefix2};
+  for (size_t i = 0; i < 2; ++i) {
+    if (args.snapshot_arg)
+      write_snapshot_file(*configs[i], *stats[i],
+                          *outdirs[i] + "/" + *prefixes[i] + "falco.bin");
+    stats[i]->summarize();
+    write_results(*configs[i], *stats[i], args.skip_text_arg,
+                  args.skip_html_arg, args.skip_short_summary_arg,
+                  args.do_call_arg, *prefixes[i], *outdirs[i], "", "", "",
+                  NULL, args.writer_arg, args.run_report_arg);
+  }
+
+  const string pair_file = outdir1 + "/" + pair_prefix + "pair_data.txt";
+  if (!falco_config.quiet)
+    log_process("Writing pair metrics to " + pair_file);
+  ostringstream pair_txt;
+  pair_txt << "##Falco\t" + FalcoConfig::FalcoVersion + "\n";
+  if (args.do_call_arg)
+    pair_txt << "##Call\t" << falco_config.call << "\n";
+  pairs.write(pair_txt, config1.filename_stripped,
+              interleaved ? config1.filename_stripped :
+                            config2.filename_stripped);
+  write_output_file(args.writer_arg, pair_file, pair_txt.str(),
+                    "pair metrics file");
+
+  if (!falco_config.quiet)
+    cerr << "Elapsed time for pairs of " << mate1 << ": "
+         << get_seconds_since(file_start_time) << "s" << endl;
 }
 
 
 int main(int argc, const char **argv) {
 
   try {
+    // "falco merge" takes the same options, and the snapshots written with
+    // -snapshot instead of sequence files
+    const bool merge_snapshots = (argc > 1 && string(argv[1]) == "merge");
+    vector<const char*> arg_values(argv, argv + argc);
+    if (merge_snapshots)
+      arg_values.erase(begin(arg_values) + 1);
+    argc = arg_values.size();
+    argv = arg_values.data();
+
     static const string FALCO_VERSION = "falco " + FalcoConfig::FalcoVersion;
     bool help = false;
     bool version = false;
@@ -504,6 +1408,20 @@ int main(int argc, const char **argv) {
     bool skip_html = false;
     bool skip_short_summary = false;
     bool do_call = false;
+    bool write_snapshots = false;
+    size_t follow_interval = 0;
+    size_t follow_timeout = 600;
+    bool write_profile = false;
+    double converge_tolerance = 0.0;
+    size_t converge_checkpoints = 5;
+    string cache_dir;
+    size_t memory_mb = 0;
+    bool pin_threads = false;
+    bool paired = false;
+    bool interleaved = false;
+    string run_report_prefix;
+    string group_by;
+    size_t max_groups = 1000;
 
     // a tmp boolean to keep compatibility with FastQC
     bool tmp_compatibility_only = false;
@@ -525,7 +1443,8 @@ int main(int argc, const char **argv) {
     /****************** COMMAND LINE OPTIONS ********************/
     OptionParser opt_parse(argv[0],
                               "A high throughput sequence QC analysis tool",
-                              "<seqfile1> <seqfile2> ...");
+                              "<seqfile1> <seqfile2> ... (- reads from standard input)\n"
+                              "       or: falco merge [options] <seqfile1>_falco.bin ...");
     opt_parse.set_show_defaults();
 
 
@@ -623,8 +1542,12 @@ int main(int argc, const char **argv) {
         "simultaneously.  Each thread will be allocated 250MB of "
         "memory so you shouldn't run more threads than your "
         "available memory will cope with, and not more than "
-        "6 threads on a 32 bit machine, should be equal or "
-        "greater than the number of files"
+        "6 threads on a 32 bit machine. FALCO-SPECIFIC: files are "
+        "processed largest first, and threads that run out of files "
+        "help read parts of large uncompressed FASTQ files. If there "
+        "are more threads than files, the remaining threads also "
+        "decompress blocks of each BGZF-compressed FASTQ or BAM file. "
+        "With -memory, fewer threads are run if they do not fit in it"
         , false, falco_config.threads);
 
     opt_parse.add_opt("-contaminants", 'c',
@@ -715,6 +1638,104 @@ int main(int argc, const char **argv) {
         "[Falco only] Do not create FastQC summary file"
         , false, skip_short_summary);
 
+    opt_parse.add_opt("snapshot", '\0',
+        "[Falco only] Also write the raw counts of each file to a binary "
+        "snapshot named like the other outputs with a falco.bin suffix. "
+        "'falco merge' adds up snapshots and writes one report for all "
+        "of them without reading the sequences again"
+        , false, write_snapshots);
+
+    opt_parse.add_opt("follow", '\0',
+        "[Falco only] Read uncompressed FASTQ files that are still being "
+        "written, and write the reports of the reads so far every this "
+        "many seconds (0 reads files once)"
+        , false, follow_interval);
+
+    opt_parse.add_opt("follow-timeout", '\0',
+        "[Falco only] With -follow, stop reading a file and write its "
+        "final reports once no record was appended to it for this many "
+        "seconds"
+        , false, follow_timeout);
+
+    opt_parse.add_opt("profile", '\0',
+        "[Falco only] Also write the time spent reading, parsing, counting "
+        "duplicates, summarizing each module and rendering the report of "
+        "each file, with counters of bytes, reads and memory, to a JSON "
+        "file named like the other outputs with a falco_profile.json suffix"
+        , false, write_profile);
+
+    opt_parse.add_opt("converge", '\0',
+        "[Falco only] Stop reading a file once its per base quality "
+        "quartiles, base content, GC content distribution and duplication "
+        "rate change by at most this much between checks, made every "
+        "100000 reads. Quality quartiles are relative to 40 Phred values. "
+        "Uncompressed FASTQ files are read in evenly spaced blocks, other "
+        "inputs from the start (0 reads whole files)"
+        , false, converge_tolerance);
+
+    opt_parse.add_opt("cache", '\0',
+        "[Falco only] Directory of a cache of the stats of inputs, from "
+        "which reports of files that did not change since a run with the "
+        "same configuration and options are written again without "
+        "reading them. Files are told apart by their size, modification "
+        "time and sampled blocks of their contents"
+        , false, cache_dir);
+
+    opt_parse.add_opt("converge-checkpoints", '\0',
+        "[Falco only] With -converge, number of consecutive checks in "
+        "which the metrics must stay within the tolerance"
+        , false, converge_checkpoints);
+
+    opt_parse.add_opt("memory", '\0',
+        "[Falco only] Megabytes of memory all threads may use. Each thread "
+        "needs up to about 80 MB, or 110 MB if kmers are counted. The line "
+        "buffer of SAM files is shrunk to fit the budget, down to 16 MB, "
+        "before fewer threads than given with -t are run. With -group-by, "
+        "each of the groups of a file needs as much as the stats of a "
+        "thread (0 for no limit)"
+        , false, memory_mb);
+
+    opt_parse.add_opt("pin", '\0',
+        "[Falco only] Pin each thread to a core, spreading threads over the "
+        "NUMA nodes of the machine, so the counts each thread allocates are "
+        "in the memory of its node"
+        , false, pin_threads);
+
+    opt_parse.add_opt("paired", '\0',
+        "[Falco only] Inputs are paired-end FASTQ files given as the two "
+        "mates of each pair one after the other. Both mates are read in "
+        "one pass, and metrics of the pairs are written to a file named "
+        "like the outputs of the first mate with a pair_data.txt suffix"
+        , false, paired);
+
+    opt_parse.add_opt("interleaved", '\0',
+        "[Falco only] With -paired, each input has the two mates of each "
+        "pair one after the other, and the outputs of the mates end "
+        "with R1 and R2"
+        , false, interleaved);
+
+    opt_parse.add_opt("run-report", '\0',
+        "[Falco only] Also write one report of all inputs, with the grade "
+        "of each module and key metrics of each input, to PREFIX.tsv, "
+        "PREFIX.json and PREFIX.html. Combine with -skip-data, "
+        "-skip-report and -skip-summary to write only this report"
+        , false, run_report_prefix);
+
+    opt_parse.add_opt("group-by", '\0',
+        "[Falco only] Write reports for each group of reads of every input "
+        "instead of one for the whole input, from a single pass over it. "
+        "KEY is name, for the barcode at the end of the read name, or a SAM "
+        "tag like RG or BC, which FASTQ files may have in the comment of "
+        "the name. Outputs of a group are named like those of the input "
+        "with the group after the file name"
+        , false, group_by);
+
+    opt_parse.add_opt("max-groups", '\0',
+        "[Falco only] With -group-by, the reads of groups seen after this "
+        "many are counted together in a group named other. Each group needs "
+        "about 1 MB and its duplication table"
+        , false, max_groups);
+
     opt_parse.add_opt("data-filename", 'D',
         "[NOT SUPPORTED IN MTT VERSION] "
         "Specify filename for FastQC data output (TXT). "
@@ -771,7 +1792,7 @@ int main(int argc, const char **argv) {
       return EXIT_SUCCESS;
     }
 
-    if (leftover_args.size() > 1 &&
+    if (leftover_args.size() > 1 && !merge_snapshots &&
         (!summary_filename.empty() ||
          !report_filename.empty() ||
          !data_filename.empty())) {
@@ -818,9 +1839,13 @@ int main(int argc, const char **argv) {
     const vector<string> all_seq_filenames(leftover_args);
 
     // check if all filenames exist
+    // "-" is standard input, which can only be read once
     bool all_files_exist = true;
+    if (count(begin(all_seq_filenames), end(all_seq_filenames), "-") > 1)
+      throw runtime_error("standard input (-) can only be given once");
     for (size_t i = 0; i < all_seq_filenames.size(); ++i) {
-      if (!file_exists(all_seq_filenames[i])) {
+      if (all_seq_filenames[i] != "-" &&
+          !file_exists(all_seq_filenames[i])) {
         cerr << "ERROR! File does not exist: " << all_seq_filenames[i] << endl;
         all_files_exist = false;
       }
@@ -838,62 +1863,171 @@ int main(int argc, const char **argv) {
      argpass_struct.skip_short_summary_arg = skip_short_summary;
      argpass_struct.do_call_arg = do_call;
      argpass_struct.outdir_arg = outdir;
+     argpass_struct.threads_per_file_arg = 1;
+     argpass_struct.forced_file_format_arg = forced_file_format;
+     argpass_struct.snapshot_arg = write_snapshots;
+     argpass_struct.follow_interval_arg = follow_interval;
+     argpass_struct.follow_timeout_arg = follow_timeout;
+     argpass_struct.profile_arg = write_profile;
+     argpass_struct.converge_tolerance_arg = converge_tolerance;
+     argpass_struct.converge_checkpoints_arg = converge_checkpoints;
+     argpass_struct.cache_arg = NULL;
+     argpass_struct.group_by_arg = group_by;
+     argpass_struct.max_groups_arg = max_groups;
+
+    // reports are written by a thread of their own while reads are counted,
+    // and the run report gets a row per input as each one finishes
+    OutputWriter writer;
+    argpass_struct.writer_arg = &writer;
+    std::unique_ptr<RunReport> run_report;
+    if (!run_report_prefix.empty()) {
+      vector<string> report_rows;
+      if (merge_snapshots)
+        report_rows.push_back("merged");
+      else if (paired && interleaved)
+        for (const string &filename : all_seq_filenames) {
+          report_rows.push_back(filename + " R1");
+          report_rows.push_back(filename + " R2");
+        }
+      else
+        report_rows = all_seq_filenames;
+      run_report.reset(new RunReport(report_rows));
+    }
+    argpass_struct.run_report_arg = run_report.get();
 
     /****************** END COMMAND LINE OPTIONS ********************/
     // Command-line argument parsing as before...
 
 
-    // to prevent empty chunks, threads will be adjusted to number of samples
-    if ( falco_config.threads > all_seq_filenames.size() ){
-        cerr << "[WARNING] You selected more threads than available samples\n" 
-        "Forcing thread to number of samples" << endl;
-         falco_config.threads = all_seq_filenames.size();
+    // files are read largest first by a pool of threads. Threads left
+    // when there are more threads than files inflate BGZF blocks of each
+    // gzipped FASTQ or BAM file or read ranges of large uncompressed files
+    if (falco_config.threads == 0)
+      falco_config.threads = 1;
+
+    // files being followed wait for each other's writers, so each gets
+    // its own thread
+    if (follow_interval > 0)
+      falco_config.threads = std::max(falco_config.threads,
+                                      all_seq_filenames.size());
+
+    // read limits, adapters and contaminants and fail early if any of the
+    // required files is not present. Each file gets a copy of the config
+    // that shares them
+    falco_config.read_config_files();
+
+    // the modules that run set how much memory each thread needs
+    falco_config.memory_budget = memory_mb << 20;
+    if (falco_config.memory_budget > 0) {
+      // besides the stats of the file, each key may get a group, and
+      // reads may also be unassigned or in the group of other keys. The
+      // max keeps the count from wrapping around with huge -max-groups
+      fit_threads_to_memory_budget(falco_config, group_by.empty() ? 0 :
+                                   std::max(max_groups, max_groups + 2));
+      if (follow_interval > 0 &&
+          falco_config.threads < all_seq_filenames.size())
+        throw runtime_error("-memory is too small to follow " +
+                            to_string(all_seq_filenames.size()) + " files");
+    }
+    argpass_struct.threads_per_file_arg =
+      std::max(falco_config.threads / all_seq_filenames.size(),
+               static_cast<size_t>(1));
+
+    if (merge_snapshots) {
+      merge_snapshot_files(falco_config, all_seq_filenames, skip_text,
+                           skip_html, skip_short_summary, do_call, outdir,
+                           summary_filename, data_filename, report_filename,
+                           &writer, run_report.get());
+      if (run_report)
+        run_report->write(run_report_prefix, &writer);
+      writer.finish();
+      return EXIT_SUCCESS;
+    }
+
+    // pairs are scheduled by their first mate, and each one is read by a
+    // single thread, whose two readers share the threads of the files
+    if (converge_tolerance < 0.0)
+      throw runtime_error("-converge must be at least zero");
+    if (converge_tolerance > 0.0 && follow_interval > 0)
+      throw runtime_error("-converge cannot be used with -follow");
+    if (!cache_dir.empty() && follow_interval > 0)
+      throw runtime_error("-cache cannot be used with -follow");
+    if (!cache_dir.empty() && paired)
+      throw runtime_error("-cache cannot be used with -paired");
+    if (!group_by.empty()) {
+      if (!ReadGroups::is_valid_key(group_by))
+        throw runtime_error("-group-by needs name or a SAM tag of two "
+                            "characters, like RG or BC: " + group_by);
+      if (max_groups == 0)
+        throw runtime_error("-max-groups must be at least one");
+      if (follow_interval > 0 || converge_tolerance > 0.0 || paired ||
+          !cache_dir.empty() || write_profile)
+        throw runtime_error("-group-by cannot be used with -follow, "
+                            "-converge, -paired, -cache or -profile");
+    }
+
+    // options that change how reads are counted are part of every key
+    std::unique_ptr<ResultCache> cache;
+    if (!cache_dir.empty()) {
+      std::ostringstream options;
+      options << "format=" << forced_file_format
+              << " subsample=" << falco_config.read_step
+              << " trim=" << falco_config.trim_value_3p
+              << " converge=" << converge_tolerance
+              << "/" << converge_checkpoints;
+      cache.reset(new ResultCache(cache_dir, falco_config, options.str()));
+      argpass_struct.cache_arg = cache.get();
     }
 
-    // if single threaded, just launch the function with all the files
-    if (falco_config.threads == 1){
-        processFile(falco_config, all_seq_filenames, argpass_struct);
-    }else {
-         std::vector<std::vector<std::string>> fileChunks = makeChunks(all_seq_filenames, falco_config.threads);
-      // This commented out section was the basic chunk creation method, it was not balanced
-      // so the last chunk was always much bigger than the others
-      // new makeChunks now make balanced chunks for each threads
-
-      // Split the list of input files into smaller chunks (e.g., 4 chunks)
-      // std::size_t numChunks = falco_config.threads;
-      // std::size_t chunkSize = all_seq_filenames.size() / numChunks;
-      // cout << "Threads chunk size: " << chunkSize << "\n"; // DEBUGLINE
-      // return EXIT_SUCCESS; // DEBUGLINE
-      // std::vector<std::vector<std::string>> fileChunks;
-      // auto it = all_seq_filenames.begin();
-      // for (std::size_t i = 0; i < numChunks - 1; ++i) {
-      //     std::vector<std::string> chunk(it, it + chunkSize);
-      //     fileChunks.push_back(chunk);
-      //     it += chunkSize;
-      // }
-      // std::vector<std::string> lastChunk(it, all_seq_filenames.end());
-      // fileChunks.push_back(lastChunk);
-
-      // for (const auto &chunk : fileChunks){
-      //     cout << "Chunk size: " << chunk.size() << "\n";
-      // }
-
-    // Create a vector to hold threads
-       std::vector<std::thread> threads;
-    // Launch threads, each processing a chunk of input files
-       for (const auto &chunk : fileChunks) {
-           threads.push_back(std::thread([&falco_config, &chunk, &argpass_struct]() {
-                 // falco_config are passed by value so the thread use a copy of the falco_config object
-                 // and prevent race condition as the processFile function actually modify the object
-                 processFile(falco_config, chunk, argpass_struct);
-           }));
-       }
-
-       // Wait for all threads to finish their execution
-       for (auto &thread : threads) {
-           thread.join();
-       }
+    if (paired) {
+      if (follow_interval > 0)
+        throw runtime_error("-follow cannot be used with -paired");
+      if (converge_tolerance > 0.0)
+        throw runtime_error("-converge cannot be used with -paired");
+      vector<string> first_mates;
+      std::unordered_map<string, string> second_mate;
+      if (!interleaved && all_seq_filenames.size() % 2 != 0)
+        throw runtime_error("-paired needs two files for each pair, but " +
+                            to_string(all_seq_filenames.size()) +
+                            " were given");
+      const size_t step = interleaved ? 1 : 2;
+      for (size_t i = 0; i < all_seq_filenames.size(); i += step) {
+        const string &mate1 = all_seq_filenames[i];
+        if (second_mate.count(mate1) > 0)
+          throw runtime_error("file given twice: " + mate1);
+        first_mates.push_back(mate1);
+        second_mate[mate1] = interleaved ? "" : all_seq_filenames[i + 1];
+      }
+
+      argpass_struct.threads_per_file_arg =
+        std::max(falco_config.threads / (2 * first_mates.size()),
+                 static_cast<size_t>(1));
+      WorkScheduler scheduler(first_mates, falco_config.threads, pin_threads);
+      scheduler.run([&](const string &mate1, const bool) {
+        processPair(falco_config, mate1, second_mate.at(mate1),
+                    argpass_struct);
+      });
+      if (!falco_config.quiet && scheduler.num_threads > 1)
+        scheduler.report_timing(cerr);
+      if (run_report)
+        run_report->write(run_report_prefix, &writer);
+      writer.finish();
+      return EXIT_SUCCESS;
     }
+
+    WorkScheduler scheduler(all_seq_filenames, falco_config.threads,
+                            pin_threads);
+    scheduler.run([&](const string &filename, const bool split) {
+      // falco_config is passed by value so each file uses a copy of its
+      // options and input fields, since processFile modifies them
+      processFile(falco_config, filename, split, argpass_struct, scheduler);
+    });
+
+    if (!falco_config.quiet && scheduler.num_threads > 1)
+      scheduler.report_timing(cerr);
+    if (run_report)
+      run_report->write(run_report_prefix, &writer);
+    writer.finish();
     }
     catch (const runtime_error &e) {
     cerr << e.what() << endl;
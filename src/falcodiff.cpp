@@ -16,14 +16,19 @@
  */
 
 #include <fstream>
+#include <sstream>
 #include <chrono>
-#include <sys/stat.h>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
 #include "smithlab_utils.hpp"
 #include "OptionParser.hpp"
 #include "FalcoConfig.hpp"
 #include "FastqStats.hpp"
-#include "HtmlMaker.hpp"
-#include "Module.hpp"
+#include "FalcoContext.hpp"
+#include "Profile.hpp"
 
 using std::string;
 using std::runtime_error;
@@ -38,6 +43,8 @@ using std::chrono::system_clock;
 using std::chrono::duration_cast;
 using std::istream;
 using std::ifstream;
+using std::istringstream;
+using std::unordered_map;
 using time_point = std::chrono::time_point<std::chrono::system_clock>;
 
 // Function to get seconds elapsed in program
@@ -57,17 +64,6 @@ log_process(const string &s) {
   cerr << "[" << time_fmt << "] " << s << endl;
 }
 
-// Function to check existance of directory
-static bool
-dir_exists(const string &path) {
-  struct stat info;
-  if (stat(path.c_str(), &info ) != 0)
-    return false;
-  else if (info.st_mode & S_IFDIR)
-    return true;
-  return false;
-}
-
 // ***********************************************************
 // ************ FUNCTIONS TO PARSE TEXT OUTPUT ***************
 // ***********************************************************
@@ -101,106 +97,446 @@ get_module_name(const string &line) {
   return ans;
 }
 
-// prints in tsv the value, a/b and
-void
-print_measure_and_diff(ostream &os,
-                       const string measure,
-                       double v1,
-                       double v2) {
-  os << measure << "\t"
-     << v1 << ":"
-     << v2 << "\t"
-     << abs(v1 - v2) << "\n";
+static string
+get_module_grade(const string &line) {
+  const size_t last_tab = line.find_last_of("\t");
+  return (last_tab == string::npos) ? "" : line.substr(last_tab + 1);
+}
+
+static vector<string>
+split_tabs(const string &line) {
+  vector<string> cells;
+  size_t pos = 0;
+  for (;;) {
+    const size_t tab = line.find('\t', pos);
+    cells.push_back(line.substr(pos, tab - pos));
+    if (tab == string::npos)
+      return cells;
+    pos = tab + 1;
+  }
+}
+
+// whether the whole cell is a number, which is then put in value
+static bool
+parse_number(const string &cell, double &value) {
+  if (cell.empty())
+    return false;
+  char *end = NULL;
+  value = strtod(cell.c_str(), &end);
+  return *end == '\0';
+}
+
+// One module of a fastqc_data.txt. Rows are keyed by their first cell, and
+// rows with a key seen before in the module, like the tiles of the per
+// tile quality, get the number of its occurrence
+struct ReportModule {
+  string grade;
+  vector<string> keys;
+  vector<vector<string> > cells;
+
+  // column names of each row, from the last header line before it
+  vector<vector<string> > headers;
+  vector<size_t> header_of_row;
+};
+
+struct Report {
+  vector<string> module_names;  // in the order of the file
+  unordered_map<string, ReportModule> modules;
+};
+
+// Comment lines in a module are the column names of the rows after them,
+// unless all their cells after the first are numbers, like the total
+// deduplicated percentage, in which case they are a row
+static void
+parse_report(istream &in, Report &report) {
+  ReportModule *module = NULL;
+  unordered_map<string, size_t> num_with_key;
+  string line;
+  while (getline(in, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty())
+      continue;
+
+    if (is_module_end(line)) {
+      module = NULL;
+      continue;
+    }
+    if (is_module_start(line)) {
+      const string name = get_module_name(line);
+      if (report.modules.count(name) > 0)
+        throw runtime_error("module found twice: " + name);
+      report.module_names.push_back(name);
+      module = &report.modules[name];
+      module->grade = get_module_grade(line);
+      module->headers.push_back(vector<string>());
+      num_with_key.clear();
+      continue;
+    }
+
+    // lines outside modules, like the version, are not compared
+    if (module == NULL)
+      continue;
+
+    vector<string> cells = split_tabs(line);
+    if (is_skippable(line)) {
+      bool is_row = (cells.size() > 1);
+      double value = 0.0;
+      for (size_t i = 1; i < cells.size() && is_row; ++i)
+        is_row = parse_number(cells[i], value);
+      if (!is_row) {
+        cells[0] = cells[0].substr(1);
+        module->headers.push_back(cells);
+        continue;
+      }
+    }
+
+    string key = cells[0];
+    const size_t num_seen = num_with_key[key]++;
+    if (num_seen > 0)
+      key += " (" + to_string(num_seen + 1) + ")";
+    module->keys.push_back(key);
+    cells.erase(begin(cells));
+    module->cells.push_back(cells);
+    module->header_of_row.push_back(module->headers.size() - 1);
+  }
+}
+
+// Reads a fastqc_data.txt, or summarizes a stats snapshot written by falco
+// -snapshot into the same report with the modules of the config
+static void
+load_report(const FalcoConfig &config, const string &filename,
+            Report &report) {
+  ifstream in(filename, std::ifstream::binary);
+  if (!in)
+    throw runtime_error("cannot open " + filename);
+  if (!FastqStats::is_snapshot(in)) {
+    parse_report(in, report);
+    return;
+  }
+
+  FalcoContext context(config, filename);
+  context.add_snapshot(in);
+  context.finalize();
+  std::ostringstream text;
+  context.write_text(text);
+  istringstream text_in(text.str());
+  parse_report(text_in, report);
+}
+
+// ***********************************************************
+// ************ NUMERIC DIFFERENCES OF REPORTS ***************
+// ***********************************************************
+
+struct DiffOptions {
+  double absolute_tolerance;
+  double relative_tolerance;
+  size_t max_differences;  // listed per module, all are counted
+};
+
+// a cell that differs, or a whole row if column is empty, with an empty
+// side if it is missing from that report
+struct CellDiff {
+  string row;
+  string column;
+  string lhs;
+  string rhs;
+  bool lhs_missing;
+  bool rhs_missing;
+};
+
+struct ModuleDiff {
+  string name;
+  string lhs_grade;  // empty if the module is missing from that side
+  string rhs_grade;
+  size_t num_values;
+  size_t num_different;
+  double max_absolute_difference;
+  double max_relative_difference;
+  vector<CellDiff> differences;
+};
+
+struct PairDiff {
+  string name;
+  string lhs;
+  string rhs;
+  string error;  // why the pair could not be compared
+  vector<ModuleDiff> modules;  // only the ones that differ
+};
+
+static string
+join_cells(const vector<string> &cells) {
+  string ans;
+  for (size_t i = 0; i < cells.size(); ++i)
+    ans += (i == 0 ? "" : "\t") + cells[i];
+  return ans;
+}
+
+static void
+add_difference(const DiffOptions &opts, ModuleDiff &diff,
+               const CellDiff &cell) {
+  ++diff.num_different;
+  if (diff.differences.size() < opts.max_differences)
+    diff.differences.push_back(cell);
 }
 
-template <typename T> void
-parse_module(T m1, T m2, istream &lhs, istream &rhs) {
-  string line_lhs, line_rhs;
-  while (getline(lhs, line_lhs) &&
-         getline(rhs, line_rhs) &&
-         !is_module_end(line_lhs) &&
-         !is_module_end(line_rhs)) {
-
-    if (!is_skippable(line_lhs) &&
-        !is_skippable(line_rhs)) {
-      m1.read_data_line(line_lhs);
-      m2.read_data_line(line_rhs);
+// Numbers are equal if they differ by at most the absolute tolerance or
+// by at most the relative tolerance of the larger one, other cells only if
+// they are the same string
+static void
+compare_cell(const DiffOptions &opts, const string &row,
+             const string &column, const string &a, const string &b,
+             ModuleDiff &diff) {
+  ++diff.num_values;
+  double x = 0.0, y = 0.0;
+  bool same = (a == b);
+  if (parse_number(a, x) && parse_number(b, y)) {
+    const double abs_diff = std::fabs(x - y);
+    const double scale = std::max(std::fabs(x), std::fabs(y));
+    const double rel_diff = (scale == 0.0) ? 0.0 : abs_diff / scale;
+    if (!std::isnan(abs_diff)) {
+      diff.max_absolute_difference =
+        std::max(diff.max_absolute_difference, abs_diff);
+      diff.max_relative_difference =
+        std::max(diff.max_relative_difference, rel_diff);
+      same = (abs_diff <= opts.absolute_tolerance ||
+              rel_diff <= opts.relative_tolerance);
     }
   }
+  if (!same) {
+    const CellDiff cell = {row, column, a, b, false, false};
+    add_difference(opts, diff, cell);
+  }
 }
 
-void
-compare_fastqcs(istream &lhs, istream &rhs,
-                ostream &os,
-                const FalcoConfig &config) {
-  string line_lhs, line_rhs, module_name;
-  while (!lhs.eof() && !rhs.eof()) {
-    getline(lhs, line_lhs);
-    getline(rhs, line_rhs);
-
-    if (!is_skippable(line_lhs)) {
-      if (is_skippable(line_rhs))
-        throw runtime_error("lines not aligned (rhs skippable, lhs not");
-
-      if (is_module_start(line_lhs)) {
-        if (line_lhs != line_rhs)
-          throw runtime_error("modules not aligned. lhs = " + line_lhs +
-                              "rhs = " + line_rhs);
-
-        string module_name = get_module_name(line_lhs);
-        // Basic statistics
-        if (module_name == ModuleBasicStatistics::module_name) {
-          // define
-          ModuleBasicStatistics m1(config), m2(config);
-          // read
-          cerr << "parsing basic statistics\n";
-          parse_module(m1, m2, lhs, rhs);
-
-          // write
-          os << "#" << ModuleBasicStatistics::module_name << "\n";
-          os << "LHS file:\t" << m1.filename_stripped << "\n";
-          os << "RHS file:\t" << m2.filename_stripped << "\n";
-          os << "#measure\ta:b\tabs_diff\n";
-          print_measure_and_diff(os, "total_sequences",
-                                      m1.total_sequences,
-                                      m2.total_sequences);
-          print_measure_and_diff(os, "min_read_length",
-                                     m1.min_read_length,
-                                     m2.min_read_length);
-          print_measure_and_diff(os, "max_read_length",
-                                     m1.max_read_length,
-                                     m2.max_read_length);
-          print_measure_and_diff(os,"gc_percent", m1.avg_gc, m2.avg_gc);
-        }
-
-        // Per base sequence quality
-        if (module_name == ModulePerBaseSequenceQuality::module_name) {
-          ModulePerBaseSequenceQuality m1(config), m2(config);
-          cerr << "parsing per base sequence quality\n";
-          // read
-          while (getline(lhs, line_lhs) &&
-                 getline(rhs, line_rhs) &&
-                 !is_module_end(line_lhs) &&
-                 !is_module_end(line_rhs)) {
-
-            if (!is_skippable(line_lhs) &&
-                !is_skippable(line_rhs)) {
-              m1.read_data_line(line_lhs);
-              m2.read_data_line(line_rhs);
-            }
-          }
-        }
+static string
+get_column_name(const ReportModule &module, const size_t row,
+                const size_t col) {
+  const vector<string> &header = module.headers[module.header_of_row[row]];
+  return (col + 1 < header.size()) ? header[col + 1] : to_string(col + 2);
+}
+
+// Rows are matched by key. The filename of the basic statistics names the
+// input rather than its reads, so it is not compared
+static ModuleDiff
+compare_modules(const DiffOptions &opts, const string &name,
+                const ReportModule &lhs, const ReportModule &rhs) {
+  ModuleDiff diff;
+  diff.name = name;
+  diff.lhs_grade = lhs.grade;
+  diff.rhs_grade = rhs.grade;
+  diff.num_values = diff.num_different = 0;
+  diff.max_absolute_difference = diff.max_relative_difference = 0.0;
+  if (lhs.grade != rhs.grade)
+    ++diff.num_different;
+
+  unordered_map<string, size_t> rhs_row;
+  for (size_t i = 0; i < rhs.keys.size(); ++i)
+    rhs_row[rhs.keys[i]] = i;
+
+  vector<bool> rhs_matched(rhs.keys.size(), false);
+  for (size_t i = 0; i < lhs.keys.size(); ++i) {
+    const string &key = lhs.keys[i];
+    if (key == "Filename")
+      continue;
+    const auto it = rhs_row.find(key);
+    if (it == end(rhs_row)) {
+      const CellDiff cell = {key, "", join_cells(lhs.cells[i]), "",
+                             false, true};
+      add_difference(opts, diff, cell);
+      continue;
+    }
+    const size_t j = it->second;
+    rhs_matched[j] = true;
+    const vector<string> &a = lhs.cells[i];
+    const vector<string> &b = rhs.cells[j];
+    for (size_t k = 0; k < std::max(a.size(), b.size()); ++k) {
+      const string column = get_column_name(k < a.size() ? lhs : rhs,
+                                            k < a.size() ? i : j, k);
+      if (k < a.size() && k < b.size())
+        compare_cell(opts, key, column, a[k], b[k], diff);
+      else {
+        ++diff.num_values;
+        const CellDiff cell = {key, column,
+                               k < a.size() ? a[k] : "",
+                               k < b.size() ? b[k] : "",
+                               k >= a.size(), k >= b.size()};
+        add_difference(opts, diff, cell);
       }
     }
+  }
 
-    // check if line in other file is also a comment/skippable
-    else if (!is_skippable(line_rhs)) {
-      throw runtime_error("lines not aligned (lhs skippable, rhs not");
+  for (size_t j = 0; j < rhs.keys.size(); ++j)
+    if (!rhs_matched[j] && rhs.keys[j] != "Filename") {
+      const CellDiff cell = {rhs.keys[j], "", "", join_cells(rhs.cells[j]),
+                             true, false};
+      add_difference(opts, diff, cell);
     }
+  return diff;
+}
+
+static void
+compare_reports(const DiffOptions &opts, const Report &lhs,
+                const Report &rhs, PairDiff &pair) {
+  static const ReportModule missing;
+  vector<string> names = lhs.module_names;
+  for (const string &name : rhs.module_names)
+    if (lhs.modules.count(name) == 0)
+      names.push_back(name);
+
+  for (const string &name : names) {
+    const auto a = lhs.modules.find(name);
+    const auto b = rhs.modules.find(name);
+    const ModuleDiff diff =
+      compare_modules(opts, name,
+                      (a == end(lhs.modules)) ? missing : a->second,
+                      (b == end(rhs.modules)) ? missing : b->second);
+    if (diff.num_different > 0)
+      pair.modules.push_back(diff);
+  }
+}
+
+// ***********************************************************
+// ************ PAIRS AND THE AGGREGATED DIFF ****************
+// ***********************************************************
+
+// Lines of the manifest are the two reports of a pair and optionally a
+// name for it, separated by tabs. Empty lines and comments are skipped
+static vector<PairDiff>
+read_manifest(const string &filename) {
+  ifstream in(filename);
+  if (!in)
+    throw runtime_error("cannot open manifest: " + filename);
+  vector<PairDiff> pairs;
+  string line;
+  for (size_t line_num = 1; getline(in, line); ++line_num) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (is_skippable(line))
+      continue;
+    const vector<string> cells = split_tabs(line);
+    if (cells.size() < 2 || cells.size() > 3)
+      throw runtime_error("line " + to_string(line_num) + " of " + filename +
+                          " is not two reports and an optional name");
+    PairDiff pair;
+    pair.lhs = cells[0];
+    pair.rhs = cells[1];
+    pair.name = (cells.size() == 3) ? cells[2] : cells[0];
+    pairs.push_back(pair);
+  }
+  return pairs;
+}
+
+static void
+diff_pair(const FalcoConfig &config, const DiffOptions &opts,
+          PairDiff &pair) {
+  try {
+    Report lhs, rhs;
+    load_report(config, pair.lhs, lhs);
+    load_report(config, pair.rhs, rhs);
+    compare_reports(opts, lhs, rhs, pair);
+  }
+  catch (const std::exception &e) {
+    pair.error = e.what();
+    pair.modules.clear();
+  }
+}
+
+// the pairs are taken in order by each thread, in any order overall
+static void
+diff_pairs(const FalcoConfig &config, const DiffOptions &opts,
+           const size_t num_threads, vector<PairDiff> &pairs) {
+  std::atomic<size_t> next_pair(0);
+  auto work = [&]() {
+    for (size_t i = next_pair++; i < pairs.size(); i = next_pair++)
+      diff_pair(config, opts, pairs[i]);
+  };
+  vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(num_threads, pairs.size()); ++i)
+    threads.push_back(std::thread(work));
+  work();
+  for (auto &t : threads)
+    t.join();
+}
+
+static void
+write_json_string_or_null(ostream &out, const string &s, const bool null) {
+  if (null)
+    out << "null";
+  else
+    write_json_string(out, s);
+}
+
+static void
+write_module_diff(ostream &out, const ModuleDiff &diff) {
+  out << "{\"name\": ";
+  write_json_string(out, diff.name);
+  out << ", \"lhs_grade\": ";
+  write_json_string_or_null(out, diff.lhs_grade, diff.lhs_grade.empty());
+  out << ", \"rhs_grade\": ";
+  write_json_string_or_null(out, diff.rhs_grade, diff.rhs_grade.empty());
+  out << ", \"num_values\": " << diff.num_values
+      << ", \"num_different\": " << diff.num_different
+      << ", \"max_absolute_difference\": " << diff.max_absolute_difference
+      << ", \"max_relative_difference\": " << diff.max_relative_difference
+      << ", \"differences\": [";
+  for (size_t i = 0; i < diff.differences.size(); ++i) {
+    const CellDiff &cell = diff.differences[i];
+    out << (i == 0 ? "\n          " : ",\n          ") << "{\"row\": ";
+    write_json_string(out, cell.row);
+    out << ", \"column\": ";
+    write_json_string_or_null(out, cell.column, cell.column.empty());
+    out << ", \"lhs\": ";
+    write_json_string_or_null(out, cell.lhs, cell.lhs_missing);
+    out << ", \"rhs\": ";
+    write_json_string_or_null(out, cell.rhs, cell.rhs_missing);
+    out << "}";
+  }
+  out << (diff.differences.empty() ? "]}" : "\n        ]}");
+}
+
+// one object with the totals and the pairs in the order of the manifest
+static void
+write_diffs_json(ostream &out, const DiffOptions &opts,
+                 const vector<PairDiff> &pairs) {
+  size_t num_different = 0, num_errors = 0;
+  for (const PairDiff &pair : pairs) {
+    num_errors += !pair.error.empty();
+    num_different += !pair.modules.empty();
   }
 
-  if (!lhs.eof() || !rhs.eof())
-    throw runtime_error("the two files do not have the same number of lines!");
+  out.precision(10);
+  out << "{\n  \"falco_version\": ";
+  write_json_string(out, FalcoConfig::FalcoVersion);
+  out << ",\n  \"absolute_tolerance\": " << opts.absolute_tolerance
+      << ",\n  \"relative_tolerance\": " << opts.relative_tolerance
+      << ",\n  \"num_pairs\": " << pairs.size()
+      << ",\n  \"num_different\": " << num_different
+      << ",\n  \"num_errors\": " << num_errors
+      << ",\n  \"pairs\": [";
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    const PairDiff &pair = pairs[i];
+    out << (i == 0 ? "\n    " : ",\n    ") << "{\"name\": ";
+    write_json_string(out, pair.name);
+    out << ", \"lhs\": ";
+    write_json_string(out, pair.lhs);
+    out << ", \"rhs\": ";
+    write_json_string(out, pair.rhs);
+    out << ", \"status\": \""
+        << (!pair.error.empty() ? "error" :
+            (pair.modules.empty() ? "same" : "different")) << "\"";
+    if (!pair.error.empty()) {
+      out << ", \"error\": ";
+      write_json_string(out, pair.error);
+    }
+    out << ", \"modules\": [";
+    for (size_t j = 0; j < pair.modules.size(); ++j) {
+      out << (j == 0 ? "\n      " : ",\n      ");
+      write_module_diff(out, pair.modules[j]);
+    }
+    out << (pair.modules.empty() ? "]}" : "\n    ]}");
+  }
+  out << "\n  ]\n}\n";
 }
 
 int main(int argc, const char **argv) {
@@ -209,35 +545,52 @@ int main(int argc, const char **argv) {
     bool help = false;
     bool VERBOSE = false;
 
-
-    // skip outputs
-    bool skip_text = false;
-    bool skip_html = false;
-    bool skip_short_summary = false;
-
-    FalcoConfig config;
-
-    string outdir;
-    const string outdir_description =
-      "Create all output files in the specified output directory. If not"
-      "provided, files will be created in the same directory as the input "
-      "file.";
+    FalcoConfig config(argc, argv);
+    string manifest;
+    string output_file;
+    size_t num_threads = 1;
+    DiffOptions opts;
+    opts.absolute_tolerance = 0.0;
+    opts.relative_tolerance = 0.0;
+    opts.max_differences = 10;
 
     static const string description =
-      "A tool for quality comparison of two samples";
+      "A tool for quality comparison of two samples, or of every pair of "
+      "samples in a manifest. Each report is the fastqc_data.txt of a "
+      "falco or FastQC run, or a stats snapshot written by falco -snapshot. "
+      "All modules are compared value by value, and the differences of all "
+      "pairs are written as one JSON object. Exits with 1 if a pair "
+      "differs or cannot be compared";
 
     /****************** COMMAND LINE OPTIONS ********************/
-    OptionParser opt_parse(argv[0], description, 
-                           "<fastqc_data_1.txt> <fastqc_data_2.txt>");
+    OptionParser opt_parse(argv[0], description,
+                           "[<fastqc_data_1.txt> <fastqc_data_2.txt>]");
     opt_parse.add_opt("-help", 'h', "print this help file and exit", false,
                         help);
-    opt_parse.add_opt("-outdir", 'o', outdir_description, false, outdir);
-    opt_parse.add_opt("-skip-text", 'T', "Skip generating text file "
-                      "(Default = false)", false, skip_text);
-    opt_parse.add_opt("-skip-html", 'H', "Skip generating HTML file "
-                      "(Default = false)", false, skip_html);
-    opt_parse.add_opt("-skip-short-summary", 'S', "Skip short summary"
-                      "(Default = false)", false, skip_short_summary);
+    opt_parse.add_opt("-manifest", 'm', "File with a pair of reports to "
+                      "compare in each line, and optionally a name for the "
+                      "pair, separated by tabs", false, manifest);
+    opt_parse.add_opt("-output", 'o', "Write the differences to this file "
+                      "instead of standard output", false, output_file);
+    opt_parse.add_opt("-threads", 't', "Number of pairs compared at the "
+                      "same time (Default = 1)", false, num_threads);
+    opt_parse.add_opt("-abs-tol", 'a', "Numbers that differ by at most this "
+                      "much are the same (Default = 0)", false,
+                      opts.absolute_tolerance);
+    opt_parse.add_opt("-rel-tol", 'r', "Numbers that differ by at most this "
+                      "fraction of the larger one are the same "
+                      "(Default = 0)", false, opts.relative_tolerance);
+    opt_parse.add_opt("-max-differences", 'd', "Differences listed for each "
+                      "module of a pair, all of which are counted "
+                      "(Default = 10)", false, opts.max_differences);
+    opt_parse.add_opt("-limits", 'l', "Limits file used to summarize stats "
+                      "snapshots, as in falco", false, config.limits_file);
+    opt_parse.add_opt("-adapters", 'A', "Adapters file used to summarize "
+                      "stats snapshots, as in falco", false,
+                      config.adapters_file);
+    opt_parse.add_opt("-contaminants", 'c', "Contaminants file used to "
+                      "summarize stats snapshots, as in falco", false,
+                      config.contaminants_file);
     opt_parse.add_opt("-verbose", 'v', "print more run info", false,
                       VERBOSE);
 
@@ -257,33 +610,50 @@ int main(int argc, const char **argv) {
       return EXIT_SUCCESS;
     }
 
-    if (leftover_args.size() != 2) {
-      cerr << "Number of arguments should be two!\n";
+    vector<PairDiff> pairs;
+    if (!manifest.empty()) {
+      if (!leftover_args.empty())
+        throw runtime_error("reports cannot be given with -manifest");
+      pairs = read_manifest(manifest);
+    }
+    else if (leftover_args.size() == 2) {
+      PairDiff pair;
+      pair.name = pair.lhs = leftover_args[0];
+      pair.rhs = leftover_args[1];
+      pairs.push_back(pair);
+    }
+    else {
+      cerr << "Number of arguments should be two, or none with -manifest!\n";
       cerr << opt_parse.help_message() << endl;
       return EXIT_SUCCESS;
     }
+    /****************** END COMMAND LINE OPTIONS ********************/
 
-    if (!outdir.empty() && !dir_exists(outdir)) {
-      cerr << "output directory does not exist: " << outdir << endl;
-      return EXIT_FAILURE;
-    }
-    const string file1 = leftover_args[0],
-                 file2 = leftover_args[1];
-
-    // read the two files and check if they exist
-    ifstream lhs(file1), rhs(file2);
-    if (!lhs)
-      throw runtime_error("File not found: " + file1);
-    if (!rhs)
-      throw runtime_error("File not found: " + file2);
+    // snapshots are summarized with the modules and limits of the config
+    config.quiet = !VERBOSE;
+    config.read_config_files();
 
-    /****************** END COMMAND LINE OPTIONS ********************/
+    if (VERBOSE)
+      log_process("comparing " + to_string(pairs.size()) + " pairs");
+    diff_pairs(config, opts, std::max(num_threads, static_cast<size_t>(1)),
+               pairs);
+
+    if (output_file.empty())
+      write_diffs_json(cout, opts, pairs);
+    else {
+      ofstream out(output_file);
+      if (!out)
+        throw runtime_error("cannot write to " + output_file);
+      write_diffs_json(out, opts, pairs);
+    }
 
-    compare_fastqcs(lhs, rhs, cout, config);
     if (VERBOSE)
       cerr << "Elapsed time: "
            << get_seconds_since(file_start_time) << "s" << endl;
 
+    for (const PairDiff &pair : pairs)
+      if (!pair.error.empty() || !pair.modules.empty())
+        return EXIT_FAILURE;
     return EXIT_SUCCESS;
   }
   catch (const runtime_error &e) {
@@ -292,5 +662,3 @@ int main(int argc, const char **argv) {
   }
   return EXIT_SUCCESS;
 }
-
-